@@ -2,22 +2,210 @@
 
 #include "abisnax.h"
 #include "abisnax.hpp"
+#include "abisnax_jit.hpp"
 
+#include <atomic>
+#include <list>
 #include <memory>
 
 inline const bool catch_all = true;
 
 using namespace abisnax;
 
+inline constexpr uint32_t latest_block = 0xffff'ffff;
+
+// Abis for one contract, keyed by the first block each applies to
+using contract_versions = std::map<uint32_t, std::shared_ptr<contract>>;
+
+struct abisnax_registry_s {
+    std::atomic<uint32_t> ref_count{1};
+    std::atomic<bool> published{false};
+    const char* last_error = "";
+    std::string last_error_buffer{};
+
+    std::map<name, contract_versions> contracts{};
+};
+
+struct abisnax_type_handle_s : std::enable_shared_from_this<abisnax_type_handle_s> {
+    const abi_type* type = nullptr;
+    bin_to_json_program bin_to_json{};
+    json_to_bin_program json_to_bin{};
+    const generated_codec* codec = nullptr;
+    std::map<std::string, abi_type> scratch{};
+
+    // bin_to_json is compiled to native code once uses reaches the context's jit_threshold
+    mutable uint32_t uses = 0;
+    mutable bin_to_json_jit_code jit{};
+    std::shared_ptr<const contract> owner{};
+
+    mutable uint32_t refs = 0; // abisnax_get_type_handle calls not yet released
+};
+
+struct abisnax_projection_s {
+    ::abisnax::projection projection{};
+    std::shared_ptr<const abisnax_type_handle> handle{}; // keeps the types alive
+};
+
+struct abisnax_predicate_s {
+    ::abisnax::predicate predicate{};
+    std::shared_ptr<const abisnax_type_handle> handle{}; // keeps the types alive
+};
+
+struct abisnax_bin_index_s {
+    ::abisnax::bin_index index{};
+    std::shared_ptr<const abisnax_type_handle> handle{}; // keeps the types alive
+};
+
+struct abisnax_json_stream_s {
+    std::shared_ptr<const abisnax_type_handle> handle; // keeps the types alive
+    json_to_bin_chunked chunked;
+
+    explicit abisnax_json_stream_s(const abisnax_type_handle* handle)
+        : handle{handle->shared_from_this()}, chunked{&handle->json_to_bin} {}
+};
+
 struct abisnax_context_s {
     const char* last_error = "";
     std::string last_error_buffer{};
     std::string result_str{};
     std::vector<char> result_bin{};
 
-    std::map<name, contract> contracts{};
+    std::string batch_arena{};
+    std::vector<abisnax_batch_result> batch_results{};
+
+    // Contracts are kept in least-recently-used order. Once the estimated size of all contracts exceeds cache_limit
+    // (0 for no limit), the least recently used are dropped and loaded again through loader when next needed.
+    struct cached_contract {
+        contract_versions versions{};
+        size_t size = 0;
+        std::list<name>::iterator lru_pos{};
+    };
+    std::map<name, cached_contract> contracts{};
+    std::list<name> lru{};
+    size_t cache_size = 0;
+    size_t cache_limit = 0;
+    abisnax_abi_loader loader = nullptr;
+    void* loader_data = nullptr;
+
+    bool lazy_abis = false;
+
+    abisnax_registry* registry = nullptr;
+    uint32_t block_num = latest_block;
+
+    // Handles pin the contract their type came from. Once it's replaced or evicted, or a different contract would be
+    // selected (registry or block), handles move to retired_type_handles until abisnax_release_type_handle releases
+    // them; handles nobody holds are dropped. Projections, predicates, indexes and streams keep the handle they were
+    // made from.
+    std::map<std::pair<uint64_t, std::string>, std::shared_ptr<abisnax_type_handle>> type_handles{};
+    std::map<const abisnax_type_handle*, std::shared_ptr<abisnax_type_handle>> retired_type_handles{};
+
+    // Codecs from abisnax-gen, by type name
+    std::multimap<std::string, const generated_codec*, std::less<>> codecs{};
+
+    uint32_t jit_threshold = 0; // 0 disables the jit
+
+    std::vector<std::unique_ptr<abisnax_projection>> projections{};
+    std::vector<std::unique_ptr<abisnax_predicate>> predicates{};
+    std::vector<std::unique_ptr<abisnax_bin_index>> bin_indexes{};
+    std::vector<std::unique_ptr<abisnax_json_stream>> json_streams{};
+
+    json_dom reorderable_dom{}; // reused by json_to_bin_reorderable
 };
 
+// Set a contract's abi. block_num is the first block it applies to, or latest_block to replace every version.
+void set_version(contract_versions& versions, uint32_t block_num, abisnax::contract&& c) {
+    auto p = std::make_shared<abisnax::contract>(std::move(c));
+    if (block_num == latest_block) {
+        versions.clear();
+        versions[0] = std::move(p);
+    } else {
+        versions[block_num] = std::move(p);
+    }
+}
+
+const std::shared_ptr<contract>* find_version(const contract_versions& versions, uint32_t block_num) {
+    auto it = versions.upper_bound(block_num);
+    if (it == versions.begin())
+        return nullptr;
+    return &std::prev(it)->second;
+}
+
+// Rough heap usage of a contract, used to enforce the cache limit
+size_t estimate_size(const contract& c) {
+    static constexpr size_t node_size = 4 * sizeof(void*);
+    size_t size = sizeof(c);
+    for (auto& [_, type] : c.action_types)
+        size += node_size + sizeof(name) + sizeof(type) + type.capacity();
+    for (auto& [_, type] : c.table_types)
+        size += node_size + sizeof(name) + sizeof(type) + type.capacity();
+    for (auto& [type_name, type] : c.abi_types)
+        size += node_size + sizeof(type_name) + type_name.capacity() + sizeof(type);
+    return size + c.arena.allocated;
+}
+
+void retire_type_handle(abisnax_context* context, std::shared_ptr<abisnax_type_handle>&& handle) {
+    if (handle->refs)
+        context->retired_type_handles.emplace(handle.get(), std::move(handle));
+}
+
+// Retire contract's handles so they stop pinning its abi
+void retire_type_handles(abisnax_context* context, uint64_t contract) {
+    auto& handles = context->type_handles;
+    auto it = handles.lower_bound({contract, std::string{}});
+    while (it != handles.end() && it->first.first == contract) {
+        retire_type_handle(context, std::move(it->second));
+        it = handles.erase(it);
+    }
+}
+
+void evict_contracts(abisnax_context* context) {
+    while (context->cache_limit && context->cache_size > context->cache_limit && context->lru.size() > 1) {
+        auto it = context->contracts.find(context->lru.back());
+        context->cache_size -= it->second.size;
+        retire_type_handles(context, it->first.value);
+        context->contracts.erase(it);
+        context->lru.pop_back();
+    }
+}
+
+void set_contract(abisnax_context* context, uint64_t contract, uint32_t block_num, abisnax::contract&& c) {
+    auto [it, inserted] = context->contracts.try_emplace(name{contract});
+    auto& entry = it->second;
+    if (inserted)
+        entry.lru_pos = context->lru.insert(context->lru.begin(), name{contract});
+    else
+        context->lru.splice(context->lru.begin(), context->lru, entry.lru_pos);
+    set_version(entry.versions, block_num, std::move(c));
+    retire_type_handles(context, contract);
+    context->cache_size -= entry.size;
+    entry.size = 0;
+    for (auto& [_, version] : entry.versions)
+        entry.size += estimate_size(*version);
+    context->cache_size += entry.size;
+    evict_contracts(context);
+}
+
+void remove_contract(abisnax_context* context, uint64_t contract) {
+    auto it = context->contracts.find(name{contract});
+    if (it == context->contracts.end())
+        return;
+    retire_type_handles(context, contract);
+    context->cache_size -= it->second.size;
+    context->lru.erase(it->second.lru_pos);
+    context->contracts.erase(it);
+}
+
+// Destroy an object the context owns. Returns false if the context doesn't own it.
+template <typename T>
+bool destroy_owned(std::vector<std::unique_ptr<T>>& owned, const T* object) {
+    auto it = std::find_if(owned.begin(), owned.end(), [&](auto& p) { return p.get() == object; });
+    if (it == owned.end())
+        return false;
+    std::swap(*it, owned.back());
+    owned.pop_back();
+    return true;
+}
+
 void fix_null_str(const char*& s) {
     if (!s)
         s = "";
@@ -29,8 +217,14 @@ bool set_error(abisnax_context* context, std::string error) noexcept {
     return false;
 }
 
-template <typename T, typename F>
-auto handle_exceptions(abisnax_context* context, T errval, F f) noexcept -> decltype(f()) {
+bool set_error(abisnax_registry* registry, std::string error) noexcept {
+    registry->last_error_buffer = std::move(error);
+    registry->last_error = registry->last_error_buffer.c_str();
+    return false;
+}
+
+template <typename C, typename T, typename F>
+auto handle_exceptions(C* context, T errval, F f) noexcept -> decltype(f()) {
     if (!context)
         return errval;
     try {
@@ -58,7 +252,11 @@ extern "C" abisnax_context* abisnax_create() {
     }
 }
 
-extern "C" void abisnax_destroy(abisnax_context* context) { delete context; }
+extern "C" void abisnax_destroy(abisnax_context* context) {
+    if (context)
+        abisnax_registry_release(context->registry);
+    delete context;
+}
 
 extern "C" const char* abisnax_get_error(abisnax_context* context) {
     if (!context)
@@ -98,79 +296,310 @@ extern "C" const char* abisnax_name_to_string(abisnax_context* context, uint64_t
     });
 }
 
-extern "C" abisnax_bool abisnax_set_abi(abisnax_context* context, uint64_t contract, const char* abi) {
-    fix_null_str(abi);
-    return handle_exceptions(context, false, [&]() {
-        context->last_error = "abi parse error";
-        abi_def def{};
-        std::string error;
-        if (!json_to_native(def, error, abi)) {
-            if (!error.empty())
-                set_error(context, std::move(error));
-            return false;
-        }
-        if (!check_abi_version(def.version, error))
-            return set_error(context, std::move(error));
+template <typename C>
+bool load_abi(C* owner, abisnax::contract& c, const char* abi, bool lazy) {
+    owner->last_error = "abi parse error";
+    abi_def def{};
+    std::string error;
+    if (!json_to_native(def, error, abi)) {
+        if (!error.empty())
+            set_error(owner, std::move(error));
+        return false;
+    }
+    if (!check_abi_version(def.version, error))
+        return set_error(owner, std::move(error));
+    if (!(lazy ? fill_contract_lazy(c, error, std::move(def)) : fill_contract(c, error, def))) {
+        if (!error.empty())
+            set_error(owner, std::move(error));
+        return false;
+    }
+    return true;
+}
+
+template <typename C>
+bool load_abi_bin(C* owner, abisnax::contract& c, const char* data, size_t size, bool lazy) {
+    owner->last_error = "abi parse error";
+    if (!data || !size)
+        return set_error(owner, "no data");
+    std::string error;
+    if (!check_abi_version(input_buffer{data, data + size}, error))
+        return set_error(owner, std::move(error));
+    abi_def def{};
+    input_buffer buf{data, data + size};
+    if (!bin_to_native(def, error, buf)) {
+        if (!error.empty())
+            set_error(owner, std::move(error));
+        return false;
+    }
+    if (!(lazy ? fill_contract_lazy(c, error, std::move(def)) : fill_contract(c, error, def))) {
+        if (!error.empty())
+            set_error(owner, std::move(error));
+        return false;
+    }
+    return true;
+}
+
+template <typename C>
+bool load_abi_hex(C* owner, abisnax::contract& c, const char* hex, bool lazy) {
+    std::vector<char> data;
+    std::string error;
+    if (!unhex(error, hex, hex + strlen(hex), std::back_inserter(data))) {
+        if (!error.empty())
+            set_error(owner, std::move(error));
+        return false;
+    }
+    return load_abi_bin(owner, c, data.data(), data.size(), lazy);
+}
+
+template <typename F>
+abisnax_bool context_set_abi(abisnax_context* context, uint64_t contract, uint32_t block_num, F load) {
+    return handle_exceptions(context, false, [&] {
         abisnax::contract c;
-        if (!fill_contract(c, error, def)) {
-            if (!error.empty())
-                set_error(context, std::move(error));
+        if (!load(c))
             return false;
-        }
-        context->contracts.insert({name{contract}, std::move(c)});
+        set_contract(context, contract, block_num, std::move(c));
         return true;
     });
 }
 
+extern "C" abisnax_bool abisnax_set_abi(abisnax_context* context, uint64_t contract, const char* abi) {
+    fix_null_str(abi);
+    return context_set_abi(context, contract, latest_block, [&](abisnax::contract& c) {
+        return load_abi(context, c, abi, context->lazy_abis);
+    });
+}
+
 extern "C" abisnax_bool abisnax_set_abi_bin(abisnax_context* context, uint64_t contract, const char* data, size_t size) {
+    return context_set_abi(context, contract, latest_block, [&](abisnax::contract& c) {
+        return load_abi_bin(context, c, data, size, context->lazy_abis);
+    });
+}
+
+extern "C" abisnax_bool abisnax_set_abi_hex(abisnax_context* context, uint64_t contract, const char* hex) {
+    fix_null_str(hex);
+    return context_set_abi(context, contract, latest_block, [&](abisnax::contract& c) {
+        return load_abi_hex(context, c, hex, context->lazy_abis);
+    });
+}
+
+extern "C" abisnax_bool abisnax_set_abi_at_block(abisnax_context* context, uint64_t contract, uint32_t block_num,
+                                               const char* abi) {
+    fix_null_str(abi);
+    return context_set_abi(context, contract, block_num, [&](abisnax::contract& c) {
+        return load_abi(context, c, abi, context->lazy_abis);
+    });
+}
+
+extern "C" abisnax_bool abisnax_set_abi_bin_at_block(abisnax_context* context, uint64_t contract, uint32_t block_num,
+                                                   const char* data, size_t size) {
+    return context_set_abi(context, contract, block_num, [&](abisnax::contract& c) {
+        return load_abi_bin(context, c, data, size, context->lazy_abis);
+    });
+}
+
+extern "C" abisnax_bool abisnax_set_abi_hex_at_block(abisnax_context* context, uint64_t contract, uint32_t block_num,
+                                                   const char* hex) {
+    fix_null_str(hex);
+    return context_set_abi(context, contract, block_num, [&](abisnax::contract& c) {
+        return load_abi_hex(context, c, hex, context->lazy_abis);
+    });
+}
+
+extern "C" abisnax_bool abisnax_set_block(abisnax_context* context, uint32_t block_num) {
+    if (!context)
+        return false;
+    context->block_num = block_num;
+    return true;
+}
+
+extern "C" abisnax_bool abisnax_set_lazy_abis(abisnax_context* context, abisnax_bool lazy) {
+    if (!context)
+        return false;
+    context->lazy_abis = lazy;
+    return true;
+}
+
+extern "C" abisnax_bool abisnax_remove_abi(abisnax_context* context, uint64_t contract) {
     return handle_exceptions(context, false, [&] {
-        context->last_error = "abi parse error";
-        if (!data || !size)
-            return set_error(context, "no data");
-        std::string error;
-        if (!check_abi_version(input_buffer{data, data + size}, error))
-            return set_error(context, std::move(error));
-        abi_def def{};
-        input_buffer buf{data, data + size};
-        if (!bin_to_native(def, error, buf)) {
-            if (!error.empty())
-                set_error(context, std::move(error));
-            return false;
-        }
+        remove_contract(context, contract);
+        return true;
+    });
+}
+
+extern "C" abisnax_bool abisnax_set_abi_loader(abisnax_context* context, abisnax_abi_loader loader, void* user_data) {
+    if (!context)
+        return false;
+    context->loader = loader;
+    context->loader_data = user_data;
+    return true;
+}
+
+extern "C" abisnax_bool abisnax_set_abi_cache_limit(abisnax_context* context, size_t limit) {
+    return handle_exceptions(context, false, [&] {
+        context->cache_limit = limit;
+        evict_contracts(context);
+        return true;
+    });
+}
+
+extern "C" size_t abisnax_get_abi_cache_size(abisnax_context* context) {
+    if (!context)
+        return 0;
+    return context->cache_size;
+}
+
+extern "C" abisnax_registry* abisnax_registry_create() {
+    try {
+        return new abisnax_registry{};
+    } catch (...) {
+        if (!catch_all)
+            throw;
+        return nullptr;
+    }
+}
+
+extern "C" void abisnax_registry_release(abisnax_registry* registry) {
+    if (registry && registry->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete registry;
+}
+
+extern "C" const char* abisnax_registry_get_error(abisnax_registry* registry) {
+    if (!registry)
+        return "registry is null";
+    return registry->last_error;
+}
+
+template <typename F>
+abisnax_bool registry_set_abi(abisnax_registry* registry, uint64_t contract, uint32_t block_num, F load) {
+    return handle_exceptions(registry, false, [&] {
+        if (registry->published.load(std::memory_order_acquire))
+            return set_error(registry, "registry is published");
         abisnax::contract c;
-        if (!fill_contract(c, error, def)) {
-            if (!error.empty())
-                set_error(context, std::move(error));
+        if (!load(c))
             return false;
-        }
-        context->contracts.insert({name{contract}, std::move(c)});
+        set_version(registry->contracts[name{contract}], block_num, std::move(c));
         return true;
     });
 }
 
-extern "C" abisnax_bool abisnax_set_abi_hex(abisnax_context* context, uint64_t contract, const char* hex) {
+extern "C" abisnax_bool abisnax_registry_set_abi(abisnax_registry* registry, uint64_t contract, const char* abi) {
+    fix_null_str(abi);
+    return registry_set_abi(registry, contract, latest_block,
+                            [&](abisnax::contract& c) { return load_abi(registry, c, abi, false); });
+}
+
+extern "C" abisnax_bool abisnax_registry_set_abi_bin(abisnax_registry* registry, uint64_t contract, const char* data,
+                                                   size_t size) {
+    return registry_set_abi(registry, contract, latest_block,
+                            [&](abisnax::contract& c) { return load_abi_bin(registry, c, data, size, false); });
+}
+
+extern "C" abisnax_bool abisnax_registry_set_abi_hex(abisnax_registry* registry, uint64_t contract, const char* hex) {
     fix_null_str(hex);
-    return handle_exceptions(context, false, [&]() -> abisnax_bool {
-        std::vector<char> data;
-        std::string error;
-        if (!unhex(error, hex, hex + strlen(hex), std::back_inserter(data))) {
-            if (!error.empty())
-                set_error(context, std::move(error));
-            return false;
+    return registry_set_abi(registry, contract, latest_block,
+                            [&](abisnax::contract& c) { return load_abi_hex(registry, c, hex, false); });
+}
+
+extern "C" abisnax_bool abisnax_registry_set_abi_at_block(abisnax_registry* registry, uint64_t contract,
+                                                        uint32_t block_num, const char* abi) {
+    fix_null_str(abi);
+    return registry_set_abi(registry, contract, block_num,
+                            [&](abisnax::contract& c) { return load_abi(registry, c, abi, false); });
+}
+
+extern "C" abisnax_bool abisnax_registry_set_abi_bin_at_block(abisnax_registry* registry, uint64_t contract,
+                                                            uint32_t block_num, const char* data, size_t size) {
+    return registry_set_abi(registry, contract, block_num,
+                            [&](abisnax::contract& c) { return load_abi_bin(registry, c, data, size, false); });
+}
+
+extern "C" abisnax_bool abisnax_registry_set_abi_hex_at_block(abisnax_registry* registry, uint64_t contract,
+                                                            uint32_t block_num, const char* hex) {
+    fix_null_str(hex);
+    return registry_set_abi(registry, contract, block_num,
+                            [&](abisnax::contract& c) { return load_abi_hex(registry, c, hex, false); });
+}
+
+extern "C" abisnax_bool abisnax_registry_publish(abisnax_registry* registry) {
+    if (!registry)
+        return false;
+    registry->published.store(true, std::memory_order_release);
+    return true;
+}
+
+extern "C" abisnax_bool abisnax_context_attach_registry(abisnax_context* context, abisnax_registry* registry) {
+    return handle_exceptions(context, false, [&] {
+        if (registry) {
+            registry->published.store(true, std::memory_order_release);
+            registry->ref_count.fetch_add(1, std::memory_order_relaxed);
         }
-        return abisnax_set_abi_bin(context, contract, data.data(), data.size());
+        abisnax_registry_release(context->registry);
+        context->registry = registry;
+        return true;
     });
 }
 
+// Find the contract version in effect at the context's current block. Contracts found in neither the context nor the
+// registry are requested from the loader. Throws if the loader supplies an abi which fails to load.
+const std::shared_ptr<contract>* find_contract(abisnax_context* context, uint64_t contract) {
+    auto it = context->contracts.find(name{contract});
+    if (it != context->contracts.end()) {
+        context->lru.splice(context->lru.begin(), context->lru, it->second.lru_pos);
+        if (auto* c = find_version(it->second.versions, context->block_num))
+            return c;
+    }
+    if (context->registry) {
+        auto registry_it = context->registry->contracts.find(name{contract});
+        if (registry_it != context->registry->contracts.end())
+            return find_version(registry_it->second, context->block_num);
+    }
+    if (it != context->contracts.end() || !context->loader)
+        return nullptr;
+
+    const char* data = nullptr;
+    size_t size = 0;
+    if (!context->loader(context->loader_data, contract, &data, &size))
+        return nullptr;
+    abisnax::contract c;
+    if (!load_abi_bin(context, c, data, size, context->lazy_abis))
+        throw std::runtime_error("contract \"" + name_to_string(contract) + "\": " + context->last_error);
+    set_contract(context, contract, latest_block, std::move(c));
+    return find_version(context->contracts[name{contract}].versions, context->block_num);
+}
+
+// Filled contracts already hold every derived type (T?, T[], T$) which their abi uses, so lookups never modify them;
+// other derived types are created in scratch. This lets threads share a contract. Lazily filled contracts are
+// modified as types are first used, so are never shared.
+ABISNAX_NODISCARD bool get_contract_type(std::string& error, const abi_type*& result,
+                                        std::map<std::string, abi_type>& scratch, contract& c, const char* type) {
+    if (!c.def)
+        return get_type(result, error, c.abi_types, scratch, type, 0);
+    abi_type* t;
+    if (!get_type(t, error, c.abi_types, type, 0))
+        return false;
+    if (!t->filled && !fill_type(c, error, *t))
+        return false;
+    result = t;
+    return true;
+}
+
+ABISNAX_NODISCARD bool get_contract_type(abisnax_context* context, std::string& error, const abi_type*& result,
+                                        std::map<std::string, abi_type>& scratch, uint64_t contract,
+                                        const char* type) {
+    auto* c = find_contract(context, contract);
+    if (!c)
+        return set_error(error, "contract \"" + name_to_string(contract) + "\" is not loaded");
+    return get_contract_type(error, result, scratch, **c, type);
+}
+
 extern "C" const char* abisnax_get_type_for_action(abisnax_context* context, uint64_t contract, uint64_t action) {
     return handle_exceptions(context, nullptr, [&] {
-        auto contract_it = context->contracts.find(::abisnax::name{contract});
-        if (contract_it == context->contracts.end())
+        auto* c = find_contract(context, contract);
+        if (!c)
             throw std::runtime_error("contract \"" + name_to_string(contract) + "\" is not loaded");
-        auto& c = contract_it->second;
 
-        auto action_it = c.action_types.find(name{action});
-        if (action_it == c.action_types.end())
+        auto action_it = (*c)->action_types.find(name{action});
+        if (action_it == (*c)->action_types.end())
             throw std::runtime_error("contract \"" + name_to_string(contract) + "\" does not have action \"" +
                                      name_to_string(action) + "\"");
         return action_it->second.c_str();
@@ -179,112 +608,797 @@ extern "C" const char* abisnax_get_type_for_action(abisnax_context* context, uin
 
 extern "C" const char* abisnax_get_type_for_table(abisnax_context* context, uint64_t contract, uint64_t table) {
     return handle_exceptions(context, nullptr, [&] {
-        auto contract_it = context->contracts.find(::abisnax::name{contract});
-        if (contract_it == context->contracts.end())
+        auto* c = find_contract(context, contract);
+        if (!c)
             throw std::runtime_error("contract \"" + name_to_string(contract) + "\" is not loaded");
-        auto& c = contract_it->second;
 
-        auto table_it = c.table_types.find(name{table});
-        if (table_it == c.table_types.end())
+        auto table_it = (*c)->table_types.find(name{table});
+        if (table_it == (*c)->table_types.end())
             throw std::runtime_error("contract \"" + name_to_string(contract) + "\" does not have table \"" +
                                      name_to_string(table) + "\"");
         return table_it->second.c_str();
     });
 }
 
+// t is an abi_type or a json_to_bin_program
+template <typename T>
+bool json_to_bin(abisnax_context* context, const T* t, std::string_view json) {
+    std::string error;
+    context->result_bin.clear();
+    if (!json_to_bin(context->result_bin, error, t, json)) {
+        if (!error.empty())
+            set_error(context, std::move(error));
+        return false;
+    }
+    return true;
+}
+
+bool json_to_bin_insitu(abisnax_context* context, const json_to_bin_program* program, char* json, size_t size) {
+    std::string error;
+    context->result_bin.clear();
+    if (!json_to_bin_insitu(context->result_bin, error, program, json, size)) {
+        if (!error.empty())
+            set_error(context, std::move(error));
+        return false;
+    }
+    return true;
+}
+
+// ordered is t or its json_to_bin_program
+template <typename T>
+bool json_to_bin_reorderable(abisnax_context* context, const abi_type* t, const T* ordered, std::string_view json) {
+    std::string error;
+    context->result_bin.clear();
+    if (!json_to_bin_reorderable(context->result_bin, error, t, ordered, context->reorderable_dom, json)) {
+        if (!error.empty())
+            set_error(context, std::move(error));
+        return false;
+    }
+    return true;
+}
+
+// t is an abi_type, a bin_to_json_program, a bin_to_json_jit_code, a generated_codec or a projection
+template <typename T>
+const char* bin_to_json(abisnax_context* context, const T* t, const char* data, size_t size) {
+    if (!data)
+        size = 0;
+    std::string error;
+    input_buffer bin{data, data + size};
+    if (!bin_to_json(bin, error, t, context->result_str)) {
+        if (!error.empty())
+            set_error(context, std::move(error));
+        return nullptr;
+    }
+    if (bin.pos != bin.end)
+        throw std::runtime_error("Extra data");
+    return context->result_str.c_str();
+}
+
+template <typename T>
+int64_t json_to_bin_into(abisnax_context* context, const T* t, const char* json, char* buf, size_t cap) {
+    std::string error;
+    size_t size = 0;
+    if (!json_to_bin(buf, cap, size, error, t, json)) {
+        if (!error.empty())
+            set_error(context, std::move(error));
+        return -1;
+    }
+    return size;
+}
+
+template <typename T>
+int64_t bin_to_json_into(abisnax_context* context, const T* t, const char* data, size_t size, char* buf, size_t cap) {
+    if (!data)
+        size = 0;
+    std::string error;
+    input_buffer bin{data, data + size};
+    size_t json_size = 0;
+    if (!bin_to_json(bin, error, t, buf, cap, json_size)) {
+        if (!error.empty())
+            set_error(context, std::move(error));
+        return -1;
+    }
+    if (bin.pos != bin.end)
+        throw std::runtime_error("Extra data");
+    return json_size;
+}
+
+bool validate_bin(abisnax_context* context, const abi_type* t, const char* data, size_t size, size_t* consumed) {
+    if (!data)
+        size = 0;
+    std::string error;
+    input_buffer bin{data, data + size};
+    if (!validate_bin(bin, error, t)) {
+        if (!error.empty())
+            set_error(context, std::move(error));
+        return false;
+    }
+    if (consumed)
+        *consumed = bin.pos - data;
+    return true;
+}
+
+template <typename F>
+auto with_hex(abisnax_context* context, const char* hex, F f) -> decltype(f(nullptr, 0)) {
+    std::vector<char> data;
+    std::string error;
+    if (!unhex(error, hex, hex + strlen(hex), std::back_inserter(data))) {
+        if (!error.empty())
+            set_error(context, std::move(error));
+        return {};
+    }
+    return f(data.data(), data.size());
+}
+
+const abisnax_type_handle* get_type_handle(abisnax_context* context, uint64_t contract, const char* type) {
+    auto* c = find_contract(context, contract);
+    if (!c) {
+        (void)set_error(context, "contract \"" + name_to_string(contract) + "\" is not loaded");
+        return nullptr;
+    }
+    auto& handle = context->type_handles[{contract, type}];
+    if (handle && handle->owner == *c)
+        return handle.get();
+    if (handle)
+        retire_type_handle(context, std::move(handle));
+    auto h = std::make_shared<abisnax_type_handle>();
+    std::string error;
+    if (!get_contract_type(error, h->type, h->scratch, **c, type)) {
+        context->type_handles.erase({contract, type});
+        (void)set_error(context, std::move(error));
+        return nullptr;
+    }
+    compile_bin_to_json(h->bin_to_json, h->type);
+    compile_json_to_bin(h->json_to_bin, h->type);
+    auto [begin, end] = context->codecs.equal_range(std::string_view{type});
+    if (begin != end) {
+        auto hash = get_shape_hash(h->type);
+        for (auto it = begin; it != end && !h->codec; ++it)
+            if (it->second->shape_hash == hash)
+                h->codec = it->second;
+        if (h->codec && h->codec->json_to_bin_nodes == h->json_to_bin.nodes.size())
+            h->json_to_bin.generated = h->codec->json_to_bin;
+    }
+    h->owner = *c;
+    handle = std::move(h);
+    return handle.get();
+}
+
+// The handle for type if a codec applies to it, otherwise null. Types no codec names skip the handle lookup.
+const abisnax_type_handle* get_codec_handle(abisnax_context* context, uint64_t contract, const char* type) {
+    if (context->codecs.find(std::string_view{type}) == context->codecs.end())
+        return nullptr;
+    auto* handle = get_type_handle(context, contract, type);
+    return handle && handle->codec ? handle : nullptr;
+}
+
+// The handle for bin_to_json if it may be faster than converting with the abi directly, otherwise null
+const abisnax_type_handle* get_bin_to_json_handle(abisnax_context* context, uint64_t contract, const char* type) {
+    if (!context->jit_threshold)
+        return get_codec_handle(context, contract, type);
+    return get_type_handle(context, contract, type);
+}
+
+// Call f with the fastest bin_to_json converter the handle has: its codec, native code or its program. Native code is
+// compiled once the handle reaches the jit threshold; if that fails, the program remains in use.
+template <typename F>
+auto with_bin_to_json(abisnax_context* context, const abisnax_type_handle* handle, F f) {
+    if (handle->codec)
+        return f(handle->codec);
+    auto threshold = context->jit_threshold;
+    if (threshold && handle->uses < threshold && ++handle->uses == threshold) {
+        std::string error;
+        (void)jit_bin_to_json(handle->jit, error, handle->bin_to_json);
+    }
+    if (handle->jit.code)
+        return f(&handle->jit);
+    return f(&handle->bin_to_json);
+}
+
 extern "C" abisnax_bool abisnax_json_to_bin(abisnax_context* context, uint64_t contract, const char* type,
                                           const char* json) {
-    fix_null_str(type);
     fix_null_str(json);
+    return abisnax_json_to_bin_n(context, contract, type, json, strlen(json));
+}
+
+extern "C" abisnax_bool abisnax_json_to_bin_n(abisnax_context* context, uint64_t contract, const char* type,
+                                            const char* json, size_t size) {
+    fix_null_str(type);
+    std::string_view json_view{json ? json : "", json ? size : 0};
     return handle_exceptions(context, false, [&] {
         context->last_error = "json parse error";
-        auto contract_it = context->contracts.find(::abisnax::name{contract});
-        if (contract_it == context->contracts.end())
-            return set_error(context, "contract \"" + name_to_string(contract) + "\" is not loaded");
-        abi_type* t;
+        if (auto* handle = get_codec_handle(context, contract, type))
+            return json_to_bin(context, &handle->json_to_bin, json_view);
+        std::map<std::string, abi_type> scratch;
+        const abi_type* t;
         std::string error;
-        if (!get_type(t, error, contract_it->second.abi_types, type, 0))
+        if (!get_contract_type(context, error, t, scratch, contract, type))
             return set_error(context, error);
-        context->result_bin.clear();
-        if (!json_to_bin(context->result_bin, error, t, json)) {
-            if (!error.empty())
-                set_error(context, std::move(error));
-            return false;
-        }
-        return true;
+        return json_to_bin(context, t, json_view);
     });
 }
 
 extern "C" abisnax_bool abisnax_json_to_bin_reorderable(abisnax_context* context, uint64_t contract, const char* type,
                                                       const char* json) {
-    fix_null_str(type);
     fix_null_str(json);
+    return abisnax_json_to_bin_reorderable_n(context, contract, type, json, strlen(json));
+}
+
+extern "C" abisnax_bool abisnax_json_to_bin_reorderable_n(abisnax_context* context, uint64_t contract,
+                                                        const char* type, const char* json, size_t size) {
+    fix_null_str(type);
+    std::string_view json_view{json ? json : "", json ? size : 0};
     return handle_exceptions(context, false, [&] {
         context->last_error = "json parse error";
-        auto contract_it = context->contracts.find(::abisnax::name{contract});
-        if (contract_it == context->contracts.end())
-            return set_error(context, "contract \"" + name_to_string(contract) + "\" is not loaded");
-        abi_type* t;
+        if (auto* handle = get_codec_handle(context, contract, type))
+            return json_to_bin_reorderable(context, handle->type, &handle->json_to_bin, json_view);
+        std::map<std::string, abi_type> scratch;
+        const abi_type* t;
         std::string error;
-        if (!get_type(t, error, contract_it->second.abi_types, type, 0))
+        if (!get_contract_type(context, error, t, scratch, contract, type))
             return set_error(context, error);
-        context->result_bin.clear();
-        ::abisnax::jvalue value;
-        if (!json_to_jvalue(value, error, json)) {
-            if (!error.empty())
-                set_error(context, std::move(error));
-            return false;
+        return json_to_bin_reorderable(context, t, t, json_view);
+    });
+}
+
+extern "C" const char* abisnax_bin_to_json(abisnax_context* context, uint64_t contract, const char* type,
+                                          const char* data, size_t size) {
+    fix_null_str(type);
+    return handle_exceptions(context, nullptr, [&]() -> const char* {
+        context->last_error = "binary decode error";
+        if (auto* handle = get_bin_to_json_handle(context, contract, type))
+            return with_bin_to_json(context, handle, [&](auto* t) { return bin_to_json(context, t, data, size); });
+        std::map<std::string, abi_type> scratch;
+        const abi_type* t;
+        std::string error;
+        if (!get_contract_type(context, error, t, scratch, contract, type)) {
+            (void)set_error(context, error);
+            return nullptr;
         }
-        if (!json_to_bin(context->result_bin, error, t, value)) {
-            if (!error.empty())
-                set_error(context, std::move(error));
-            return false;
+        return bin_to_json(context, t, data, size);
+    });
+}
+
+extern "C" const char* abisnax_hex_to_json(abisnax_context* context, uint64_t contract, const char* type,
+                                          const char* hex) {
+    fix_null_str(hex);
+    return handle_exceptions(context, nullptr, [&]() -> const char* {
+        return with_hex(context, hex, [&](const char* data, size_t size) {
+            return abisnax_bin_to_json(context, contract, type, data, size);
+        });
+    });
+}
+
+extern "C" abisnax_bool abisnax_bin_validate(abisnax_context* context, uint64_t contract, const char* type,
+                                           const char* data, size_t size, size_t* consumed) {
+    fix_null_str(type);
+    return handle_exceptions(context, false, [&] {
+        context->last_error = "binary decode error";
+        std::map<std::string, abi_type> scratch;
+        const abi_type* t;
+        std::string error;
+        if (!get_contract_type(context, error, t, scratch, contract, type))
+            return set_error(context, error);
+        return validate_bin(context, t, data, size, consumed);
+    });
+}
+
+extern "C" const abisnax_type_handle* abisnax_get_type_handle(abisnax_context* context, uint64_t contract,
+                                                            const char* type) {
+    fix_null_str(type);
+    return handle_exceptions(context, nullptr, [&]() -> const abisnax_type_handle* {
+        auto* handle = get_type_handle(context, contract, type);
+        if (handle)
+            ++handle->refs;
+        return handle;
+    });
+}
+
+extern "C" abisnax_bool abisnax_release_type_handle(abisnax_context* context, const abisnax_type_handle* type) {
+    return handle_exceptions(context, false, [&] {
+        if (!type)
+            return set_error(context, "type handle is null");
+        auto retired = context->retired_type_handles.find(type);
+        if (retired != context->retired_type_handles.end()) {
+            if (!--retired->second->refs)
+                context->retired_type_handles.erase(retired);
+            return true;
         }
+        auto& handles = context->type_handles;
+        auto it = std::find_if(handles.begin(), handles.end(), [&](auto& h) { return h.second.get() == type; });
+        if (it == handles.end() || !type->refs)
+            return set_error(context, "type handle is not held");
+        --type->refs;
         return true;
     });
 }
 
-extern "C" const char* abisnax_bin_to_json(abisnax_context* context, uint64_t contract, const char* type,
-                                          const char* data, size_t size) {
+extern "C" abisnax_bool abisnax_add_codecs(abisnax_context* context, const abisnax_codec* codecs, size_t count) {
+    return handle_exceptions(context, false, [&] {
+        if (count && !codecs)
+            return set_error(context, "codecs is null");
+        for (size_t i = 0; i < count; ++i)
+            context->codecs.emplace(codecs[i].type, &codecs[i]);
+        for (auto& [_, handle] : context->type_handles)
+            retire_type_handle(context, std::move(handle));
+        context->type_handles.clear();
+        return true;
+    });
+}
+
+extern "C" abisnax_bool abisnax_set_jit_threshold(abisnax_context* context, uint32_t threshold) {
+    return handle_exceptions(context, false, [&] {
+        if (threshold && !jit_supported)
+            return set_error(context, "jit is not supported on this platform");
+        context->jit_threshold = threshold;
+        return true;
+    });
+}
+
+extern "C" abisnax_bool abisnax_json_to_bin_handle(abisnax_context* context, const abisnax_type_handle* type,
+                                                 const char* json) {
+    fix_null_str(json);
+    return abisnax_json_to_bin_handle_n(context, type, json, strlen(json));
+}
+
+extern "C" abisnax_bool abisnax_json_to_bin_handle_n(abisnax_context* context, const abisnax_type_handle* type,
+                                                   const char* json, size_t size) {
+    std::string_view json_view{json ? json : "", json ? size : 0};
+    return handle_exceptions(context, false, [&] {
+        if (!type)
+            return set_error(context, "type handle is null");
+        context->last_error = "json parse error";
+        return json_to_bin(context, &type->json_to_bin, json_view);
+    });
+}
+
+extern "C" abisnax_bool abisnax_json_to_bin_handle_insitu(abisnax_context* context, const abisnax_type_handle* type,
+                                                        char* json, size_t size) {
+    if (!json)
+        size = 0;
+    return handle_exceptions(context, false, [&] {
+        if (!type)
+            return set_error(context, "type handle is null");
+        context->last_error = "json parse error";
+        return json_to_bin_insitu(context, &type->json_to_bin, json, size);
+    });
+}
+
+extern "C" abisnax_json_stream* abisnax_json_stream_begin(abisnax_context* context, uint64_t contract,
+                                                        const char* type) {
     fix_null_str(type);
+    return handle_exceptions(context, nullptr, [&]() -> abisnax_json_stream* {
+        auto* handle = get_type_handle(context, contract, type);
+        if (!handle)
+            return nullptr;
+        return abisnax_json_stream_begin_handle(context, handle);
+    });
+}
+
+extern "C" abisnax_json_stream* abisnax_json_stream_begin_handle(abisnax_context* context,
+                                                               const abisnax_type_handle* type) {
+    return handle_exceptions(context, nullptr, [&]() -> abisnax_json_stream* {
+        if (!type) {
+            (void)set_error(context, "type handle is null");
+            return nullptr;
+        }
+        context->json_streams.push_back(std::make_unique<abisnax_json_stream>(type));
+        return context->json_streams.back().get();
+    });
+}
+
+extern "C" abisnax_bool abisnax_json_stream_feed(abisnax_context* context, abisnax_json_stream* stream,
+                                               const char* data, size_t size) {
+    return handle_exceptions(context, false, [&] {
+        if (!stream)
+            return set_error(context, "stream is null");
+        if (std::none_of(context->json_streams.begin(), context->json_streams.end(),
+                         [&](auto& s) { return s.get() == stream; }))
+            return set_error(context, "stream is not open");
+        context->last_error = "json parse error";
+        if (!stream->chunked.feed({data ? data : "", data ? size : 0}))
+            return set_error(context, stream->chunked.error);
+        return true;
+    });
+}
+
+extern "C" abisnax_bool abisnax_json_stream_end(abisnax_context* context, abisnax_json_stream* stream) {
+    return handle_exceptions(context, false, [&] {
+        auto it = std::find_if(context->json_streams.begin(), context->json_streams.end(),
+                               [&](auto& s) { return s.get() == stream; });
+        if (it == context->json_streams.end())
+            return set_error(context, "stream is not open");
+        auto owned = std::move(*it);
+        context->json_streams.erase(it);
+        context->result_bin.clear();
+        context->last_error = "json parse error";
+        if (!owned->chunked.finish())
+            return set_error(context, std::move(owned->chunked.error));
+        context->result_bin = std::move(owned->chunked.bin);
+        return true;
+    });
+}
+
+extern "C" abisnax_bool abisnax_json_stream_destroy(abisnax_context* context, abisnax_json_stream* stream) {
+    return handle_exceptions(context, false, [&] {
+        if (!destroy_owned(context->json_streams, stream))
+            return set_error(context, "stream is not open");
+        return true;
+    });
+}
+
+extern "C" abisnax_bool abisnax_json_to_bin_reorderable_handle(abisnax_context* context,
+                                                             const abisnax_type_handle* type, const char* json) {
+    fix_null_str(json);
+    return abisnax_json_to_bin_reorderable_handle_n(context, type, json, strlen(json));
+}
+
+extern "C" abisnax_bool abisnax_json_to_bin_reorderable_handle_n(abisnax_context* context,
+                                                               const abisnax_type_handle* type, const char* json,
+                                                               size_t size) {
+    std::string_view json_view{json ? json : "", json ? size : 0};
+    return handle_exceptions(context, false, [&] {
+        if (!type)
+            return set_error(context, "type handle is null");
+        context->last_error = "json parse error";
+        return json_to_bin_reorderable(context, type->type, &type->json_to_bin, json_view);
+    });
+}
+
+extern "C" const char* abisnax_bin_to_json_handle(abisnax_context* context, const abisnax_type_handle* type,
+                                                 const char* data, size_t size) {
     return handle_exceptions(context, nullptr, [&]() -> const char* {
-        if (!data)
-            size = 0;
+        if (!type) {
+            (void)set_error(context, "type handle is null");
+            return nullptr;
+        }
         context->last_error = "binary decode error";
-        auto contract_it = context->contracts.find(::abisnax::name{contract});
+        return with_bin_to_json(context, type, [&](auto* t) { return bin_to_json(context, t, data, size); });
+    });
+}
+
+extern "C" const char* abisnax_hex_to_json_handle(abisnax_context* context, const abisnax_type_handle* type,
+                                                 const char* hex) {
+    fix_null_str(hex);
+    return handle_exceptions(context, nullptr, [&]() -> const char* {
+        return with_hex(context, hex, [&](const char* data, size_t size) {
+            return abisnax_bin_to_json_handle(context, type, data, size);
+        });
+    });
+}
+
+extern "C" abisnax_bool abisnax_bin_validate_handle(abisnax_context* context, const abisnax_type_handle* type,
+                                                  const char* data, size_t size, size_t* consumed) {
+    return handle_exceptions(context, false, [&] {
+        if (!type)
+            return set_error(context, "type handle is null");
+        context->last_error = "binary decode error";
+        return validate_bin(context, type->type, data, size, consumed);
+    });
+}
+
+extern "C" const abisnax_projection* abisnax_compile_projection(abisnax_context* context,
+                                                                const abisnax_type_handle* type,
+                                                                const char* const* paths, size_t count) {
+    return handle_exceptions(context, nullptr, [&]() -> const abisnax_projection* {
+        if (!type) {
+            (void)set_error(context, "type handle is null");
+            return nullptr;
+        }
+        if (count && !paths) {
+            (void)set_error(context, "paths is null");
+            return nullptr;
+        }
+        std::vector<std::string_view> path_views;
+        for (size_t i = 0; i < count; ++i)
+            path_views.push_back(paths[i] ? paths[i] : "");
+        auto p = std::make_unique<abisnax_projection>();
         std::string error;
-        if (contract_it == context->contracts.end()) {
-            (void)set_error(error, "contract \"" + name_to_string(contract) + "\" is not loaded");
+        if (!compile_projection(p->projection, error, type->type, path_views)) {
+            (void)set_error(context, std::move(error));
             return nullptr;
         }
-        abi_type* t;
-        if (!get_type(t, error, contract_it->second.abi_types, type, 0)) {
-            (void)set_error(context, error);
+        p->handle = type->shared_from_this();
+        context->projections.push_back(std::move(p));
+        return context->projections.back().get();
+    });
+}
+
+extern "C" abisnax_bool abisnax_destroy_projection(abisnax_context* context, const abisnax_projection* projection) {
+    return handle_exceptions(context, false, [&] {
+        if (!destroy_owned(context->projections, projection))
+            return set_error(context, "unknown projection");
+        return true;
+    });
+}
+
+extern "C" const char* abisnax_bin_to_json_projection(abisnax_context* context, const abisnax_projection* projection,
+                                                     const char* data, size_t size) {
+    return handle_exceptions(context, nullptr, [&]() -> const char* {
+        if (!projection) {
+            (void)set_error(context, "projection is null");
+            return nullptr;
+        }
+        context->last_error = "binary decode error";
+        return bin_to_json(context, &projection->projection, data, size);
+    });
+}
+
+extern "C" const abisnax_predicate* abisnax_compile_predicate(abisnax_context* context,
+                                                              const abisnax_type_handle* type, const char* predicate) {
+    fix_null_str(predicate);
+    return handle_exceptions(context, nullptr, [&]() -> const abisnax_predicate* {
+        if (!type) {
+            (void)set_error(context, "type handle is null");
+            return nullptr;
+        }
+        auto p = std::make_unique<abisnax_predicate>();
+        std::string error;
+        if (!compile_predicate(p->predicate, error, type->type, predicate)) {
+            (void)set_error(context, std::move(error));
             return nullptr;
         }
+        p->handle = type->shared_from_this();
+        context->predicates.push_back(std::move(p));
+        return context->predicates.back().get();
+    });
+}
+
+extern "C" abisnax_bool abisnax_destroy_predicate(abisnax_context* context, const abisnax_predicate* predicate) {
+    return handle_exceptions(context, false, [&] {
+        if (!destroy_owned(context->predicates, predicate))
+            return set_error(context, "unknown predicate");
+        return true;
+    });
+}
+
+extern "C" int abisnax_match_predicate(abisnax_context* context, const abisnax_predicate* predicate, const char* data,
+                                       size_t size) {
+    return handle_exceptions(context, -1, [&]() -> int {
+        if (!predicate) {
+            (void)set_error(context, "predicate is null");
+            return -1;
+        }
+        context->last_error = "binary decode error";
+        if (!data)
+            size = 0;
         input_buffer bin{data, data + size};
-        if (!bin_to_json(bin, error, t, context->result_str)) {
+        std::string error;
+        bool result;
+        if (!match_predicate(result, bin, error, predicate->predicate)) {
             if (!error.empty())
                 set_error(context, std::move(error));
-            return nullptr;
+            return -1;
         }
-        if (bin.pos != bin.end)
+        return result;
+    });
+}
+
+extern "C" abisnax_bin_index* abisnax_create_bin_index(abisnax_context* context) {
+    return handle_exceptions(context, nullptr, [&]() -> abisnax_bin_index* {
+        context->bin_indexes.push_back(std::make_unique<abisnax_bin_index>());
+        return context->bin_indexes.back().get();
+    });
+}
+
+extern "C" abisnax_bool abisnax_destroy_bin_index(abisnax_context* context, abisnax_bin_index* index) {
+    return handle_exceptions(context, false, [&] {
+        if (!destroy_owned(context->bin_indexes, index))
+            return set_error(context, "unknown bin index");
+        return true;
+    });
+}
+
+extern "C" abisnax_bool abisnax_index_bin(abisnax_context* context, abisnax_bin_index* index,
+                                        const abisnax_type_handle* type, const char* data, size_t size) {
+    return handle_exceptions(context, false, [&] {
+        if (!index)
+            return set_error(context, "index is null");
+        index->handle.reset();
+        if (!type)
+            return set_error(context, "type handle is null");
+        context->last_error = "binary decode error";
+        if (!data)
+            size = 0;
+        std::string error;
+        if (!index_bin(index->index, error, type->type, data, size)) {
+            if (!error.empty())
+                set_error(context, std::move(error));
+            return false;
+        }
+        if (index->index.entries[0].size != size) {
+            index->index.entries.clear();
             throw std::runtime_error("Extra data");
+        }
+        index->handle = type->shared_from_this();
+        return true;
+    });
+}
+
+// Find the part of index at path. Returns false on error.
+bool get_bin_index_value(abisnax_context* context, bin_index_value& value, const abisnax_bin_index* index,
+                         const uint32_t* path, size_t depth) {
+    if (!index)
+        return set_error(context, "index is null");
+    if (depth && !path)
+        return set_error(context, "path is null");
+    std::string error;
+    if (!get_child(value, error, index->index, path, depth))
+        return set_error(context, std::move(error));
+    return true;
+}
+
+extern "C" int64_t abisnax_bin_index_count(abisnax_context* context, const abisnax_bin_index* index,
+                                          const uint32_t* path, size_t depth) {
+    return handle_exceptions(context, -1, [&]() -> int64_t {
+        bin_index_value value;
+        if (!get_bin_index_value(context, value, index, path, depth))
+            return -1;
+        return num_children(value);
+    });
+}
+
+extern "C" const char* abisnax_bin_index_type(abisnax_context* context, const abisnax_bin_index* index,
+                                             const uint32_t* path, size_t depth) {
+    return handle_exceptions(context, nullptr, [&]() -> const char* {
+        bin_index_value value;
+        if (!get_bin_index_value(context, value, index, path, depth))
+            return nullptr;
+        context->result_str = value.type->name;
         return context->result_str.c_str();
     });
 }
 
-extern "C" const char* abisnax_hex_to_json(abisnax_context* context, uint64_t contract, const char* type,
-                                          const char* hex) {
-    fix_null_str(hex);
+extern "C" abisnax_bool abisnax_bin_index_get_bin(abisnax_context* context, const abisnax_bin_index* index,
+                                                const uint32_t* path, size_t depth, const char** data, size_t* size) {
+    return handle_exceptions(context, false, [&] {
+        if (!data || !size)
+            return set_error(context, "data or size is null");
+        bin_index_value value;
+        if (!get_bin_index_value(context, value, index, path, depth))
+            return false;
+        *data = index->index.data.data() + value.offset;
+        *size = value.size;
+        return true;
+    });
+}
+
+extern "C" const char* abisnax_bin_index_to_json(abisnax_context* context, const abisnax_bin_index* index,
+                                                const uint32_t* path, size_t depth) {
     return handle_exceptions(context, nullptr, [&]() -> const char* {
-        std::vector<char> data;
+        bin_index_value value;
+        if (!get_bin_index_value(context, value, index, path, depth))
+            return nullptr;
+        context->last_error = "binary decode error";
+        return bin_to_json(context, value.type, index->index.data.data() + value.offset, value.size);
+    });
+}
+
+extern "C" int64_t abisnax_json_to_bin_into(abisnax_context* context, uint64_t contract, const char* type,
+                                           const char* json, char* buf, size_t cap) {
+    fix_null_str(type);
+    fix_null_str(json);
+    return handle_exceptions(context, -1, [&]() -> int64_t {
+        context->last_error = "json parse error";
+        if (auto* handle = get_codec_handle(context, contract, type))
+            return json_to_bin_into(context, &handle->json_to_bin, json, buf, cap);
+        std::map<std::string, abi_type> scratch;
+        const abi_type* t;
         std::string error;
-        if (!unhex(error, hex, hex + strlen(hex), std::back_inserter(data))) {
-            if (!error.empty())
-                set_error(context, std::move(error));
+        if (!get_contract_type(context, error, t, scratch, contract, type)) {
+            (void)set_error(context, error);
+            return -1;
+        }
+        return json_to_bin_into(context, t, json, buf, cap);
+    });
+}
+
+extern "C" int64_t abisnax_bin_to_json_into(abisnax_context* context, uint64_t contract, const char* type,
+                                           const char* data, size_t size, char* buf, size_t cap) {
+    fix_null_str(type);
+    return handle_exceptions(context, -1, [&]() -> int64_t {
+        context->last_error = "binary decode error";
+        if (auto* handle = get_bin_to_json_handle(context, contract, type)) {
+            return with_bin_to_json(context, handle,
+                                    [&](auto* t) { return bin_to_json_into(context, t, data, size, buf, cap); });
+        }
+        std::map<std::string, abi_type> scratch;
+        const abi_type* t;
+        std::string error;
+        if (!get_contract_type(context, error, t, scratch, contract, type)) {
+            (void)set_error(context, error);
+            return -1;
+        }
+        return bin_to_json_into(context, t, data, size, buf, cap);
+    });
+}
+
+extern "C" int64_t abisnax_json_to_bin_handle_into(abisnax_context* context, const abisnax_type_handle* type,
+                                                  const char* json, char* buf, size_t cap) {
+    fix_null_str(json);
+    return handle_exceptions(context, -1, [&]() -> int64_t {
+        if (!type) {
+            (void)set_error(context, "type handle is null");
+            return -1;
+        }
+        context->last_error = "json parse error";
+        return json_to_bin_into(context, &type->json_to_bin, json, buf, cap);
+    });
+}
+
+extern "C" int64_t abisnax_bin_to_json_handle_into(abisnax_context* context, const abisnax_type_handle* type,
+                                                  const char* data, size_t size, char* buf, size_t cap) {
+    return handle_exceptions(context, -1, [&]() -> int64_t {
+        if (!type) {
+            (void)set_error(context, "type handle is null");
+            return -1;
+        }
+        context->last_error = "binary decode error";
+        return with_bin_to_json(context, type,
+                                [&](auto* t) { return bin_to_json_into(context, t, data, size, buf, cap); });
+    });
+}
+
+extern "C" const abisnax_batch_result* abisnax_bin_to_json_batch(abisnax_context* context, size_t count,
+                                                                const uint64_t* contracts, const char* const* types,
+                                                                const char* const* data, const size_t* sizes) {
+    return handle_exceptions(context, nullptr, [&]() -> const abisnax_batch_result* {
+        if (count && (!contracts || !types || !data || !sizes)) {
+            (void)set_error(context, "batch arrays are null");
             return nullptr;
         }
-        return abisnax_bin_to_json(context, contract, type, data.data(), data.size());
+        context->batch_arena.clear();
+        context->batch_results.clear();
+        context->batch_results.reserve(count);
+
+        // Batches usually hold runs of the same few action types
+        std::map<std::string, abi_type> scratch;
+        std::map<std::pair<uint64_t, std::string_view>, std::pair<const abi_type*, bin_to_json_program>> types_seen;
+        std::vector<std::shared_ptr<contract>> pinned; // loading later items may evict earlier contracts
+        std::string error;
+        for (size_t i = 0; i < count; ++i) {
+            auto& result = context->batch_results.emplace_back();
+            result.offset = context->batch_arena.size();
+            error.clear();
+            bool ok = [&] {
+                std::string_view type = types[i] ? types[i] : "";
+                auto& [t, program] = types_seen[{contracts[i], type}];
+                if (!t) {
+                    const std::shared_ptr<contract>* c;
+                    try {
+                        c = find_contract(context, contracts[i]);
+                    } catch (std::exception& e) {
+                        return set_error(error, e.what());
+                    }
+                    if (!c)
+                        return set_error(error, "contract \"" + name_to_string(contracts[i]) + "\" is not loaded");
+                    pinned.push_back(*c);
+                    if (!get_contract_type(error, t, scratch, **c, types[i] ? types[i] : ""))
+                        return false;
+                    compile_bin_to_json(program, t);
+                }
+                input_buffer bin{data[i], data[i] ? data[i] + sizes[i] : data[i]};
+                json_output_stream stream{context->batch_arena};
+                bool ok = bin_to_json(bin, error, &program, stream);
+                stream.finish();
+                if (ok && bin.pos != bin.end)
+                    return set_error(error, "Extra data");
+                return ok;
+            }();
+            if (!ok) {
+                context->batch_arena.resize(result.offset);
+                context->batch_arena += error.empty() ? "binary decode error" : error;
+            }
+            result.size = context->batch_arena.size() - result.offset;
+            result.ok = ok;
+            context->batch_arena.push_back(0);
+        }
+        return context->batch_results.data();
     });
 }
+
+extern "C" const char* abisnax_get_batch_arena(abisnax_context* context) {
+    if (!context)
+        return nullptr;
+    return context->batch_arena.c_str();
+}
@@ -10,6 +10,13 @@ extern "C" {
 #endif
 
 typedef struct abisnax_context_s abisnax_context;
+typedef struct abisnax_registry_s abisnax_registry;
+typedef struct abisnax_type_handle_s abisnax_type_handle;
+typedef struct abisnax_codec_s abisnax_codec;
+typedef struct abisnax_projection_s abisnax_projection;
+typedef struct abisnax_predicate_s abisnax_predicate;
+typedef struct abisnax_bin_index_s abisnax_bin_index;
+typedef struct abisnax_json_stream_s abisnax_json_stream;
 typedef int abisnax_bool;
 
 // Create a context. The context holds all memory allocated by functions in this header. Returns null on failure.
@@ -35,15 +42,107 @@ const char* abisnax_get_bin_hex(abisnax_context* context);
 uint64_t abisnax_string_to_name(abisnax_context* context, const char* str);
 const char* abisnax_name_to_string(abisnax_context* context, uint64_t name);
 
-// Set abi (JSON format). Returns false on error.
+// Set abi (JSON format). Replaces any abis previously set for the contract, including those set for specific blocks. If
+// this fails, the previous abis remain in place. Returns false on error.
 abisnax_bool abisnax_set_abi(abisnax_context* context, uint64_t contract, const char* abi);
 
-// Set abi (binary format). Returns false on error.
+// Set abi (binary format). Replaces any abis previously set for the contract, including those set for specific blocks.
+// If this fails, the previous abis remain in place. Returns false on error.
 abisnax_bool abisnax_set_abi_bin(abisnax_context* context, uint64_t contract, const char* data, size_t size);
 
-// Set abi (hex format). Returns false on error.
+// Set abi (hex format). Replaces any abis previously set for the contract, including those set for specific blocks. If
+// this fails, the previous abis remain in place. Returns false on error.
 abisnax_bool abisnax_set_abi_hex(abisnax_context* context, uint64_t contract, const char* hex);
 
+// Set abi (JSON format) which is in effect from block_num until the block of the contract's next abi. Abis set for
+// other blocks are kept; see abisnax_set_block. Returns false on error.
+abisnax_bool abisnax_set_abi_at_block(abisnax_context* context, uint64_t contract, uint32_t block_num,
+                                    const char* abi);
+
+// Set abi (binary format) which is in effect from block_num until the block of the contract's next abi. Abis set for
+// other blocks are kept; see abisnax_set_block. Returns false on error.
+abisnax_bool abisnax_set_abi_bin_at_block(abisnax_context* context, uint64_t contract, uint32_t block_num,
+                                        const char* data, size_t size);
+
+// Set abi (hex format) which is in effect from block_num until the block of the contract's next abi. Abis set for
+// other blocks are kept; see abisnax_set_block. Returns false on error.
+abisnax_bool abisnax_set_abi_hex_at_block(abisnax_context* context, uint64_t contract, uint32_t block_num,
+                                        const char* hex);
+
+// Select the block whose abis the following calls use. The default, 0xffffffff, selects each contract's latest abi.
+// Returns false on error.
+abisnax_bool abisnax_set_block(abisnax_context* context, uint32_t block_num);
+
+// Choose whether abis set afterwards are loaded lazily. Lazily loaded abis are only parsed when set; each type is
+// resolved and checked when first used, so errors in types which are never used go unreported. Abis in a registry are
+// never loaded lazily. Returns false on error.
+abisnax_bool abisnax_set_lazy_abis(abisnax_context* context, abisnax_bool lazy);
+
+// Remove every abi set for a contract. Returns false on error.
+abisnax_bool abisnax_remove_abi(abisnax_context* context, uint64_t contract);
+
+// Supplies the abi (binary format) of a contract which isn't loaded. Set *data and *size and return true, or return
+// false if there is no abi. The data only needs to remain valid until the loader is called again or the context is
+// destroyed. The loader must not call into the context.
+typedef abisnax_bool (*abisnax_abi_loader)(void* user_data, uint64_t contract, const char** data, size_t* size);
+
+// Set the loader used when a contract is found in neither the context nor its registry. The loaded abi applies to all
+// blocks. Pass null to remove the loader. Returns false on error.
+abisnax_bool abisnax_set_abi_loader(abisnax_context* context, abisnax_abi_loader loader, void* user_data);
+
+// Limit the estimated memory, in bytes, used by the context's contracts; 0 (the default) means no limit. Once the limit
+// is exceeded, the least recently used contracts are removed, and are loaded again through the loader when next
+// needed. The most recently used contract is always kept. Contracts in a registry are not counted. Returns false on
+// error.
+abisnax_bool abisnax_set_abi_cache_limit(abisnax_context* context, size_t limit);
+
+// Get the estimated memory, in bytes, used by the context's contracts.
+size_t abisnax_get_abi_cache_size(abisnax_context* context);
+
+// Create a registry. A registry holds abis which many contexts may share. Returns null on failure.
+abisnax_registry* abisnax_registry_create();
+
+// Release a reference to a registry. The registry is destroyed once the creator and every attached context have
+// released it.
+void abisnax_registry_release(abisnax_registry* registry);
+
+// Get last error from a registry function. Never returns null. The registry owns the returned string.
+const char* abisnax_registry_get_error(abisnax_registry* registry);
+
+// Set abi (JSON format) in a registry. Fails once the registry is published. Returns false on error.
+abisnax_bool abisnax_registry_set_abi(abisnax_registry* registry, uint64_t contract, const char* abi);
+
+// Set abi (binary format) in a registry. Fails once the registry is published. Returns false on error.
+abisnax_bool abisnax_registry_set_abi_bin(abisnax_registry* registry, uint64_t contract, const char* data,
+                                         size_t size);
+
+// Set abi (hex format) in a registry. Fails once the registry is published. Returns false on error.
+abisnax_bool abisnax_registry_set_abi_hex(abisnax_registry* registry, uint64_t contract, const char* hex);
+
+// Set abi (JSON format) in a registry, in effect from block_num. Fails once the registry is published. Returns false
+// on error.
+abisnax_bool abisnax_registry_set_abi_at_block(abisnax_registry* registry, uint64_t contract, uint32_t block_num,
+                                             const char* abi);
+
+// Set abi (binary format) in a registry, in effect from block_num. Fails once the registry is published. Returns
+// false on error.
+abisnax_bool abisnax_registry_set_abi_bin_at_block(abisnax_registry* registry, uint64_t contract, uint32_t block_num,
+                                                 const char* data, size_t size);
+
+// Set abi (hex format) in a registry, in effect from block_num. Fails once the registry is published. Returns false
+// on error.
+abisnax_bool abisnax_registry_set_abi_hex_at_block(abisnax_registry* registry, uint64_t contract, uint32_t block_num,
+                                                 const char* hex);
+
+// Publish a registry. A published registry is immutable; any number of contexts, on any number of threads, may read it
+// concurrently without locking. Returns false on error.
+abisnax_bool abisnax_registry_publish(abisnax_registry* registry);
+
+// Attach a registry to a context, publishing it if needed. The context holds a reference to the registry until it is
+// destroyed or another registry is attached. Pass null to detach. Contracts set directly on the context take precedence
+// over contracts in the registry. Returns false on error.
+abisnax_bool abisnax_context_attach_registry(abisnax_context* context, abisnax_registry* registry);
+
 // Get the type name for an action. The contract owns the returned memory. Returns null on error; use abisnax_get_error
 // to retrieve error.
 const char* abisnax_get_type_for_action(abisnax_context* context, uint64_t contract, uint64_t action);
@@ -55,19 +154,223 @@ const char* abisnax_get_type_for_table(abisnax_context* context, uint64_t contra
 // Convert json to binary. Use abisnax_get_bin_* to retrieve result. Returns false on error.
 abisnax_bool abisnax_json_to_bin(abisnax_context* context, uint64_t contract, const char* type, const char* json);
 
-// Convert json to binary. Allow json field reordering. Use abisnax_get_bin_* to retrieve result. Returns false on error.
+// Convert json to binary. Allow json field reordering. Json with its fields in order converts about as fast as with
+// abisnax_json_to_bin; other json is parsed again into a dom. Use abisnax_get_bin_* to retrieve result. Returns false
+// on error.
 abisnax_bool abisnax_json_to_bin_reorderable(abisnax_context* context, uint64_t contract, const char* type,
                                            const char* json);
 
+// The *_n functions take json as [json, json + size), which needn't be null-terminated, and behave like the functions
+// without the suffix. The json isn't copied.
+abisnax_bool abisnax_json_to_bin_n(abisnax_context* context, uint64_t contract, const char* type, const char* json,
+                                 size_t size);
+abisnax_bool abisnax_json_to_bin_reorderable_n(abisnax_context* context, uint64_t contract, const char* type,
+                                             const char* json, size_t size);
+
 // Convert binary to json. The context owns the returned string. Returns null on error; use abisnax_get_error to retrieve
 // error.
 const char* abisnax_bin_to_json(abisnax_context* context, uint64_t contract, const char* type, const char* data,
                                size_t size);
 
+// Check that data starts with a well-formed value of type without converting it, which is much faster than
+// abisnax_bin_to_json. Unlike abisnax_bin_to_json, data after the value isn't an error: on success, *consumed (if not
+// null) receives the size of the value. Returns false on error.
+abisnax_bool abisnax_bin_validate(abisnax_context* context, uint64_t contract, const char* type, const char* data,
+                                size_t size, size_t* consumed);
+
 // Convert hex to json. The context owns the returned memory. Returns null on error; use abisnax_get_error to retrieve
 // error.
 const char* abisnax_hex_to_json(abisnax_context* context, uint64_t contract, const char* type, const char* hex);
 
+// Resolve a type once for use with the *_handle functions below, which skip the contract and type lookups. The handle
+// keeps using the abi in effect when it was resolved, even if the abi is replaced later. Resolving the same contract
+// and type again returns the same handle unless the abi changed. The context owns the handle; it remains valid until
+// the context is destroyed or abisnax_release_type_handle has been called once for each time it was returned. Once the
+// abi is replaced or evicted, the handle is retired and keeps the old abi alive until it's released. Projections,
+// predicates, indexes and streams made from a handle keep it alive. Returns null on error; use abisnax_get_error to
+// retrieve error.
+const abisnax_type_handle* abisnax_get_type_handle(abisnax_context* context, uint64_t contract, const char* type);
+
+// Release a handle returned by abisnax_get_type_handle. Returns false on error.
+abisnax_bool abisnax_release_type_handle(abisnax_context* context, const abisnax_type_handle* type);
+
+// Add codecs generated by abisnax-gen. The bin_to_json, hex_to_json, json_to_bin and json_to_bin_reorderable functions,
+// including the *_handle and *_into variants and json streams, then use a codec in place of the abi when the type's
+// name and shape match the ones it was generated from. codecs must remain valid until the context is destroyed. Handles
+// resolved earlier are retired. Returns false on error.
+abisnax_bool abisnax_add_codecs(abisnax_context* context, const abisnax_codec* codecs, size_t count);
+
+// Compile a type's bin_to_json to native code once its type handle has been used for threshold conversions. The
+// bin_to_json and hex_to_json functions, including the *_into variants, use type handles for this even when not called
+// with one. 0, the default, disables the jit; the bench target compares it with the interpreter. Only supported on
+// x86-64 Linux. Returns false on error.
+abisnax_bool abisnax_set_jit_threshold(abisnax_context* context, uint32_t threshold);
+
+// Convert json to binary using a type handle. Use abisnax_get_bin_* to retrieve result. Returns false on error.
+abisnax_bool abisnax_json_to_bin_handle(abisnax_context* context, const abisnax_type_handle* type, const char* json);
+
+// Convert json to binary using a type handle. Allow json field reordering. Use abisnax_get_bin_* to retrieve result.
+// Returns false on error.
+abisnax_bool abisnax_json_to_bin_reorderable_handle(abisnax_context* context, const abisnax_type_handle* type,
+                                                  const char* json);
+
+// Length-delimited versions of the functions above; see abisnax_json_to_bin_n
+abisnax_bool abisnax_json_to_bin_handle_n(abisnax_context* context, const abisnax_type_handle* type, const char* json,
+                                        size_t size);
+abisnax_bool abisnax_json_to_bin_reorderable_handle_n(abisnax_context* context, const abisnax_type_handle* type,
+                                                    const char* json, size_t size);
+
+// Like abisnax_json_to_bin_handle_n, but parses the json in place, which avoids copying its strings. The content of
+// [json, json + size) is unspecified afterward.
+abisnax_bool abisnax_json_to_bin_handle_insitu(abisnax_context* context, const abisnax_type_handle* type, char* json,
+                                             size_t size);
+
+// Convert json which arrives in chunks, e.g. from a socket, without holding all of it in memory. Begin a stream, feed
+// it the chunks in order, then end it. Binary is produced as each chunk is parsed. Fields must be in order, as with
+// abisnax_json_to_bin. Several streams may be open at once. The context owns the stream; it remains valid until
+// abisnax_json_stream_end or abisnax_json_stream_destroy, one of which must be called even after an error. Returns
+// null on error; use abisnax_get_error to retrieve error.
+abisnax_json_stream* abisnax_json_stream_begin(abisnax_context* context, uint64_t contract, const char* type);
+
+// Begin a stream using a type handle; see abisnax_json_stream_begin
+abisnax_json_stream* abisnax_json_stream_begin_handle(abisnax_context* context, const abisnax_type_handle* type);
+
+// Convert the next chunk of json, which may end anywhere, even within a string. Returns false on error; use
+// abisnax_get_error to retrieve error. Once a chunk fails, the stream only fails. Fails if the stream isn't open in
+// this context.
+abisnax_bool abisnax_json_stream_feed(abisnax_context* context, abisnax_json_stream* stream, const char* data,
+                                    size_t size);
+
+// Finish the json and destroy the stream. Use abisnax_get_bin_* to retrieve result. Returns false on error.
+abisnax_bool abisnax_json_stream_end(abisnax_context* context, abisnax_json_stream* stream);
+
+// Destroy a stream without finishing the json, e.g. once the connection feeding it is gone. Returns false on error.
+abisnax_bool abisnax_json_stream_destroy(abisnax_context* context, abisnax_json_stream* stream);
+
+// Convert binary to json using a type handle. The context owns the returned string. Returns null on error; use
+// abisnax_get_error to retrieve error.
+const char* abisnax_bin_to_json_handle(abisnax_context* context, const abisnax_type_handle* type, const char* data,
+                                      size_t size);
+
+// Convert hex to json using a type handle. The context owns the returned memory. Returns null on error; use
+// abisnax_get_error to retrieve error.
+const char* abisnax_hex_to_json_handle(abisnax_context* context, const abisnax_type_handle* type, const char* hex);
+
+// Check binary using a type handle; see abisnax_bin_validate. Returns false on error.
+abisnax_bool abisnax_bin_validate_handle(abisnax_context* context, const abisnax_type_handle* type, const char* data,
+                                       size_t size, size_t* consumed);
+
+// Compile a projection, which selects the parts of a type's values named by count paths, e.g. "actions[].account" or
+// "quantity". Fields are separated by "."; a field followed by "[]" selects within every item of an array. The context
+// owns the projection; it remains valid until abisnax_destroy_projection or until the context is destroyed. Returns
+// null on error; use abisnax_get_error to retrieve error.
+const abisnax_projection* abisnax_compile_projection(abisnax_context* context, const abisnax_type_handle* type,
+                                                     const char* const* paths, size_t count);
+
+// Destroy a projection. Returns false on error.
+abisnax_bool abisnax_destroy_projection(abisnax_context* context, const abisnax_projection* projection);
+
+// Convert binary to json, keeping only the parts a projection selects and skipping over the rest of the data. The
+// context owns the returned string. Returns null on error; use abisnax_get_error to retrieve error.
+const char* abisnax_bin_to_json_projection(abisnax_context* context, const abisnax_projection* projection,
+                                          const char* data, size_t size);
+
+// Compile a predicate, a condition on a type's values such as `to == "useraaaaaaab" && quantity.symbol == "4,SNAX"`.
+// Each comparison has a field path on the left and a json literal on the right; && and || combine comparisons, and
+// parentheses group them. Integer fields and asset.amount support ==, !=, <, <=, > and >=; bool, name, symbol,
+// symbol_code, asset and asset.symbol fields support == and !=. Comparisons on absent optional or extension fields are
+// false. The context owns the predicate; it remains valid until abisnax_destroy_predicate or until the context is
+// destroyed. Returns null on error; use abisnax_get_error to retrieve error.
+const abisnax_predicate* abisnax_compile_predicate(abisnax_context* context, const abisnax_type_handle* type,
+                                                   const char* predicate);
+
+// Destroy a predicate. Returns false on error.
+abisnax_bool abisnax_destroy_predicate(abisnax_context* context, const abisnax_predicate* predicate);
+
+// Check whether binary matches a predicate without converting it. Only the fields up to the last one the predicate
+// uses are read. Returns 1 if it matches, 0 if it doesn't, or -1 on error; use abisnax_get_error to retrieve error.
+int abisnax_match_predicate(abisnax_context* context, const abisnax_predicate* predicate, const char* data,
+                            size_t size);
+
+// Create an empty binary index. An index records where the parts of a binary value begin, so they can be read later
+// without decoding the rest of it. The context owns the index; it remains valid until abisnax_destroy_bin_index or
+// until the context is destroyed. Returns null on failure.
+abisnax_bin_index* abisnax_create_bin_index(abisnax_context* context);
+
+// Destroy an index. Returns false on error.
+abisnax_bool abisnax_destroy_bin_index(abisnax_context* context, abisnax_bin_index* index);
+
+// Index binary using a type handle, replacing the index's previous content. The index keeps a copy of data. The value
+// must fill data; data after it is an error, as with the other conversions. Returns false on error; use
+// abisnax_get_error to retrieve error.
+abisnax_bool abisnax_index_bin(abisnax_context* context, abisnax_bin_index* index, const abisnax_type_handle* type,
+                             const char* data, size_t size);
+
+// The abisnax_bin_index_* functions below find a part of an indexed value by path, depth child numbers leading down
+// from the value: a struct's field, an array's item, or 0 for an optional's value or a variant's alternative. e.g.
+// {17, 3} is field 3 of item 17. An empty path is the value itself. Each step takes constant time, except within
+// fixed-size structs, where it adds up the sizes of the preceding fields.
+
+// Get the number of children of a part. Returns -1 on error; use abisnax_get_error to retrieve error.
+int64_t abisnax_bin_index_count(abisnax_context* context, const abisnax_bin_index* index, const uint32_t* path,
+                                size_t depth);
+
+// Get the type name of a part. The context owns the returned string. Returns null on error; use abisnax_get_error to
+// retrieve error.
+const char* abisnax_bin_index_type(abisnax_context* context, const abisnax_bin_index* index, const uint32_t* path,
+                                   size_t depth);
+
+// Get the binary of a part. data receives a pointer into the index, which remains valid until the index changes.
+// Returns false on error; use abisnax_get_error to retrieve error.
+abisnax_bool abisnax_bin_index_get_bin(abisnax_context* context, const abisnax_bin_index* index, const uint32_t* path,
+                                     size_t depth, const char** data, size_t* size);
+
+// Convert a part to json. The context owns the returned string. Returns null on error; use abisnax_get_error to
+// retrieve error.
+const char* abisnax_bin_index_to_json(abisnax_context* context, const abisnax_bin_index* index, const uint32_t* path,
+                                      size_t depth);
+
+// The *_into functions below write their result straight into buf instead of into memory owned by the context. They
+// return the size of the result, or -1 on error; use abisnax_get_error to retrieve error. If the returned size is
+// larger than cap, buf was too small and its content is unspecified; call again with a buffer of at least that size.
+// Json results are not null-terminated.
+
+// Convert json to binary, writing the result into buf.
+int64_t abisnax_json_to_bin_into(abisnax_context* context, uint64_t contract, const char* type, const char* json,
+                                 char* buf, size_t cap);
+
+// Convert binary to json, writing the result into buf.
+int64_t abisnax_bin_to_json_into(abisnax_context* context, uint64_t contract, const char* type, const char* data,
+                                 size_t size, char* buf, size_t cap);
+
+// Convert json to binary using a type handle, writing the result into buf.
+int64_t abisnax_json_to_bin_handle_into(abisnax_context* context, const abisnax_type_handle* type, const char* json,
+                                        char* buf, size_t cap);
+
+// Convert binary to json using a type handle, writing the result into buf.
+int64_t abisnax_bin_to_json_handle_into(abisnax_context* context, const abisnax_type_handle* type, const char* data,
+                                        size_t size, char* buf, size_t cap);
+
+// One entry of the table returned by abisnax_bin_to_json_batch. offset and size locate the item's json within the
+// batch arena; if ok is false, they locate an error message instead. Each is followed by a null terminator which size
+// doesn't include.
+typedef struct abisnax_batch_result_s {
+    size_t offset;
+    size_t size;
+    abisnax_bool ok;
+} abisnax_batch_result;
+
+// Convert count binaries to json in one call. Item i is converted using contracts[i], types[i], data[i] and sizes[i].
+// A failed item doesn't stop the rest. Returns a table of count results; use abisnax_get_batch_arena to retrieve the
+// json. The context owns the returned memory; it remains valid until the next batch. Returns null on error; use
+// abisnax_get_error to retrieve error.
+const abisnax_batch_result* abisnax_bin_to_json_batch(abisnax_context* context, size_t count,
+                                                     const uint64_t* contracts, const char* const* types,
+                                                     const char* const* data, const size_t* sizes);
+
+// Get the arena holding the output of the last abisnax_bin_to_json_batch. The context owns the returned memory.
+const char* abisnax_get_batch_arena(abisnax_context* context);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,13 +4,18 @@
 
 #include <ctime>
 #include <date/date.h>
+#include <limits>
 #include <map>
+#include <memory>
 #include <optional>
+#include <string_view>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
 #include "abisnax_numeric.hpp"
 
+#include "rapidjson/memorystream.h"
 #include "rapidjson/reader.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
@@ -141,6 +146,188 @@ struct input_buffer {
     const char* end = nullptr;
 };
 
+inline size_t varuint32_size(uint32_t v) {
+    size_t size = 1;
+    while (v >>= 7)
+        ++size;
+    return size;
+}
+
+// Binary destination which json_to_bin writes straight into. With a vector destination it appends to the vector,
+// growing it as needed; with a fixed buffer it counts the bytes which didn't fit so callers can learn the required
+// size. Call finish once done.
+struct bin_output {
+    using value_type = char;
+
+    char* begin = nullptr;
+    char* pos = nullptr;
+    char* end = nullptr;
+    std::vector<char>* vec = nullptr;
+    size_t overflow = 0;
+
+    // varuint32s which need more than the byte reserved for them, by position. finish makes room for them in one pass
+    // over the data, rather than moving what follows each one as it's written.
+    std::vector<std::pair<size_t, uint32_t>> wide{};
+    size_t wide_extra = 0;
+
+    explicit bin_output(std::vector<char>& vec) : vec{&vec} {
+        auto used = vec.size();
+        vec.resize(std::max(vec.capacity(), used));
+        begin = pos = vec.data() + used;
+        end = vec.data() + vec.size();
+    }
+
+    bin_output(char* buf, size_t cap) : begin{buf}, pos{buf}, end{buf + cap} {}
+
+    bin_output(const bin_output&) = delete;
+    bin_output& operator=(const bin_output&) = delete;
+
+    void push_back(char c) {
+        if (pos == end)
+            make_room(1);
+        if (pos == end)
+            ++overflow;
+        else
+            *pos++ = c;
+    }
+
+    void append(const char* data, size_t size) {
+        if (size_t(end - pos) < size)
+            make_room(size);
+        auto n = std::min(size, size_t(end - pos));
+        if (n)
+            memcpy(pos, data, n);
+        pos += n;
+        overflow += size - n;
+    }
+
+    // Bytes pushed so far
+    size_t tell() const { return pos - begin + overflow; }
+
+    // Size of the binary once finished
+    size_t size() const { return tell() + wide_extra; }
+
+    // Write v over the byte reserved at position, which tell() returned before the byte was pushed
+    void write_varuint32(size_t position, uint32_t v) {
+        if (v >= 0x80) {
+            wide.push_back({position, v});
+            wide_extra += varuint32_size(v) - 1;
+        } else if (position < size_t(pos - begin)) {
+            begin[position] = v;
+        }
+    }
+
+    // Write the wide varuint32s and trim a vector destination to the binary. A fixed buffer's content is unspecified if
+    // the binary didn't fit.
+    void finish() {
+        size_t used = pos - begin;
+        size_t total = used + wide_extra;
+        if (vec && total > used) {
+            auto start = begin - vec->data();
+            vec->resize(start + total);
+            begin = vec->data() + start;
+        }
+        if (!overflow && (vec || total <= size_t(end - begin))) {
+            std::sort(wide.begin(), wide.end());
+            auto src_end = used;
+            auto dest_end = total;
+            for (auto it = wide.rbegin(); it != wide.rend(); ++it) {
+                auto [position, v] = *it;
+                auto n = src_end - (position + 1);
+                memmove(begin + dest_end - n, begin + position + 1, n);
+                dest_end -= n + varuint32_size(v);
+                auto* dest = begin + dest_end;
+                do {
+                    uint8_t b = v & 0x7f;
+                    v >>= 7;
+                    *dest++ = b | ((v > 0) << 7);
+                } while (v);
+                src_end = position;
+            }
+        }
+        if (vec)
+            vec->resize(begin - vec->data() + total);
+        wide.clear();
+    }
+
+  private:
+    void make_room(size_t size) {
+        if (!vec)
+            return;
+        auto start = begin - vec->data();
+        auto used = pos - vec->data();
+        vec->resize(std::max<size_t>({vec->size() * 2, used + size, 64}));
+        begin = vec->data() + start;
+        pos = vec->data() + used;
+        end = vec->data() + vec->size();
+    }
+};
+
+template <typename T>
+void push_raw(bin_output& bin, const T& obj) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    bin.append(reinterpret_cast<const char*>(&obj), sizeof(obj));
+}
+
+inline void push_bytes(std::vector<char>& bin, const char* data, size_t size) {
+    bin.insert(bin.end(), data, data + size);
+}
+
+inline void push_bytes(bin_output& bin, const char* data, size_t size) { bin.append(data, size); }
+
+// rapidjson output stream which writes straight into its destination. With a string destination it appends to the
+// string, growing it as needed; with a fixed buffer it counts the bytes which didn't fit so callers can learn the
+// required size.
+struct json_output_stream {
+    typedef char Ch;
+
+    char* begin = nullptr;
+    char* pos = nullptr;
+    char* end = nullptr;
+    std::string* str = nullptr;
+    size_t overflow = 0;
+
+    explicit json_output_stream(std::string& str) : str{&str} {
+        auto used = str.size();
+        str.resize(std::max(str.capacity(), used));
+        begin = pos = str.data() + used;
+        end = str.data() + str.size();
+    }
+
+    json_output_stream(char* buf, size_t cap) : begin{buf}, pos{buf}, end{buf + cap} {}
+
+    void Put(char c) {
+        if (pos == end)
+            make_room();
+        if (pos == end)
+            ++overflow;
+        else
+            *pos++ = c;
+    }
+
+    void Flush() {}
+
+    size_t size() const { return pos - begin + overflow; }
+
+    // Trim a string destination to the bytes written
+    void finish() {
+        if (str)
+            str->resize(pos - str->data());
+    }
+
+  private:
+    void make_room() {
+        if (!str)
+            return;
+        auto start = begin - str->data();
+        auto used = pos - str->data();
+        str->resize(std::max<size_t>(str->size() * 2, 64));
+        begin = str->data() + start;
+        pos = str->data() + used;
+        end = str->data() + str->size();
+    }
+};
+
 ABISNAX_NODISCARD inline bool read_raw(input_buffer& bin, std::string& error, void* dest, ptrdiff_t size) {
     if (bin.end - bin.pos < size)
         return set_error(error, "read past end");
@@ -166,6 +353,13 @@ ABISNAX_NODISCARD inline bool read_raw(input_buffer& bin, std::string& error, bo
 
 ABISNAX_NODISCARD bool read_varuint32(input_buffer& bin, std::string& error, uint32_t& dest);
 
+// Bounds check size bytes at once, e.g. a whole fixed-size struct or array
+ABISNAX_NODISCARD inline bool check_remaining(input_buffer& bin, std::string& error, uint64_t size) {
+    if (uint64_t(bin.end - bin.pos) < size)
+        return set_error(error, "read past end");
+    return true;
+}
+
 ABISNAX_NODISCARD inline bool read_string(input_buffer& bin, std::string& error, std::string& dest) {
     uint32_t size;
     if (!read_varuint32(bin, error, size))
@@ -247,13 +441,53 @@ struct json_reader_handler : public rapidjson::BaseReaderHandler<rapidjson::UTF8
     }
 };
 
+inline constexpr unsigned json_parse_flags =
+    rapidjson::kParseValidateEncodingFlag | rapidjson::kParseIterativeFlag | rapidjson::kParseNumbersAsStringsFlag;
+
+// rapidjson stream which parses [src, end) in place, unescaping strings over the json. Like
+// rapidjson::InsituStringStream, except the json needn't be 0-terminated.
+struct insitu_json_stream {
+    using Ch = char;
+
+    char* head = nullptr;
+    char* src = nullptr;
+    char* end = nullptr;
+    char* dst = nullptr;
+
+    Ch Peek() const { return src < end ? *src : 0; }
+    Ch Take() { return src < end ? *src++ : 0; }
+    size_t Tell() const { return src - head; }
+
+    Ch* PutBegin() { return dst = src; }
+    void Put(Ch c) { *dst++ = c; }
+    size_t PutEnd(Ch* begin) { return dst - begin; }
+    void Flush() {}
+};
+
+// Parse json with handler. The json needn't be 0-terminated and isn't copied. The streams read 0 at the end, so the
+// parse must also reach the end; otherwise it stopped at a 0 within the json.
+template <typename Handler>
+ABISNAX_NODISCARD bool parse_json(Handler& handler, std::string_view json) {
+    rapidjson::Reader reader;
+    rapidjson::MemoryStream ss(json.data(), json.size());
+    return reader.Parse<json_parse_flags>(ss, handler) && ss.Tell() == json.size();
+}
+
+// Like parse_json, but parses strings in place, overwriting [json, json + size)
+template <typename Handler>
+ABISNAX_NODISCARD bool parse_json_insitu(Handler& handler, char* json, size_t size) {
+    rapidjson::Reader reader;
+    insitu_json_stream ss{json, json, json + size};
+    return reader.Parse<json_parse_flags | rapidjson::kParseInsituFlag>(ss, handler) && ss.Tell() == size;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // json model
 ///////////////////////////////////////////////////////////////////////////////
 
 struct jvalue;
 using jarray = std::vector<jvalue>;
-using jobject = std::map<std::string, jvalue>;
+using jobject = std::map<std::string, jvalue, std::less<>>;
 
 struct jvalue {
     std::variant<std::nullptr_t, bool, std::string, jobject, jarray> value;
@@ -273,11 +507,6 @@ inline event_type get_event_type(const jvalue& value) {
 // state and serializers
 ///////////////////////////////////////////////////////////////////////////////
 
-struct size_insertion {
-    size_t position = 0;
-    uint32_t size = 0;
-};
-
 struct json_to_jvalue_stack_entry {
     jvalue* value = nullptr;
     std::string key = "";
@@ -303,8 +532,9 @@ struct json_to_bin_stack_entry {
     const struct abi_type* type = nullptr;
     bool allow_extensions = false;
     int position = -1;
-    size_t size_insertion_index = 0;
+    size_t size_position = 0; // arrays: where the size goes once it's known
     size_t variant_type_index = 0;
+    uint32_t node = 0; // json_to_bin_program only
 };
 
 struct bin_to_json_stack_entry {
@@ -348,22 +578,23 @@ struct jvalue_to_bin_state {
 
 struct json_to_bin_state : json_reader_handler<json_to_bin_state> {
     std::string& error;
-    std::vector<char> bin;
-    std::vector<size_insertion> size_insertions{};
+    bin_output bin;
     std::vector<json_to_bin_stack_entry> stack{};
     bool skipped_extension = false;
+    const struct json_to_bin_program* program = nullptr;
 
-    json_to_bin_state(std::string& error) : error{error} {}
+    json_to_bin_state(std::string& error, std::vector<char>& bin) : error{error}, bin{bin} {}
+    json_to_bin_state(std::string& error, char* buf, size_t cap) : error{error}, bin{buf, cap} {}
 };
 
 struct bin_to_json_state : json_reader_handler<bin_to_json_state> {
     std::string& error;
     input_buffer& bin;
-    rapidjson::Writer<rapidjson::StringBuffer>& writer;
+    rapidjson::Writer<json_output_stream>& writer;
     std::vector<bin_to_json_stack_entry> stack{};
     bool skipped_extension = false;
 
-    bin_to_json_state(input_buffer& bin, std::string& error, rapidjson::Writer<rapidjson::StringBuffer>& writer)
+    bin_to_json_state(input_buffer& bin, std::string& error, rapidjson::Writer<json_output_stream>& writer)
         : error{error}, bin{bin}, writer{writer} {}
 };
 
@@ -525,7 +756,8 @@ struct bytes {
     std::vector<char> data;
 };
 
-void push_varuint32(std::vector<char>& bin, uint32_t v);
+template <typename Bin>
+void push_varuint32(Bin& bin, uint32_t v);
 
 ABISNAX_NODISCARD inline bool bin_to_native(bytes& obj, bin_to_native_state& state, bool) {
     uint32_t size;
@@ -670,7 +902,7 @@ ABISNAX_NODISCARD bool json_to_bin(fixed_binary<size>*, State& state, bool, cons
             return false;
         if (v.size() != size)
             return set_error(state, "hex string has incorrect length");
-        state.bin.insert(state.bin.end(), v.begin(), v.end());
+        push_bytes(state.bin, (const char*)v.data(), v.size());
         return true;
     } else
         return set_error(state, "expected string containing hex");
@@ -994,7 +1226,8 @@ struct varuint32 {
     explicit operator std::string() const { return std::to_string(value); }
 };
 
-inline void push_varuint32(std::vector<char>& bin, uint32_t v) {
+template <typename Bin>
+void push_varuint32(Bin& bin, uint32_t v) {
     uint64_t val = v;
     do {
         uint8_t b = val & 0x7f;
@@ -1055,7 +1288,8 @@ struct varint32 {
     explicit operator std::string() const { return std::to_string(value); }
 };
 
-inline void push_varint32(std::vector<char>& bin, int32_t v) {
+template <typename Bin>
+void push_varint32(Bin& bin, int32_t v) {
     push_varuint32(bin, (uint32_t(v) << 1) ^ uint32_t(v >> 31));
 }
 
@@ -1623,7 +1857,7 @@ constexpr void for_each_field(abi_def*, F f) {
 }
 
 ABISNAX_NODISCARD inline bool check_abi_version(const std::string& s, std::string& error) {
-    if (s.substr(0, 13) != "snax::abi/1.")
+    if (s.substr(0, 12) != "snax::abi/1.")
         return set_error(error, "unsupported abi version");
     return true;
 }
@@ -1679,14 +1913,9 @@ ABISNAX_NODISCARD inline bool receive_event(struct json_to_jvalue_state& state,
 }
 
 ABISNAX_NODISCARD inline bool json_to_jvalue(jvalue& value, std::string& error, std::string_view json) {
-    std::string mutable_json{json};
-    mutable_json.push_back(0);
     json_to_jvalue_state state{error};
     state.stack.push_back({&value});
-    rapidjson::Reader reader;
-    rapidjson::InsituStringStream ss(mutable_json.data());
-    return reader.Parse<rapidjson::kParseValidateEncodingFlag | rapidjson::kParseIterativeFlag |
-                        rapidjson::kParseNumbersAsStringsFlag>(ss, state);
+    return parse_json(state, json);
 }
 
 ABISNAX_NODISCARD inline bool json_to_jobject(jvalue& value, json_to_jvalue_state& state, event_type event, bool start) {
@@ -2007,14 +2236,9 @@ ABISNAX_NODISCARD inline bool receive_event(struct json_to_native_state& state,
 
 template <typename T>
 ABISNAX_NODISCARD bool json_to_native(T& obj, std::string& error, std::string_view json) {
-    std::string mutable_json{json};
-    mutable_json.push_back(0);
     json_to_native_state state{error};
     state.stack.push_back(native_stack_entry{&obj, &native_serializer_for<T>, 0});
-    rapidjson::Reader reader;
-    rapidjson::InsituStringStream ss(mutable_json.data());
-    return reader.Parse<rapidjson::kParseValidateEncodingFlag | rapidjson::kParseIterativeFlag |
-                        rapidjson::kParseNumbersAsStringsFlag>(ss, state);
+    return parse_json(state, json);
 }
 
 template <typename T>
@@ -2184,28 +2408,96 @@ inline constexpr auto abi_serializer_for = abi_serializer_impl<T>{};
 // abi handling
 ///////////////////////////////////////////////////////////////////////////////
 
+// Bump allocator which owns a contract's fields and names. Only holds trivially destructible objects, so freeing the
+// arena is a handful of deallocations regardless of the abi's size.
+struct abi_arena {
+    // Chunks start small, since most abis are small, and double up to the maximum
+    static constexpr size_t min_chunk_size = 256;
+    static constexpr size_t max_chunk_size = 16384;
+
+    std::vector<std::unique_ptr<char[]>> chunks{};
+    char* pos = nullptr;
+    char* end = nullptr;
+    size_t allocated = 0;
+
+    abi_arena() = default;
+    abi_arena(const abi_arena&) = delete;
+    abi_arena(abi_arena&&) = default;
+    abi_arena& operator=(const abi_arena&) = delete;
+    abi_arena& operator=(abi_arena&&) = default;
+
+    template <typename T>
+    T* alloc(size_t n) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        if (!n)
+            return nullptr;
+        size_t size = n * sizeof(T);
+        auto aligned = [&] { return (char*)((uintptr_t(pos) + alignof(T) - 1) & ~(uintptr_t(alignof(T)) - 1)); };
+        if (!pos || aligned() + size > end) {
+            size_t chunk = std::max(std::clamp(allocated, min_chunk_size, max_chunk_size), size + alignof(T));
+            chunks.push_back(std::make_unique<char[]>(chunk));
+            pos = chunks.back().get();
+            end = pos + chunk;
+            allocated += chunk;
+        }
+        auto* result = aligned();
+        pos = result + size;
+        for (size_t i = 0; i < n; ++i)
+            new (result + i * sizeof(T)) T{};
+        return (T*)result;
+    }
+};
+
+// Copies names into an arena, reusing earlier copies. The lookup table only lives while a contract is being filled.
+struct abi_name_table {
+    abi_arena& arena;
+    std::unordered_set<std::string_view> names{};
+
+    std::string_view intern(std::string_view s) {
+        if (auto it = names.find(s); it != names.end())
+            return *it;
+        auto* p = arena.alloc<char>(s.size());
+        std::copy(s.begin(), s.end(), p);
+        return *names.insert(std::string_view{p, s.size()}).first;
+    }
+};
+
 struct abi_field {
-    std::string name{};
+    std::string_view name{};
     const struct abi_type* type{};
 };
 
+// Contiguous fields, owned by an abi_arena
+struct abi_fields {
+    const abi_field* first = nullptr;
+    size_t count = 0;
+
+    const abi_field* begin() const { return first; }
+    const abi_field* end() const { return first + count; }
+    size_t size() const { return count; }
+    bool empty() const { return !count; }
+    const abi_field& operator[](size_t i) const { return first[i]; }
+    const abi_field& back() const { return first[count - 1]; }
+};
+
 struct abi_type {
-    std::string name{};
-    std::string alias_of_name{};
+    std::string_view name{}; // refers to the key of the map which holds this type
+    std::string_view alias_of_name{};
     const ::abisnax::struct_def* struct_def{};
     const ::abisnax::variant_def* variant_def{};
     abi_type* alias_of{};
-    abi_type* optional_of{};
-    abi_type* extension_of{};
-    abi_type* array_of{};
+    const abi_type* optional_of{};
+    const abi_type* extension_of{};
+    const abi_type* array_of{};
     abi_type* base{};
-    std::vector<abi_field> fields{};
+    abi_fields fields{};
     bool filled_struct{};
     bool filled_variant{};
+    bool filled{}; // this and every type it refers to are filled; only tracked in lazily filled contracts
+    uint32_t fixed_size{}; // binary size of every value of this type, or 0 if it varies
     const abi_serializer* ser{};
 
-    abi_type(std::string name = "", std::string alias_of_name = "")
-        : name{std::move(name)}, alias_of_name{std::move(alias_of_name)} {}
+    abi_type() = default;
     abi_type(const abi_type&) = delete;
     abi_type(abi_type&&) = delete;
     abi_type& operator=(const abi_type&) = delete;
@@ -2216,181 +2508,390 @@ struct contract {
     std::map<name, std::string> action_types;
     std::map<name, std::string> table_types;
     std::map<std::string, abi_type> abi_types;
+    abi_arena arena;
+
+    // Set by fill_contract_lazy. Struct and variant types point into it until they are filled by fill_type.
+    std::unique_ptr<abi_def> def;
 };
 
 template <int i>
-bool ends_with(const std::string& s, const char (&suffix)[i]) {
-    return s.size() >= i - 1 && !strcmp(s.c_str() + s.size() - (i - 1), suffix);
+bool ends_with(std::string_view s, const char (&suffix)[i]) {
+    return s.size() >= i - 1 && s.substr(s.size() - (i - 1)) == suffix;
+}
+
+inline size_t derived_type_suffix_size(std::string_view name) {
+    if (ends_with(name, "?") || ends_with(name, "$"))
+        return 1;
+    if (ends_with(name, "[]"))
+        return 2;
+    return 0;
+}
+
+// Link a T?, T[] or T$ type to T
+ABISNAX_NODISCARD inline bool link_derived_type(abi_type& type, std::string& error, const abi_type* inner) {
+    if (ends_with(type.name, "?")) {
+        type.optional_of = inner;
+        if (inner->optional_of || inner->array_of)
+            return set_error(error, "optional (?) and array ([]) don't support nesting");
+        if (inner->extension_of)
+            return set_error(error, "optional (?) may not contain binary extensions ($)");
+        type.ser = &abi_serializer_for<pseudo_optional>;
+    } else if (ends_with(type.name, "[]")) {
+        type.array_of = inner;
+        if (inner->array_of || inner->optional_of)
+            return set_error(error, "optional (?) and array ([]) don't support nesting");
+        if (inner->extension_of)
+            return set_error(error, "array ([]) may not contain binary extensions ($)");
+        type.ser = &abi_serializer_for<pseudo_array>;
+    } else {
+        type.extension_of = inner;
+        if (inner->extension_of)
+            return set_error(error, "binary extensions ($) may not contain binary extensions ($)");
+        type.ser = &abi_serializer_for<pseudo_extension>;
+    }
+    return true;
+}
+
+// Binary size of a built-in type, or 0 if it varies
+template <typename T>
+constexpr uint32_t builtin_fixed_size() {
+    if constexpr (std::is_arithmetic_v<T> || std::is_same_v<T, int128> || std::is_same_v<T, uint128> ||
+                  std::is_same_v<T, float128> || std::is_same_v<T, checksum160> || std::is_same_v<T, checksum256> ||
+                  std::is_same_v<T, checksum512> || std::is_same_v<T, time_point> ||
+                  std::is_same_v<T, time_point_sec> || std::is_same_v<T, block_timestamp> ||
+                  std::is_same_v<T, name> || std::is_same_v<T, symbol> || std::is_same_v<T, symbol_code> ||
+                  std::is_same_v<T, asset>)
+        return sizeof(T);
+    else
+        return 0;
+}
+
+// Built-in types, shared by every contract. Contracts don't store these; type lookups fall through to this table.
+// It is never modified after construction.
+inline std::map<std::string, abi_type>& builtin_abi_types() {
+    static abi_field extended_asset_fields[2];
+    static std::map<std::string, abi_type> types = [] {
+        std::map<std::string, abi_type> types;
+        for_each_abi_type([&](const char* name, auto* p) {
+            auto& [key, type] = *types.try_emplace(name).first;
+            type.name = key;
+            type.filled = true;
+            type.fixed_size = builtin_fixed_size<std::decay_t<decltype(*p)>>();
+            type.ser = &abi_serializer_for<std::decay_t<decltype(*p)>>;
+        });
+        auto& [key, type] = *types.try_emplace("extended_asset").first;
+        type.name = key;
+        extended_asset_fields[0] = {"quantity", &types.at("asset")};
+        extended_asset_fields[1] = {"contract", &types.at("name")};
+        type.fields = {extended_asset_fields, 2};
+        type.filled_struct = true;
+        type.filled = true;
+        type.fixed_size = types.at("asset").fixed_size + types.at("name").fixed_size;
+        type.ser = &abi_serializer_for<pseudo_object>;
+        return types;
+    }();
+    return types;
+}
+
+inline abi_type* find_abi_type(std::map<std::string, abi_type>& abi_types, const std::string& name) {
+    if (auto it = abi_types.find(name); it != abi_types.end())
+        return &it->second;
+    auto& builtins = builtin_abi_types();
+    if (auto it = builtins.find(name); it != builtins.end())
+        return &it->second;
+    return nullptr;
+}
+
+inline const abi_type* find_abi_type(const std::map<std::string, abi_type>& abi_types, const std::string& name) {
+    if (auto it = abi_types.find(name); it != abi_types.end())
+        return &it->second;
+    auto& builtins = builtin_abi_types();
+    if (auto it = builtins.find(name); it != builtins.end())
+        return &it->second;
+    return nullptr;
 }
 
 ABISNAX_NODISCARD inline bool get_type(abi_type*& result, std::string& error, std::map<std::string, abi_type>& abi_types,
                                       const std::string& name, int depth) {
     if (depth >= 32)
         return set_error(error, "abi recursion limit reached");
-    auto it = abi_types.find(name);
-    if (it == abi_types.end()) {
-        if (ends_with(name, "?")) {
-            abi_type& type = abi_types[name];
-            type.name = name;
-            if (!get_type(type.optional_of, error, abi_types, name.substr(0, name.size() - 1), depth + 1))
-                return false;
-            if (type.optional_of->optional_of || type.optional_of->array_of)
-                return set_error(error, "optional (?) and array ([]) don't support nesting");
-            if (type.optional_of->extension_of)
-                return set_error(error, "optional (?) may not contain binary extensions ($)");
-            type.ser = &abi_serializer_for<pseudo_optional>;
-            result = &type;
-            return true;
-        } else if (ends_with(name, "[]")) {
-            abi_type& type = abi_types[name];
-            type.name = name;
-            if (!get_type(type.array_of, error, abi_types, name.substr(0, name.size() - 2), depth + 1))
-                return false;
-            if (type.array_of->array_of || type.array_of->optional_of)
-                return set_error(error, "optional (?) and array ([]) don't support nesting");
-            if (type.array_of->extension_of)
-                return set_error(error, "array ([]) may not contain binary extensions ($)");
-            type.ser = &abi_serializer_for<pseudo_array>;
-            result = &type;
-            return true;
-        } else if (ends_with(name, "$")) {
-            abi_type& type = abi_types[name];
-            type.name = name;
-            if (!get_type(type.extension_of, error, abi_types, name.substr(0, name.size() - 1), depth + 1))
-                return false;
-            if (type.extension_of->extension_of)
-                return set_error(error, "binary extensions ($) may not contain binary extensions ($)");
-            type.ser = &abi_serializer_for<pseudo_extension>;
-            result = &type;
-            return true;
-        } else
+    auto* found = find_abi_type(abi_types, name);
+    if (!found) {
+        auto suffix_size = derived_type_suffix_size(name);
+        if (!suffix_size)
             return set_error(error, "unknown type \"" + name + "\"");
+        auto& [key, type] = *abi_types.try_emplace(name).first;
+        type.name = key;
+        abi_type* inner;
+        if (!get_type(inner, error, abi_types, name.substr(0, name.size() - suffix_size), depth + 1))
+            return false;
+        if (!link_derived_type(type, error, inner))
+            return false;
+        result = &type;
+        return true;
+    }
+    if (found->alias_of) {
+        result = found->alias_of;
+        return true;
+    }
+    if (found->alias_of_name.empty()) {
+        result = found;
+        return true;
     }
-    if (it->second.alias_of) {
-        result = it->second.alias_of;
+    if (!get_type(result, error, abi_types, std::string{found->alias_of_name}, depth + 1))
+        return false;
+    found->alias_of = result;
+    return true;
+}
+
+// Look up a type without modifying abi_types, which may be shared between threads. Derived types (T?, T[], T$) which
+// the abi doesn't use itself are created in scratch instead; scratch must outlive any use of result.
+ABISNAX_NODISCARD inline bool get_type(const abi_type*& result, std::string& error,
+                                      const std::map<std::string, abi_type>& abi_types,
+                                      std::map<std::string, abi_type>& scratch, const std::string& name, int depth) {
+    if (depth >= 32)
+        return set_error(error, "abi recursion limit reached");
+    if (auto* found = find_abi_type(abi_types, name)) {
+        if (!found->alias_of_name.empty() && !found->alias_of)
+            return set_error(error, "abi type \"" + name + "\" is not resolved");
+        result = found->alias_of ? found->alias_of : found;
         return true;
     }
-    if (it->second.alias_of_name.empty()) {
+    if (auto it = scratch.find(name); it != scratch.end()) {
         result = &it->second;
         return true;
     }
-    if (!get_type(result, error, abi_types, it->second.alias_of_name, depth + 1))
+    auto suffix_size = derived_type_suffix_size(name);
+    if (!suffix_size)
+        return set_error(error, "unknown type \"" + name + "\"");
+    const abi_type* inner;
+    if (!get_type(inner, error, abi_types, scratch, name.substr(0, name.size() - suffix_size), depth + 1))
         return false;
-    it->second.alias_of = result;
+    auto& [key, type] = *scratch.try_emplace(name).first;
+    type.name = key;
+    if (!link_derived_type(type, error, inner)) {
+        scratch.erase(name);
+        return false;
+    }
+    result = &type;
     return true;
 }
 
-ABISNAX_NODISCARD inline bool fill_struct(std::map<std::string, abi_type>& abi_types, std::string& error, abi_type& type,
-                                         int depth) {
+ABISNAX_NODISCARD inline bool fill_struct(std::map<std::string, abi_type>& abi_types, abi_name_table& names,
+                                         std::string& error, abi_type& type, int depth) {
     if (depth >= 32)
         return set_error(error, "abi recursion limit reached");
     if (type.filled_struct)
         return true;
     if (!type.struct_def)
-        return set_error(error, "abi type \"" + type.name + "\" is not a struct");
+        return set_error(error, "abi type \"" + std::string{type.name} + "\" is not a struct");
+    abi_fields base_fields;
     if (!type.struct_def->base.empty()) {
         abi_type* t;
         if (!get_type(t, error, abi_types, type.struct_def->base, depth + 1))
             return false;
-        if (!fill_struct(abi_types, error, *t, depth + 1))
+        if (!fill_struct(abi_types, names, error, *t, depth + 1))
             return false;
-        type.fields = t->fields;
+        base_fields = t->fields;
     }
-    for (auto& field : type.struct_def->fields) {
+    auto* fields = names.arena.alloc<abi_field>(base_fields.size() + type.struct_def->fields.size());
+    std::copy(base_fields.begin(), base_fields.end(), fields);
+    auto* field = fields + base_fields.size();
+    for (auto& def : type.struct_def->fields) {
         abi_type* t;
-        if (!get_type(t, error, abi_types, field.type, depth + 1))
+        if (!get_type(t, error, abi_types, def.type, depth + 1))
             return false;
-        type.fields.push_back(abi_field{field.name, t});
+        *field++ = abi_field{names.intern(def.name), t};
     }
+    type.fields = {fields, size_t(field - fields)};
     type.filled_struct = true;
     return true;
 }
 
-ABISNAX_NODISCARD inline bool fill_variant(std::map<std::string, abi_type>& abi_types, std::string& error,
-                                          abi_type& type, int depth) {
+ABISNAX_NODISCARD inline bool fill_variant(std::map<std::string, abi_type>& abi_types, abi_name_table& names,
+                                          std::string& error, abi_type& type, int depth) {
     if (depth >= 32)
         return set_error(error, "abi recursion limit reached");
     if (type.filled_variant)
         return true;
     if (!type.variant_def)
-        return set_error(error, "abi type \"" + type.name + "\" is not a variant");
+        return set_error(error, "abi type \"" + std::string{type.name} + "\" is not a variant");
+    auto* fields = names.arena.alloc<abi_field>(type.variant_def->types.size());
+    auto* field = fields;
     for (auto& types : type.variant_def->types) {
         abi_type* t;
         if (!get_type(t, error, abi_types, types, depth + 1))
             return false;
-        type.fields.push_back(abi_field{types, t});
+        *field++ = abi_field{names.intern(types), t};
     }
+    type.fields = {fields, size_t(field - fields)};
     type.filled_variant = true;
     return true;
 }
 
-ABISNAX_NODISCARD inline bool fill_contract(contract& c, std::string& error, const abi_def& abi) {
+// Find the filled structs whose values always have the same binary size. Decoders use fixed_size to bounds check a
+// whole struct, or a whole array of them, at once. Structs which contain themselves never get a size.
+inline void fill_fixed_sizes(const std::vector<abi_type*>& types) {
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto* t : types) {
+            if (t->fixed_size || !t->filled_struct || t->fields.empty())
+                continue;
+            uint64_t size = 0;
+            for (auto& field : t->fields) {
+                if (!field.type->fixed_size) {
+                    size = 0;
+                    break;
+                }
+                size += field.type->fixed_size;
+            }
+            if (size && size == uint32_t(size)) {
+                t->fixed_size = size;
+                changed = true;
+            }
+        }
+    }
+}
+
+// Register the abi's types without resolving them
+ABISNAX_NODISCARD inline bool add_contract_types(contract& c, abi_name_table& names, std::string& error,
+                                                const abi_def& abi) {
     for (auto& a : abi.actions)
         c.action_types[a.name] = a.type;
     for (auto& t : abi.tables)
         c.table_types[t.name] = t.type;
-    for_each_abi_type([&](const char* name, auto* p) {
-        auto& type = c.abi_types[name];
-        type.name = name;
-        type.ser = &abi_serializer_for<std::decay_t<decltype(*p)>>;
-    });
-    {
-        auto& type = c.abi_types["extended_asset"];
-        type.name = "extended_asset";
-        abi_type *asset_type, *name_type;
-        if (!get_type(asset_type, error, c.abi_types, "asset", 0) ||
-            !get_type(name_type, error, c.abi_types, "name", 0))
-            return false;
-        type.fields.push_back(abi_field{"quantity", asset_type});
-        type.fields.push_back(abi_field{"contract", name_type});
-        type.filled_struct = true;
-        type.ser = &abi_serializer_for<pseudo_object>;
-    }
-
+    auto& builtins = builtin_abi_types();
     for (auto& t : abi.types) {
         if (t.new_type_name.empty())
             return set_error(error, "abi has a type with a missing name");
-        auto [_, inserted] = c.abi_types.try_emplace(t.new_type_name, t.new_type_name, t.type);
-        if (!inserted)
+        auto [it, inserted] = c.abi_types.try_emplace(t.new_type_name);
+        if (!inserted || builtins.count(t.new_type_name))
             return set_error(error, "abi redefines type \"" + t.new_type_name + "\"");
+        it->second.name = it->first;
+        it->second.alias_of_name = names.intern(t.type);
     }
     for (auto& s : abi.structs) {
         if (s.name.empty())
             return set_error(error, "abi has a struct with a missing name");
-        auto [it, inserted] = c.abi_types.try_emplace(s.name, s.name);
-        if (!inserted)
+        auto [it, inserted] = c.abi_types.try_emplace(s.name);
+        if (!inserted || builtins.count(s.name))
             return set_error(error, "abi redefines type \"" + s.name + "\"");
+        it->second.name = it->first;
         it->second.struct_def = &s;
         it->second.ser = &abi_serializer_for<pseudo_object>;
     }
     for (auto& v : abi.variants.value) {
         if (v.name.empty())
             return set_error(error, "abi has a variant with a missing name");
-        auto [it, inserted] = c.abi_types.try_emplace(v.name, v.name);
-        if (!inserted)
+        auto [it, inserted] = c.abi_types.try_emplace(v.name);
+        if (!inserted || builtins.count(v.name))
             return set_error(error, "abi redefines type \"" + v.name + "\"");
+        it->second.name = it->first;
         it->second.variant_def = &v;
         it->second.ser = &abi_serializer_for<pseudo_variant>;
     }
+    return true;
+}
+
+// Resolve every type in the abi. The filled contract holds every derived type (T?, T[], T$) the abi names, so the const
+// get_type never needs to modify it.
+ABISNAX_NODISCARD inline bool fill_contract(contract& c, std::string& error, const abi_def& abi) {
+    abi_name_table names{c.arena};
+    if (!add_contract_types(c, names, error, abi))
+        return false;
     for (auto& [_, t] : c.abi_types)
         if (!t.alias_of_name.empty())
-            if (!get_type(t.alias_of, error, c.abi_types, t.alias_of_name, 0))
+            if (!get_type(t.alias_of, error, c.abi_types, std::string{t.alias_of_name}, 0))
                 return false;
     for (auto& [_, t] : c.abi_types) {
         if (t.struct_def) {
-            if (!fill_struct(c.abi_types, error, t, 0))
+            if (!fill_struct(c.abi_types, names, error, t, 0))
                 return false;
         } else if (t.variant_def) {
-            if (!fill_variant(c.abi_types, error, t, 0))
+            if (!fill_variant(c.abi_types, names, error, t, 0))
                 return false;
         }
     }
+    for (auto* names : {&c.action_types, &c.table_types}) {
+        for (auto& [_, type_name] : *names) {
+            std::map<std::string, abi_type> derived;
+            const abi_type* t;
+            std::string ignored;
+            if (get_type(t, ignored, c.abi_types, derived, type_name, 0))
+                c.abi_types.merge(derived);
+        }
+    }
+    std::vector<abi_type*> types;
     for (auto& [_, t] : c.abi_types) {
         t.struct_def = nullptr;
         t.variant_def = nullptr;
         if (t.alias_of && t.alias_of->extension_of)
             return set_error(error, "can't use extensions ($) within typedefs");
+        types.push_back(&t);
+    }
+    fill_fixed_sizes(types);
+    return true;
+}
+
+// Like fill_contract, but leaves types unresolved until fill_type is called on them. Errors in types which are never
+// used aren't detected.
+ABISNAX_NODISCARD inline bool fill_contract_lazy(contract& c, std::string& error, abi_def&& abi) {
+    c.def = std::make_unique<abi_def>(std::move(abi));
+    abi_name_table names{c.arena};
+    return add_contract_types(c, names, error, *c.def);
+}
+
+// Fill a type from a lazily filled contract, along with every type it refers to. type must come from get_type. Types
+// are marked filled as they're reached, which stops cycles; on error the marks are undone so the next call reports the
+// error again.
+ABISNAX_NODISCARD inline bool fill_type(contract& c, std::string& error, abi_type& type) {
+    abi_name_table names{c.arena};
+    std::vector<abi_type*> pending{&type};
+    std::vector<abi_type*> filled;
+    bool ok = [&] {
+        while (!pending.empty()) {
+            auto& t = *pending.back();
+            pending.pop_back();
+            if (t.filled)
+                continue;
+            t.filled = true;
+            filled.push_back(&t);
+            auto push = [&](const std::string& name) {
+                abi_type* inner;
+                if (!get_type(inner, error, c.abi_types, name, 0))
+                    return false;
+                if (inner->extension_of && find_abi_type(c.abi_types, name)->alias_of)
+                    return set_error(error, "can't use extensions ($) within typedefs");
+                pending.push_back(inner);
+                return true;
+            };
+            if (t.struct_def) {
+                if (!fill_struct(c.abi_types, names, error, t, 0))
+                    return false;
+                if (!t.struct_def->base.empty() && !push(t.struct_def->base))
+                    return false;
+                for (auto& field : t.struct_def->fields)
+                    if (!push(field.type))
+                        return false;
+            } else if (t.variant_def) {
+                if (!fill_variant(c.abi_types, names, error, t, 0))
+                    return false;
+                for (auto& name : t.variant_def->types)
+                    if (!push(name))
+                        return false;
+            } else if (auto suffix_size = derived_type_suffix_size(t.name)) {
+                if (!push(std::string{t.name.substr(0, t.name.size() - suffix_size)}))
+                    return false;
+            }
+        }
+        return true;
+    }();
+    if (!ok) {
+        for (auto* t : filled)
+            t->filled = false;
+        return false;
     }
+    fill_fixed_sizes(filled);
     return true;
 }
 
@@ -2398,31 +2899,18 @@ ABISNAX_NODISCARD inline bool fill_contract(contract& c, std::string& error, con
 // json_to_bin (jvalue)
 ///////////////////////////////////////////////////////////////////////////////
 
-ABISNAX_NODISCARD inline bool json_to_bin(std::vector<char>& bin, std::string& error, const abi_type* type,
-                                         const jvalue& value) {
-    jvalue_to_bin_state state{error, bin, &value};
-    bool result = [&] {
-        if (!type->ser->json_to_bin(state, true, type, get_event_type(value), true))
-            return false;
-        while (!state.stack.empty()) {
-            auto& entry = state.stack.back();
-            if (!entry.type->ser->json_to_bin(state, entry.allow_extensions, entry.type, get_event_type(*entry.value),
-                                              false))
-                return false;
-        }
-        return true;
-    }();
-    if (result)
-        return true;
+// Prefix error with where the stack of a failed json_to_bin was, e.g. "transfer.memo: "
+template <typename Stack>
+void add_error_path(std::string& error, const Stack& stack) {
     std::string s;
-    if (!state.stack.empty() && state.stack[0].type->filled_struct)
-        s += state.stack[0].type->name;
-    for (auto& entry : state.stack) {
+    if (!stack.empty() && stack[0].type->filled_struct)
+        s += stack[0].type->name;
+    for (auto& entry : stack) {
         if (entry.type->array_of)
             s += "[" + std::to_string(entry.position) + "]";
         else if (entry.type->filled_struct) {
             if (entry.position >= 0 && entry.position < (int)entry.type->fields.size())
-                s += "." + entry.type->fields[entry.position].name;
+                s += "." + std::string{entry.type->fields[entry.position].name};
         } else if (entry.type->optional_of) {
             s += "<optional>";
         } else if (entry.type->filled_variant) {
@@ -2434,6 +2922,25 @@ ABISNAX_NODISCARD inline bool json_to_bin(std::vector<char>& bin, std::string& e
     if (!s.empty())
         s += ": ";
     error = s + error;
+}
+
+ABISNAX_NODISCARD inline bool json_to_bin(std::vector<char>& bin, std::string& error, const abi_type* type,
+                                         const jvalue& value) {
+    jvalue_to_bin_state state{error, bin, &value};
+    bool result = [&] {
+        if (!type->ser->json_to_bin(state, true, type, get_event_type(value), true))
+            return false;
+        while (!state.stack.empty()) {
+            auto& entry = state.stack.back();
+            if (!entry.type->ser->json_to_bin(state, entry.allow_extensions, entry.type, get_event_type(*entry.value),
+                                              false))
+                return false;
+        }
+        return true;
+    }();
+    if (result)
+        return true;
+    add_error_path(error, state.stack);
     return false;
 }
 
@@ -2485,10 +2992,10 @@ ABISNAX_NODISCARD inline bool json_to_bin(pseudo_object*, jvalue_to_bin_state& s
             return true;
         }
         stack_entry.position = -1;
-        return set_error(state.error, "expected field \"" + field.name + "\"");
+        return set_error(state.error, "expected field \"" + std::string{field.name} + "\"");
     }
     if (state.skipped_extension)
-        return set_error(state.error, "unexpected field \"" + field.name + "\"");
+        return set_error(state.error, "unexpected field \"" + std::string{field.name} + "\"");
     state.received_value = &it->second;
     return field.type->ser && field.type->ser->json_to_bin(state, allow_extensions && &field == &type->fields.back(),
                                                            field.type, get_event_type(it->second), true);
@@ -2586,6 +3093,9 @@ ABISNAX_NODISCARD inline bool json_to_bin(std::string*, jvalue_to_bin_state& sta
 // json_to_bin
 ///////////////////////////////////////////////////////////////////////////////
 
+ABISNAX_NODISCARD bool run_json_to_bin_program(json_to_bin_state& state, uint32_t node, bool allow_extensions,
+                                              event_type event, bool start);
+
 ABISNAX_NODISCARD inline bool receive_event(struct json_to_bin_state& state, event_type event, bool start) {
     if (state.stack.empty())
         return false;
@@ -2597,52 +3107,88 @@ ABISNAX_NODISCARD inline bool receive_event(struct json_to_bin_state& state, eve
         state.stack.clear();
     if (state.stack.size() > max_stack_size)
         return set_error(state, "recursion limit reached");
+    if (state.program)
+        return run_json_to_bin_program(state, entry.node, entry.allow_extensions, event, start);
     return type->ser && type->ser->json_to_bin(state, entry.allow_extensions, type, event, start);
 }
 
-ABISNAX_NODISCARD inline bool json_to_bin(std::vector<char>& bin, std::string& error, const abi_type* type,
-                                         std::string_view json) {
-    std::string mutable_json{json};
-    mutable_json.push_back(0);
-    json_to_bin_state state{error};
+// parse runs the json reader with state as its handler
+template <typename F>
+ABISNAX_NODISCARD bool parse_json_to_bin(json_to_bin_state& state, const abi_type* type, F parse) {
     state.stack.push_back({type, true});
-    rapidjson::Reader reader;
-    rapidjson::InsituStringStream ss(mutable_json.data());
-
-    if (!reader.Parse<rapidjson::kParseValidateEncodingFlag | rapidjson::kParseIterativeFlag |
-                      rapidjson::kParseNumbersAsStringsFlag>(ss, state)) {
-        if (error.empty())
-            error = "failed to parse";
-        std::string s;
-        if (!state.stack.empty() && state.stack[0].type->filled_struct)
-            s += state.stack[0].type->name;
-        for (auto& entry : state.stack) {
-            if (entry.type->array_of)
-                s += "[" + std::to_string(entry.position) + "]";
-            else if (entry.type->filled_struct) {
-                if (entry.position >= 0 && entry.position < (int)entry.type->fields.size())
-                    s += "." + entry.type->fields[entry.position].name;
-            } else if (entry.type->optional_of) {
-                s += "<optional>";
-            } else if (entry.type->filled_variant) {
-                s += "<variant>";
-            } else {
-                s += "<?>";
-            }
-        }
-        if (!s.empty())
-            s += ": ";
-        error = s + error;
+    if (!parse()) {
+        if (state.error.empty())
+            state.error = "failed to parse";
+        add_error_path(state.error, state.stack);
+        return false;
+    }
+    return true;
+}
+
+ABISNAX_NODISCARD inline bool json_to_bin(json_to_bin_state& state, const abi_type* type, std::string_view json) {
+    return parse_json_to_bin(state, type, [&] { return parse_json(state, json); });
+}
+
+// Like json_to_bin, but parses [json, json + size) in place, overwriting it
+ABISNAX_NODISCARD inline bool json_to_bin_insitu(json_to_bin_state& state, const abi_type* type, char* json,
+                                                size_t size) {
+    return parse_json_to_bin(state, type, [&] { return parse_json_insitu(state, json, size); });
+}
+
+// json_to_bin doesn't know an array's size until its end, so it reserves a byte for the size at the start and writes
+// the size there at the end; see bin_output::write_varuint32.
+
+inline void reserve_array_size(json_to_bin_state& state, json_to_bin_stack_entry& entry) {
+    entry.size_position = state.bin.tell();
+    state.bin.push_back(0);
+}
+
+inline void write_array_size(json_to_bin_state& state, const json_to_bin_stack_entry& entry) {
+    state.bin.write_varuint32(entry.size_position, entry.position + 1);
+}
+
+ABISNAX_NODISCARD bool json_to_bin(json_to_bin_state& state, const json_to_bin_program* program,
+                                  std::string_view json);
+ABISNAX_NODISCARD bool json_to_bin_insitu(json_to_bin_state& state, const json_to_bin_program* program, char* json,
+                                         size_t size);
+
+// type is an abi_type or a json_to_bin_program
+template <typename T>
+ABISNAX_NODISCARD bool json_to_bin(std::vector<char>& bin, std::string& error, const T* type, std::string_view json) {
+    auto old_size = bin.size();
+    json_to_bin_state state{error, bin};
+    if (!json_to_bin(state, type, json)) {
+        bin.resize(old_size);
         return false;
     }
+    state.bin.finish();
+    return true;
+}
 
-    size_t pos = 0;
-    for (auto& insertion : state.size_insertions) {
-        bin.insert(bin.end(), state.bin.begin() + pos, state.bin.begin() + insertion.position);
-        push_varuint32(bin, insertion.size);
-        pos = insertion.position;
+// Like json_to_bin, but parses [json, json + size) in place, overwriting it
+template <typename T>
+ABISNAX_NODISCARD bool json_to_bin_insitu(std::vector<char>& bin, std::string& error, const T* type, char* json,
+                                         size_t size) {
+    auto old_size = bin.size();
+    json_to_bin_state state{error, bin};
+    if (!json_to_bin_insitu(state, type, json, size)) {
+        bin.resize(old_size);
+        return false;
     }
-    bin.insert(bin.end(), state.bin.begin() + pos, state.bin.end());
+    state.bin.finish();
+    return true;
+}
+
+// Convert into [buf, buf + cap), writing straight into it. size receives the full size of the binary; buf's content is
+// unspecified if it doesn't fit.
+template <typename T>
+ABISNAX_NODISCARD bool json_to_bin(char* buf, size_t cap, size_t& size, std::string& error, const T* type,
+                                  std::string_view json) {
+    json_to_bin_state state{error, buf, cap};
+    if (!json_to_bin(state, type, json))
+        return false;
+    state.bin.finish();
+    size = state.bin.size();
     return true;
 }
 
@@ -2680,7 +3226,7 @@ ABISNAX_NODISCARD inline bool json_to_bin(pseudo_object*, json_to_bin_state& sta
             auto& field = type->fields[stack_entry.position + 1];
             if (!field.type->extension_of || !allow_extensions) {
                 stack_entry.position = -1;
-                return set_error(state, "expected field \"" + field.name + "\"");
+                return set_error(state, "expected field \"" + std::string{field.name} + "\"");
             }
             ++stack_entry.position;
             state.skipped_extension = true;
@@ -2697,7 +3243,7 @@ ABISNAX_NODISCARD inline bool json_to_bin(pseudo_object*, json_to_bin_state& sta
         auto& field = type->fields[stack_entry.position];
         if (state.received_data.key != field.name) {
             stack_entry.position = -1;
-            return set_error(state, "expected field \"" + field.name + "\"");
+            return set_error(state, "expected field \"" + std::string{field.name} + "\"");
         }
         return true;
     } else {
@@ -2719,15 +3265,14 @@ ABISNAX_NODISCARD inline bool json_to_bin(pseudo_array*, json_to_bin_state& stat
         if (trace_json_to_bin)
             printf("%*s[\n", int(state.stack.size() * 4), "");
         state.stack.push_back({type, false});
-        state.stack.back().size_insertion_index = state.size_insertions.size();
-        state.size_insertions.push_back({state.bin.size()});
+        reserve_array_size(state, state.stack.back());
         return true;
     }
     auto& stack_entry = state.stack.back();
     if (event == event_type::received_end_array) {
         if (trace_json_to_bin)
             printf("%*s]\n", int((state.stack.size() - 1) * 4), "");
-        state.size_insertions[stack_entry.size_insertion_index].size = stack_entry.position + 1;
+        write_array_size(state, stack_entry);
         state.stack.pop_back();
         return true;
     }
@@ -2797,59 +3342,742 @@ ABISNAX_NODISCARD inline bool json_to_bin(std::string*, json_to_bin_state& state
         if (trace_json_to_bin)
             printf("%*sstring: %s\n", int(state.stack.size() * 4), "", s.c_str());
         push_varuint32(state.bin, s.size());
-        state.bin.insert(state.bin.end(), s.begin(), s.end());
+        state.bin.append(s.data(), s.size());
         return true;
     } else
         return set_error(state, "expected string");
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// bin_to_json
+// json_to_bin (json_dom)
 ///////////////////////////////////////////////////////////////////////////////
 
-ABISNAX_NODISCARD inline bool bin_to_json(input_buffer& bin, std::string& error, const abi_type* type,
-                                         std::string& dest) {
-    if (!type->ser)
-        return false;
-    rapidjson::StringBuffer buffer{};
-    rapidjson::Writer<rapidjson::StringBuffer> writer{buffer};
-    bin_to_json_state state{bin, error, writer};
-    if (!type->ser || !type->ser->bin_to_json(state, true, type, true))
-        return false;
-    while (!state.stack.empty()) {
-        auto& entry = state.stack.back();
-        if (!entry.type->ser || !entry.type->ser->bin_to_json(state, entry.allow_extensions, entry.type, false))
-            return false;
-        if (state.stack.size() > max_stack_size)
-            return set_error(state, "recursion limit reached");
+// json_dom holds a parsed document in a few flat arrays instead of jvalue's tree of maps and strings, so parsing
+// allocates little and clearing keeps the memory for the next document. Keys are interned; each struct's fields are
+// matched to key ids once per document. The reorderable json_to_bin uses it to find fields in any order, with the same
+// behavior and errors as the jvalue version.
+
+enum class json_dom_kind : uint8_t { null, boolean, string, object, array };
+
+inline constexpr uint32_t json_dom_no_key = 0xffff'ffff;
+inline constexpr size_t max_json_dom_keys = 4096;
+
+struct json_dom_node {
+    json_dom_kind kind = json_dom_kind::null;
+    bool value_bool = false;
+    uint32_t key = json_dom_no_key; // object members: interned key, or no key if a later member has the same one
+    uint32_t size = 0;              // string: length; object: members; array: items
+    uint32_t offset = 0;            // string: position in strings
+    uint32_t next = 0;              // the node after this one's members or items
+};
+
+struct json_dom {
+    std::vector<json_dom_node> nodes{}; // in document order
+    std::string strings{};
+
+    // Interned keys are kept when the dom is cleared, up to max_json_dom_keys
+    std::map<std::string, uint32_t, std::less<>> keys{};
+    std::vector<uint32_t> key_marks{};   // finds duplicate keys
+    std::vector<uint32_t> key_members{}; // finds duplicate keys
+    uint32_t mark = 0;
+
+    std::map<const abi_type*, size_t> field_keys_pos{}; // where each struct's field keys start
+    std::vector<uint32_t> field_keys{};
+
+    void clear() {
+        nodes.clear();
+        strings.clear();
+        field_keys_pos.clear();
+        field_keys.clear();
+        if (keys.size() > max_json_dom_keys) {
+            keys.clear();
+            key_marks.clear();
+            key_members.clear();
+        }
     }
-    dest = buffer.GetString();
-    return true;
-}
+};
 
-ABISNAX_NODISCARD inline bool bin_to_json(pseudo_optional*, bin_to_json_state& state, bool allow_extensions,
-                                         const abi_type* type, bool) {
-    bool present;
-    if (!read_raw(state.bin, state.error, present))
-        return false;
-    if (present)
-        return type->optional_of->ser &&
-               type->optional_of->ser->bin_to_json(state, allow_extensions, type->optional_of, true);
-    state.writer.Null();
-    return true;
+inline event_type get_event_type(const json_dom_node& node) {
+    switch (node.kind) {
+    case json_dom_kind::null: return event_type::received_null;
+    case json_dom_kind::boolean: return event_type::received_bool;
+    case json_dom_kind::string: return event_type::received_string;
+    case json_dom_kind::object: return event_type::received_start_object;
+    case json_dom_kind::array: return event_type::received_start_array;
+    }
+    return event_type::received_null;
 }
 
-ABISNAX_NODISCARD inline bool bin_to_json(pseudo_extension*, bin_to_json_state& state, bool allow_extensions,
-                                         const abi_type* type, bool) {
-    return type->extension_of->ser &&
-           type->extension_of->ser->bin_to_json(state, allow_extensions, type->extension_of, true);
-}
+struct json_to_dom_state : rapidjson::BaseReaderHandler<rapidjson::UTF8<>, json_to_dom_state> {
+    json_dom& dom;
+    std::string& error;
+    std::vector<uint32_t> stack{}; // open objects and arrays
+    uint32_t key = json_dom_no_key;
+
+    json_to_dom_state(json_dom& dom, std::string& error) : dom{dom}, error{error} {}
+
+    json_dom_node& add(json_dom_kind kind) {
+        if (!stack.empty())
+            ++dom.nodes[stack.back()].size;
+        auto& node = dom.nodes.emplace_back();
+        node.kind = kind;
+        node.key = key;
+        node.next = dom.nodes.size();
+        key = json_dom_no_key;
+        return node;
+    }
+
+    bool start(json_dom_kind kind) {
+        if (stack.size() >= max_stack_size)
+            return set_error(error, "recursion limit reached");
+        add(kind);
+        stack.push_back(dom.nodes.size() - 1);
+        return true;
+    }
+
+    void end() {
+        dom.nodes[stack.back()].next = dom.nodes.size();
+        stack.pop_back();
+    }
+
+    bool Null() {
+        add(json_dom_kind::null);
+        return true;
+    }
+
+    bool Bool(bool v) {
+        add(json_dom_kind::boolean).value_bool = v;
+        return true;
+    }
+
+    bool RawNumber(const char* v, rapidjson::SizeType length, bool copy) { return String(v, length, copy); }
+
+    bool String(const char* v, rapidjson::SizeType length, bool) {
+        if (dom.strings.size() + length != uint32_t(dom.strings.size() + length))
+            return set_error(error, "json is too large");
+        auto& node = add(json_dom_kind::string);
+        node.offset = dom.strings.size();
+        node.size = length;
+        dom.strings.append(v, length);
+        return true;
+    }
+
+    bool StartObject() { return start(json_dom_kind::object); }
+    bool StartArray() { return start(json_dom_kind::array); }
+    bool EndArray(rapidjson::SizeType) {
+        end();
+        return true;
+    }
+
+    bool Key(const char* v, rapidjson::SizeType length, bool) {
+        std::string_view k{v, length};
+        auto it = dom.keys.find(k);
+        if (it == dom.keys.end()) {
+            it = dom.keys.emplace(std::string{k}, dom.keys.size()).first;
+            dom.key_marks.push_back(0);
+            dom.key_members.push_back(0);
+        }
+        key = it->second;
+        return true;
+    }
+
+    // Like jvalue, keep the last member with each key
+    bool EndObject(rapidjson::SizeType) {
+        auto& obj = dom.nodes[stack.back()];
+        if (!++dom.mark) {
+            std::fill(dom.key_marks.begin(), dom.key_marks.end(), 0);
+            dom.mark = 1;
+        }
+        for (uint32_t member = stack.back() + 1, i = 0; i < obj.size; member = dom.nodes[member].next, ++i) {
+            auto k = dom.nodes[member].key;
+            if (dom.key_marks[k] == dom.mark)
+                dom.nodes[dom.key_members[k]].key = json_dom_no_key;
+            dom.key_marks[k] = dom.mark;
+            dom.key_members[k] = member;
+        }
+        end();
+        return true;
+    }
+};
+
+// Parse json into dom, replacing its content
+ABISNAX_NODISCARD inline bool json_to_dom(json_dom& dom, std::string& error, std::string_view json) {
+    dom.clear();
+    json_to_dom_state state{dom, error};
+    return parse_json(state, json);
+}
+
+// Position in dom.field_keys of the key of each of a struct's fields
+inline size_t get_field_keys(json_dom& dom, const abi_type* type) {
+    auto [it, inserted] = dom.field_keys_pos.try_emplace(type, dom.field_keys.size());
+    if (inserted) {
+        for (auto& field : type->fields) {
+            auto k = dom.keys.find(field.name);
+            dom.field_keys.push_back(k == dom.keys.end() ? json_dom_no_key : k->second);
+        }
+    }
+    return it->second;
+}
+
+// Convert dom.nodes[index]. state.stack mirrors the stack the jvalue version keeps, for error messages.
+ABISNAX_NODISCARD inline bool json_to_bin(json_to_bin_state& state, json_dom& dom, uint32_t index,
+                                         const abi_type* type, bool allow_extensions) {
+    auto& node = dom.nodes[index];
+    auto* ser = type->ser;
+    if (!ser)
+        return false;
+    if (ser == &abi_serializer_for<pseudo_extension>)
+        return json_to_bin(state, dom, index, type->extension_of, allow_extensions);
+    if (ser == &abi_serializer_for<pseudo_optional>) {
+        state.bin.push_back(node.kind != json_dom_kind::null);
+        return node.kind == json_dom_kind::null ||
+               json_to_bin(state, dom, index, type->optional_of, allow_extensions);
+    }
+    if (ser == &abi_serializer_for<pseudo_object>) {
+        if (node.kind != json_dom_kind::object)
+            return set_error(state.error, "expected object");
+        auto keys = get_field_keys(dom, type);
+        auto entry = state.stack.size();
+        state.stack.push_back({type, allow_extensions});
+        // Members are usually in field order, so look for each field after the previous one first
+        uint32_t cursor = index + 1;
+        for (auto& field : type->fields) {
+            auto k = dom.field_keys[keys + ++state.stack[entry].position];
+            uint32_t member = 0;
+            if (k != json_dom_no_key) {
+                if (cursor < node.next && dom.nodes[cursor].key == k) {
+                    member = cursor;
+                } else {
+                    for (uint32_t m = index + 1; m < node.next; m = dom.nodes[m].next) {
+                        if (dom.nodes[m].key == k) {
+                            member = m;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (!member) {
+                if (field.type->extension_of && allow_extensions) {
+                    state.skipped_extension = true;
+                    continue;
+                }
+                state.stack[entry].position = -1;
+                return set_error(state.error, "expected field \"" + std::string{field.name} + "\"");
+            }
+            if (state.skipped_extension)
+                return set_error(state.error, "unexpected field \"" + std::string{field.name} + "\"");
+            if (!json_to_bin(state, dom, member, field.type, allow_extensions && &field == &type->fields.back()))
+                return false;
+            cursor = dom.nodes[member].next;
+        }
+        state.stack.pop_back();
+        return true;
+    }
+    if (ser == &abi_serializer_for<pseudo_array>) {
+        if (node.kind != json_dom_kind::array)
+            return set_error(state.error, "expected array");
+        push_varuint32(state.bin, node.size);
+        auto entry = state.stack.size();
+        state.stack.push_back({type, false});
+        for (uint32_t item = index + 1, i = 0; i < node.size; item = dom.nodes[item].next, ++i) {
+            state.stack[entry].position = i;
+            if (!json_to_bin(state, dom, item, type->array_of, false))
+                return false;
+        }
+        state.stack.pop_back();
+        return true;
+    }
+    if (ser == &abi_serializer_for<pseudo_variant>) {
+        auto& type_node = dom.nodes[index + 1];
+        if (node.kind != json_dom_kind::array || node.size != 2 || type_node.kind != json_dom_kind::string)
+            return set_error(state.error, R"(expected variant: ["type", value])");
+        std::string_view type_name{dom.strings.data() + type_node.offset, type_node.size};
+        auto entry = state.stack.size();
+        state.stack.push_back({type, allow_extensions, 0});
+        auto it = std::find_if(type->fields.begin(), type->fields.end(),
+                               [&](auto& field) { return field.name == type_name; });
+        if (it == type->fields.end())
+            return set_error(state.error, "type is not valid for this variant");
+        push_varuint32(state.bin, it - type->fields.begin());
+        state.stack[entry].position = 1;
+        if (!json_to_bin(state, dom, type_node.next, it->type, allow_extensions))
+            return false;
+        state.stack.pop_back();
+        return true;
+    }
+    if (node.kind == json_dom_kind::string)
+        state.received_data.value_string.assign(dom.strings.data() + node.offset, node.size);
+    else
+        state.received_data.value_bool = node.value_bool;
+    return ser->json_to_bin(state, allow_extensions, type, get_event_type(node), true);
+}
+
+// Convert a document parsed by json_to_dom
+ABISNAX_NODISCARD inline bool json_to_bin(std::vector<char>& bin, std::string& error, const abi_type* type,
+                                         json_dom& dom) {
+    auto old_size = bin.size();
+    json_to_bin_state state{error, bin};
+    if (!json_to_bin(state, dom, 0, type, true)) {
+        bin.resize(old_size);
+        add_error_path(error, state.stack);
+        return false;
+    }
+    state.bin.finish();
+    return true;
+}
+
+// Convert json whose fields may be in any order. Most json has them in order, so this tries the streaming json_to_bin
+// with ordered (type or its json_to_bin_program) first, and only parses json into dom if that fails. The result and
+// errors are the same as converting through dom alone.
+template <typename T>
+ABISNAX_NODISCARD bool json_to_bin_reorderable(std::vector<char>& bin, std::string& error, const abi_type* type,
+                                              const T* ordered, json_dom& dom, std::string_view json) {
+    if (json_to_bin(bin, error, ordered, json))
+        return true;
+    error.clear();
+    return json_to_dom(dom, error, json) && json_to_bin(bin, error, type, dom);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// json_to_bin (chunked)
+///////////////////////////////////////////////////////////////////////////////
+
+// Decode the escapes in a json string's content. false if one is invalid. Like rapidjson, a high surrogate must be
+// followed by a low one, but a lone low surrogate is kept.
+ABISNAX_NODISCARD inline bool unescape_json(std::string& dest, std::string_view s) {
+    auto hex4 = [&](size_t pos, uint32_t& v) {
+        if (pos + 4 > s.size())
+            return false;
+        v = 0;
+        for (auto c : s.substr(pos, 4)) {
+            if (c >= '0' && c <= '9')
+                v = (v << 4) | (c - '0');
+            else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                v = (v << 4) | ((c | 0x20) - 'a' + 10);
+            else
+                return false;
+        }
+        return true;
+    };
+    dest.clear();
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] != '\\') {
+            dest.push_back(s[i]);
+            continue;
+        }
+        switch (s[++i]) {
+        case '"': dest.push_back('"'); break;
+        case '\\': dest.push_back('\\'); break;
+        case '/': dest.push_back('/'); break;
+        case 'b': dest.push_back('\b'); break;
+        case 'f': dest.push_back('\f'); break;
+        case 'n': dest.push_back('\n'); break;
+        case 'r': dest.push_back('\r'); break;
+        case 't': dest.push_back('\t'); break;
+        case 'u': {
+            uint32_t v, low;
+            if (!hex4(i + 1, v))
+                return false;
+            i += 4;
+            if (v >= 0xd800 && v <= 0xdbff) {
+                if (s.substr(i + 1, 2) != "\\u" || !hex4(i + 3, low) || low < 0xdc00 || low > 0xdfff)
+                    return false;
+                i += 6;
+                v = (((v - 0xd800) << 10) | (low - 0xdc00)) + 0x10000;
+            }
+            if (v < 0x80) {
+                dest.push_back(v);
+            } else if (v < 0x800) {
+                dest.push_back(0xc0 | (v >> 6));
+                dest.push_back(0x80 | (v & 0x3f));
+            } else if (v < 0x10000) {
+                dest.push_back(0xe0 | (v >> 12));
+                dest.push_back(0x80 | ((v >> 6) & 0x3f));
+                dest.push_back(0x80 | (v & 0x3f));
+            } else {
+                dest.push_back(0xf0 | (v >> 18));
+                dest.push_back(0x80 | ((v >> 12) & 0x3f));
+                dest.push_back(0x80 | ((v >> 6) & 0x3f));
+                dest.push_back(0x80 | (v & 0x3f));
+            }
+            break;
+        }
+        default: return false;
+        }
+    }
+    return true;
+}
+
+// Same checks as rapidjson's kParseValidateEncodingFlag: no overlong encodings, surrogates or code points past
+// U+10FFFF
+inline bool is_valid_utf8(std::string_view s) {
+    for (size_t i = 0; i < s.size();) {
+        auto c = (uint8_t)s[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t n;
+        uint8_t lo = 0x80, hi = 0xbf;
+        if (c >= 0xc2 && c <= 0xdf)
+            n = 1;
+        else if (c >= 0xe0 && c <= 0xef)
+            n = 2, lo = c == 0xe0 ? 0xa0 : 0x80, hi = c == 0xed ? 0x9f : 0xbf;
+        else if (c >= 0xf0 && c <= 0xf4)
+            n = 3, lo = c == 0xf0 ? 0x90 : 0x80, hi = c == 0xf4 ? 0x8f : 0xbf;
+        else
+            return false;
+        if (i + n >= s.size())
+            return false;
+        for (size_t j = 1; j <= n; ++j) {
+            auto d = (uint8_t)s[i + j];
+            if (d < (j == 1 ? lo : 0x80) || d > (j == 1 ? hi : 0xbf))
+                return false;
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+// Size of the number at the start of s, or 0 if it's malformed. Like rapidjson, what follows the number is left for
+// the caller; e.g. "01" is the number 0 followed by a stray 1.
+inline size_t json_number_size(std::string_view s) {
+    size_t i = 0;
+    auto digits = [&] {
+        auto begin = i;
+        while (i < s.size() && s[i] >= '0' && s[i] <= '9')
+            ++i;
+        return i > begin;
+    };
+    if (i < s.size() && s[i] == '-')
+        ++i;
+    if (i < s.size() && s[i] == '0')
+        ++i;
+    else if (!digits())
+        return 0;
+    if (i < s.size() && s[i] == '.' && (++i, !digits()))
+        return 0;
+    if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+        ++i;
+        if (i < s.size() && (s[i] == '+' || s[i] == '-'))
+            ++i;
+        if (!digits())
+            return 0;
+    }
+    return i;
+}
+
+// Parses json given in chunks of any size, calling handler's methods as rapidjson's reader does with json_parse_flags.
+// Only a string, number or literal split between chunks is kept from one chunk to the next.
+template <typename Handler>
+struct json_chunk_parser {
+    enum class expect : uint8_t { value, value_or_end_array, key, key_or_end_object, colon, comma_or_end, done };
+    enum class token_kind : uint8_t { none, string, key, number, literal };
+
+    struct container {
+        bool object = false;
+        rapidjson::SizeType count = 0;
+    };
+
+    Handler& handler;
+    std::vector<container> containers{};
+    expect next = expect::value;
+    token_kind kind = token_kind::none;
+    bool escaped = false;     // string: the previous character was a backslash which escapes this one
+    bool has_escapes = false; // string
+    bool failed = false;
+    std::string token{}; // the part of the token in earlier chunks
+    std::string unescaped{};
+
+    explicit json_chunk_parser(Handler& handler) : handler{handler} {}
+
+    bool fail() {
+        failed = true;
+        return false;
+    }
+
+    ABISNAX_NODISCARD bool feed(const char* p, const char* end) {
+        if (failed)
+            return false;
+        while (p != end) {
+            if (kind != token_kind::none) {
+                if (!continue_token(p, end))
+                    return fail();
+            } else if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+                ++p;
+            } else if (!structural(p)) {
+                return fail();
+            }
+        }
+        return true;
+    }
+
+    // Call once the last chunk has been fed
+    ABISNAX_NODISCARD bool finish() {
+        if (failed)
+            return false;
+        if ((kind == token_kind::number || kind == token_kind::literal) && !end_token(token))
+            return fail();
+        if (kind != token_kind::none || next != expect::done)
+            return fail();
+        return true;
+    }
+
+    void after_value() { next = containers.empty() ? expect::done : expect::comma_or_end; }
+
+    bool end_container(bool object) {
+        if (containers.empty() || containers.back().object != object)
+            return false;
+        auto count = containers.back().count;
+        containers.pop_back();
+        after_value();
+        return object ? handler.EndObject(count) : handler.EndArray(count);
+    }
+
+    // Handle the character at p outside of tokens. Numbers and literals leave it for continue_token.
+    bool structural(const char*& p) {
+        char c = *p;
+        switch (next) {
+        case expect::value_or_end_array:
+            if (c == ']')
+                return ++p, end_container(false);
+            [[fallthrough]];
+        case expect::value:
+            if (!containers.empty())
+                ++containers.back().count;
+            if (c == '{') {
+                ++p;
+                containers.push_back({true});
+                next = expect::key_or_end_object;
+                return handler.StartObject();
+            }
+            if (c == '[') {
+                ++p;
+                containers.push_back({false});
+                next = expect::value_or_end_array;
+                return handler.StartArray();
+            }
+            if (c == '"')
+                return ++p, start_token(token_kind::string);
+            if (c == '-' || (c >= '0' && c <= '9'))
+                return start_token(token_kind::number);
+            if (c >= 'a' && c <= 'z')
+                return start_token(token_kind::literal);
+            return false;
+        case expect::key_or_end_object:
+            if (c == '}')
+                return ++p, end_container(true);
+            [[fallthrough]];
+        case expect::key:
+            return c == '"' && (++p, start_token(token_kind::key));
+        case expect::colon:
+            if (c != ':')
+                return false;
+            ++p;
+            next = expect::value;
+            return true;
+        case expect::comma_or_end:
+            ++p;
+            if (c == ',') {
+                next = containers.back().object ? expect::key : expect::value;
+                return true;
+            }
+            return (c == '}' || c == ']') && end_container(c == '}');
+        case expect::done: return false;
+        }
+        return false;
+    }
+
+    bool start_token(token_kind k) {
+        kind = k;
+        escaped = has_escapes = false;
+        token.clear();
+        return true;
+    }
+
+    // Scan the rest of the current token within this chunk. A token which doesn't cross chunks isn't copied.
+    bool continue_token(const char*& p, const char* end) {
+        auto* begin = p;
+        if (kind == token_kind::string || kind == token_kind::key) {
+            for (; p != end; ++p) {
+                if (escaped)
+                    escaped = false;
+                else if (*p == '\\')
+                    escaped = has_escapes = true;
+                else if (*p == '"')
+                    break;
+                else if ((uint8_t)*p < 0x20)
+                    return false;
+            }
+        } else if (kind == token_kind::number) {
+            while (p != end && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.' || *p == 'e' ||
+                                *p == 'E'))
+                ++p;
+        } else {
+            while (p != end && *p >= 'a' && *p <= 'z')
+                ++p;
+        }
+        if (p == end) {
+            token.append(begin, p);
+            return true;
+        }
+        std::string_view s{begin, size_t(p - begin)};
+        if (!token.empty()) {
+            token.append(begin, p);
+            s = token;
+        }
+        if (kind == token_kind::string || kind == token_kind::key)
+            ++p;
+        return end_token(s);
+    }
+
+    bool end_token(std::string_view s) {
+        auto k = kind;
+        kind = token_kind::none;
+        // Like rapidjson, a well-formed number or literal reaches handler even when more characters follow it
+        if (k == token_kind::number) {
+            after_value();
+            auto size = json_number_size(s);
+            return size && handler.RawNumber(s.data(), size, true) && size == s.size();
+        }
+        if (k == token_kind::literal) {
+            after_value();
+            auto lit = s.substr(0, s[0] == 'f' ? 5 : 4);
+            if (lit == "null")
+                return handler.Null() && lit.size() == s.size();
+            if (lit == "true" || lit == "false")
+                return handler.Bool(lit == "true") && lit.size() == s.size();
+            return false;
+        }
+        if (s.size() > std::numeric_limits<rapidjson::SizeType>::max() || !is_valid_utf8(s))
+            return false;
+        if (has_escapes) {
+            if (!unescape_json(unescaped, s))
+                return false;
+            s = unescaped;
+        }
+        if (k == token_kind::key) {
+            next = expect::colon;
+            return handler.Key(s.data(), s.size(), true);
+        }
+        after_value();
+        return handler.String(s.data(), s.size(), true);
+    }
+};
+
+// Converts json given in chunks to binary, without holding all of the json at once. Feed it the chunks in order, then
+// call finish. Fields must be in order, as with json_to_bin.
+struct json_to_bin_chunked {
+    std::string error{};
+    std::vector<char> bin{};
+    json_to_bin_state state{error, bin};
+    json_chunk_parser<json_to_bin_state> parser{state};
+
+    explicit json_to_bin_chunked(const abi_type* type) { state.stack.push_back({type, true}); }
+    explicit json_to_bin_chunked(const json_to_bin_program* program);
+    json_to_bin_chunked(const json_to_bin_chunked&) = delete;
+    json_to_bin_chunked& operator=(const json_to_bin_chunked&) = delete;
+
+    ABISNAX_NODISCARD bool feed(std::string_view chunk) {
+        return parser.feed(chunk.data(), chunk.data() + chunk.size()) || fail();
+    }
+
+    // On success, bin holds the binary
+    ABISNAX_NODISCARD bool finish() {
+        if (!parser.finish())
+            return fail();
+        state.bin.finish();
+        return true;
+    }
+
+  private:
+    bool reported = false;
+
+    // Like parse_json_to_bin
+    bool fail() {
+        if (!reported) {
+            reported = true;
+            if (error.empty())
+                error = "failed to parse";
+            add_error_path(error, state.stack);
+        }
+        return false;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// bin_to_json
+///////////////////////////////////////////////////////////////////////////////
+
+// Convert one value into state.writer. state.stack must be empty; depth counts entries held further up by the caller.
+ABISNAX_NODISCARD inline bool bin_to_json(bin_to_json_state& state, const abi_type* type, bool allow_extensions,
+                                         size_t depth = 0) {
+    if (!type->ser || !type->ser->bin_to_json(state, allow_extensions, type, true))
+        return false;
+    while (!state.stack.empty()) {
+        auto& entry = state.stack.back();
+        if (!entry.type->ser || !entry.type->ser->bin_to_json(state, entry.allow_extensions, entry.type, false))
+            return false;
+        if (depth + state.stack.size() > max_stack_size)
+            return set_error(state, "recursion limit reached");
+    }
+    return true;
+}
+
+ABISNAX_NODISCARD inline bool bin_to_json(input_buffer& bin, std::string& error, const abi_type* type,
+                                         json_output_stream& stream) {
+    if (!type->ser)
+        return false;
+    rapidjson::Writer<json_output_stream> writer{stream};
+    bin_to_json_state state{bin, error, writer};
+    return bin_to_json(state, type, true);
+}
+
+// type is an abi_type or a bin_to_json_program
+template <typename T>
+ABISNAX_NODISCARD bool bin_to_json(input_buffer& bin, std::string& error, const T* type, std::string& dest) {
+    dest.clear();
+    json_output_stream stream{dest};
+    bool ok = bin_to_json(bin, error, type, stream);
+    stream.finish();
+    return ok;
+}
+
+// Convert into [buf, buf + cap). size receives the full size of the json, even if it didn't fit.
+template <typename T>
+ABISNAX_NODISCARD bool bin_to_json(input_buffer& bin, std::string& error, const T* type, char* buf, size_t cap,
+                                  size_t& size) {
+    json_output_stream stream{buf, cap};
+    bool ok = bin_to_json(bin, error, type, stream);
+    size = stream.size();
+    return ok;
+}
+
+ABISNAX_NODISCARD inline bool bin_to_json(pseudo_optional*, bin_to_json_state& state, bool allow_extensions,
+                                         const abi_type* type, bool) {
+    bool present;
+    if (!read_raw(state.bin, state.error, present))
+        return false;
+    if (present)
+        return type->optional_of->ser &&
+               type->optional_of->ser->bin_to_json(state, allow_extensions, type->optional_of, true);
+    state.writer.Null();
+    return true;
+}
+
+ABISNAX_NODISCARD inline bool bin_to_json(pseudo_extension*, bin_to_json_state& state, bool allow_extensions,
+                                         const abi_type* type, bool) {
+    return type->extension_of->ser &&
+           type->extension_of->ser->bin_to_json(state, allow_extensions, type->extension_of, true);
+}
 
 ABISNAX_NODISCARD inline bool bin_to_json(pseudo_object*, bin_to_json_state& state, bool allow_extensions,
                                          const abi_type* type, bool start) {
     if (start) {
         if (trace_bin_to_json)
             printf("%*s{ %d fields\n", int(state.stack.size() * 4), "", int(type->fields.size()));
+        if (!check_remaining(state.bin, state.error, type->fixed_size))
+            return false;
         state.stack.push_back({type, allow_extensions});
         state.writer.StartObject();
         return true;
@@ -2864,7 +4092,7 @@ ABISNAX_NODISCARD inline bool bin_to_json(pseudo_object*, bin_to_json_state& sta
             state.skipped_extension = true;
             return true;
         }
-        state.writer.Key(field.name.c_str(), field.name.length());
+        state.writer.Key(field.name.data(), field.name.length());
         return field.type->ser && field.type->ser->bin_to_json(
                                       state, allow_extensions && &field == &type->fields.back(), field.type, true);
     } else {
@@ -2882,6 +4110,9 @@ ABISNAX_NODISCARD inline bool bin_to_json(pseudo_array*, bin_to_json_state& stat
         state.stack.push_back({type, false});
         if (!read_varuint32(state.bin, state.error, state.stack.back().array_size))
             return false;
+        auto size = state.stack.back().array_size;
+        if (!check_remaining(state.bin, state.error, uint64_t(size) * type->array_of->fixed_size))
+            return false;
         if (trace_bin_to_json)
             printf("%*s[ %d items\n", int(state.stack.size() * 4), "", int(state.stack.back().array_size));
         state.writer.StartArray();
@@ -2891,7 +4122,7 @@ ABISNAX_NODISCARD inline bool bin_to_json(pseudo_array*, bin_to_json_state& stat
     if (++stack_entry.position < (ptrdiff_t)stack_entry.array_size) {
         if (trace_bin_to_json)
             printf("%*sitem %d/%d %p %s\n", int(state.stack.size() * 4), "", int(stack_entry.position),
-                   int(stack_entry.array_size), type->array_of->ser, type->array_of->name.c_str());
+                   int(stack_entry.array_size), type->array_of->ser, std::string{type->array_of->name}.c_str());
         return type->array_of->ser && type->array_of->ser->bin_to_json(state, false, type->array_of, true);
     } else {
         if (trace_bin_to_json)
@@ -2919,7 +4150,7 @@ ABISNAX_NODISCARD inline bool bin_to_json(pseudo_variant*, bin_to_json_state& st
         if (index >= stack_entry.type->fields.size())
             return set_error(state, "invalid variant type index");
         auto& f = stack_entry.type->fields[index];
-        state.writer.String(f.name.c_str());
+        state.writer.String(f.name.data(), f.name.length());
         return f.type->ser &&
                f.type->ser->bin_to_json(state, allow_extensions && stack_entry.allow_extensions, f.type, true);
     } else {
@@ -2932,12 +4163,7 @@ ABISNAX_NODISCARD inline bool bin_to_json(pseudo_variant*, bin_to_json_state& st
 }
 
 template <typename T>
-ABISNAX_NODISCARD auto bin_to_json(T*, bin_to_json_state& state, bool, const abi_type*, bool start)
-    -> std::enable_if_t<std::is_arithmetic_v<T>, bool> {
-
-    T v;
-    if (!read_raw(state.bin, state.error, v))
-        return false;
+ABISNAX_NODISCARD bool arithmetic_to_json(bin_to_json_state& state, T v) {
     if constexpr (std::is_same_v<T, bool>) {
         return state.writer.Bool(v);
     } else if constexpr (std::is_floating_point_v<T>) {
@@ -2952,6 +4178,38 @@ ABISNAX_NODISCARD auto bin_to_json(T*, bin_to_json_state& state, bool, const abi
     }
 }
 
+template <typename T>
+ABISNAX_NODISCARD auto bin_to_json(T*, bin_to_json_state& state, bool, const abi_type*, bool start)
+    -> std::enable_if_t<std::is_arithmetic_v<T>, bool> {
+
+    T v;
+    if (!read_raw(state.bin, state.error, v))
+        return false;
+    return arithmetic_to_json(state, v);
+}
+
+// Convert a value of a built-in fixed-size type which the caller has already bounds checked, e.g. as part of a
+// fixed-size struct. Arithmetic types and names are read straight from bin.pos; other types keep their own reads.
+template <typename T>
+ABISNAX_NODISCARD bool unchecked_bin_to_json(T*, bin_to_json_state& state) {
+    if constexpr (std::is_same_v<T, bool>) {
+        return state.writer.Bool(*state.bin.pos++);
+    } else if constexpr (std::is_arithmetic_v<T>) {
+        T v;
+        memcpy(&v, state.bin.pos, sizeof(v));
+        state.bin.pos += sizeof(v);
+        return arithmetic_to_json(state, v);
+    } else if constexpr (std::is_same_v<T, name>) {
+        name v;
+        memcpy(&v.value, state.bin.pos, sizeof(v.value));
+        state.bin.pos += sizeof(v.value);
+        auto s = std::string{v};
+        return state.writer.String(s.c_str(), s.size());
+    } else {
+        return bin_to_json((T*)nullptr, state, false, nullptr, true);
+    }
+}
+
 ABISNAX_NODISCARD inline bool bin_to_json(std::string*, bin_to_json_state& state, bool, const abi_type*, bool start) {
     std::string s;
     if (!read_string(state.bin, state.error, s))
@@ -2959,8 +4217,1915 @@ ABISNAX_NODISCARD inline bool bin_to_json(std::string*, bin_to_json_state& state
     return state.writer.String(s.c_str(), s.size());
 }
 
-inline namespace literals {
-inline constexpr name operator""_n(const char* s, size_t) { return name{s}; }
-} // namespace literals
+///////////////////////////////////////////////////////////////////////////////
+// bin_to_json (compiled)
+///////////////////////////////////////////////////////////////////////////////
 
-} // namespace abisnax
+// bin_to_json_program is a type graph flattened into a list of ops, which avoids the virtual calls and stack entries
+// the serializers above need for every value. Structs and variants compile to subroutines so recursive types work.
+
+enum class bin_to_json_opcode : uint8_t {
+    done,
+    call,           // call subroutine at target
+    ret,            // return from subroutine
+    jump,           // jump to target
+    fail,           // type has no serializer
+    start_object,   //
+    fixed_object,   // bounds check type->fixed_size, then convert the whole struct without further checks
+    end_object,     //
+    key,            // write key
+    skip_extension, // jump to target if there's no more data
+    optional,       // read present flag; if absent, write null and jump to target
+    start_array,    // read size, bounds check fixed-size items (type) and start array; if empty, jump to target
+    next_item,      // jump to target (first op of item) if there are more items
+    end_array,      //
+    variant,        // read index, start array, write alternative name and jump to targets[target + index]
+    leaf,           // type->ser->bin_to_json
+    bool_,
+    int8,
+    uint8,
+    int16,
+    uint16,
+    int32,
+    uint32,
+    int64,
+    uint64,
+    float32,
+    float64,
+    varuint32,
+    name,
+    string,
+};
+
+struct bin_to_json_op {
+    bin_to_json_opcode code = bin_to_json_opcode::done;
+    uint32_t target = 0;
+    const abi_type* type = nullptr;
+    std::string_view key = {};
+};
+
+struct bin_to_json_program {
+    std::vector<bin_to_json_op> ops{};
+    std::vector<uint32_t> targets{};
+};
+
+inline bin_to_json_opcode get_leaf_opcode(const abi_serializer* ser) {
+    using op = bin_to_json_opcode;
+    if (ser == &abi_serializer_for<bool>)
+        return op::bool_;
+    if (ser == &abi_serializer_for<int8_t>)
+        return op::int8;
+    if (ser == &abi_serializer_for<uint8_t>)
+        return op::uint8;
+    if (ser == &abi_serializer_for<int16_t>)
+        return op::int16;
+    if (ser == &abi_serializer_for<uint16_t>)
+        return op::uint16;
+    if (ser == &abi_serializer_for<int32_t>)
+        return op::int32;
+    if (ser == &abi_serializer_for<uint32_t>)
+        return op::uint32;
+    if (ser == &abi_serializer_for<int64_t>)
+        return op::int64;
+    if (ser == &abi_serializer_for<uint64_t>)
+        return op::uint64;
+    if (ser == &abi_serializer_for<float>)
+        return op::float32;
+    if (ser == &abi_serializer_for<double>)
+        return op::float64;
+    if (ser == &abi_serializer_for<::abisnax::varuint32>)
+        return op::varuint32;
+    if (ser == &abi_serializer_for<::abisnax::name>)
+        return op::name;
+    if (ser == &abi_serializer_for<std::string>)
+        return op::string;
+    return op::leaf;
+}
+
+struct bin_to_json_compiler {
+    using op = bin_to_json_opcode;
+
+    bin_to_json_program& program;
+    std::map<std::pair<const abi_type*, bool>, uint32_t> subroutines{};
+    std::vector<std::pair<const abi_type*, bool>> pending{};
+    std::vector<uint32_t> pcs{};
+
+    uint32_t emit(op code, const abi_type* type = nullptr, std::string_view key = {}) {
+        program.ops.push_back({code, 0, type, key});
+        return program.ops.size() - 1;
+    }
+
+    uint32_t pc() const { return program.ops.size(); }
+
+    // allow_extensions has the same meaning as in abi_serializer::bin_to_json
+    void value(const abi_type* type, bool allow_extensions) {
+        if (type->extension_of && type->ser == &abi_serializer_for<pseudo_extension>) {
+            value(type->extension_of, allow_extensions);
+        } else if (type->optional_of && type->ser == &abi_serializer_for<pseudo_optional>) {
+            auto optional = emit(op::optional);
+            value(type->optional_of, allow_extensions);
+            program.ops[optional].target = pc();
+        } else if (type->array_of && type->ser == &abi_serializer_for<pseudo_array>) {
+            auto start = emit(op::start_array, type->array_of);
+            auto item = pc();
+            value(type->array_of, false);
+            program.ops[emit(op::next_item)].target = item;
+            program.ops[start].target = pc();
+            emit(op::end_array);
+        } else if (type->ser == &abi_serializer_for<pseudo_object> && type->fixed_size) {
+            emit(op::fixed_object, type);
+        } else if (type->ser == &abi_serializer_for<pseudo_object> ||
+                   type->ser == &abi_serializer_for<pseudo_variant>) {
+            auto [it, inserted] = subroutines.try_emplace({type, allow_extensions}, subroutines.size());
+            if (inserted)
+                pending.push_back(it->first);
+            program.ops[emit(op::call)].target = it->second;
+        } else if (!type->ser) {
+            emit(op::fail);
+        } else {
+            emit(get_leaf_opcode(type->ser), type);
+        }
+    }
+
+    void object(const abi_type* type, bool allow_extensions) {
+        emit(op::start_object, type);
+        for (auto& field : type->fields) {
+            uint32_t skip = 0;
+            bool extension = allow_extensions && field.type->extension_of;
+            if (extension)
+                skip = emit(op::skip_extension);
+            emit(op::key, nullptr, field.name);
+            value(field.type, allow_extensions && &field == &type->fields.back());
+            if (extension)
+                program.ops[skip].target = pc();
+        }
+        emit(op::end_object);
+    }
+
+    void variant(const abi_type* type, bool allow_extensions) {
+        auto first_target = program.targets.size();
+        program.ops[emit(op::variant, type)].target = first_target;
+        program.targets.resize(first_target + type->fields.size());
+        std::vector<uint32_t> jumps;
+        for (size_t i = 0; i < type->fields.size(); ++i) {
+            program.targets[first_target + i] = pc();
+            value(type->fields[i].type, allow_extensions);
+            jumps.push_back(emit(op::jump));
+        }
+        for (auto jump : jumps)
+            program.ops[jump].target = pc();
+        emit(op::end_array);
+    }
+
+    void compile(const abi_type* type) {
+        program.ops.clear();
+        program.targets.clear();
+        value(type, true);
+        emit(op::done);
+        for (size_t i = 0; i < pending.size(); ++i) {
+            auto [type, allow_extensions] = pending[i];
+            pcs.push_back(pc());
+            if (type->ser == &abi_serializer_for<pseudo_object>)
+                object(type, allow_extensions);
+            else
+                variant(type, allow_extensions);
+            emit(op::ret);
+        }
+        for (auto& o : program.ops)
+            if (o.code == op::call)
+                o.target = pcs[o.target];
+    }
+};
+
+inline void compile_bin_to_json(bin_to_json_program& program, const abi_type* type) {
+    bin_to_json_compiler{program}.compile(type);
+}
+
+// Convert a fixed-size struct which the caller has already bounds checked as a whole
+ABISNAX_NODISCARD inline bool fixed_object_to_json(bin_to_json_state& state, const abi_type* type) {
+    using op = bin_to_json_opcode;
+    state.writer.StartObject();
+    for (auto& field : type->fields) {
+        state.writer.Key(field.name.data(), field.name.length());
+        auto* t = field.type;
+        bool ok;
+        switch (get_leaf_opcode(t->ser)) {
+        case op::bool_: ok = unchecked_bin_to_json((bool*)nullptr, state); break;
+        case op::int8: ok = unchecked_bin_to_json((int8_t*)nullptr, state); break;
+        case op::uint8: ok = unchecked_bin_to_json((uint8_t*)nullptr, state); break;
+        case op::int16: ok = unchecked_bin_to_json((int16_t*)nullptr, state); break;
+        case op::uint16: ok = unchecked_bin_to_json((uint16_t*)nullptr, state); break;
+        case op::int32: ok = unchecked_bin_to_json((int32_t*)nullptr, state); break;
+        case op::uint32: ok = unchecked_bin_to_json((uint32_t*)nullptr, state); break;
+        case op::int64: ok = unchecked_bin_to_json((int64_t*)nullptr, state); break;
+        case op::uint64: ok = unchecked_bin_to_json((uint64_t*)nullptr, state); break;
+        case op::float32: ok = unchecked_bin_to_json((float*)nullptr, state); break;
+        case op::float64: ok = unchecked_bin_to_json((double*)nullptr, state); break;
+        case op::name: ok = unchecked_bin_to_json((::abisnax::name*)nullptr, state); break;
+        default:
+            ok = t->ser == &abi_serializer_for<pseudo_object> ? fixed_object_to_json(state, t)
+                                                             : t->ser->bin_to_json(state, false, t, true);
+        }
+        if (!ok)
+            return false;
+    }
+    state.writer.EndObject();
+    return true;
+}
+
+ABISNAX_NODISCARD inline bool bin_to_json(input_buffer& bin, std::string& error, const bin_to_json_program* program,
+                                         json_output_stream& stream) {
+    using op = bin_to_json_opcode;
+    rapidjson::Writer<json_output_stream> writer{stream};
+    bin_to_json_state state{bin, error, writer};
+
+    // Return addresses and remaining array items
+    std::vector<uint32_t> stack;
+    auto& ops = program->ops;
+    uint32_t pc = 0;
+    while (true) {
+        auto& o = ops[pc++];
+        switch (o.code) {
+        case op::done: return true;
+        case op::call:
+            if (stack.size() >= max_stack_size)
+                return set_error(state, "recursion limit reached");
+            stack.push_back(pc);
+            pc = o.target;
+            break;
+        case op::ret:
+            pc = stack.back();
+            stack.pop_back();
+            break;
+        case op::jump: pc = o.target; break;
+        case op::fail: return false;
+        case op::start_object: writer.StartObject(); break;
+        case op::fixed_object:
+            if (!check_remaining(bin, error, o.type->fixed_size) || !fixed_object_to_json(state, o.type))
+                return false;
+            break;
+        case op::end_object: writer.EndObject(); break;
+        case op::key: writer.Key(o.key.data(), o.key.length()); break;
+        case op::skip_extension:
+            if (bin.pos == bin.end)
+                pc = o.target;
+            break;
+        case op::optional: {
+            bool present;
+            if (!read_raw(bin, error, present))
+                return false;
+            if (!present) {
+                writer.Null();
+                pc = o.target;
+            }
+            break;
+        }
+        case op::start_array: {
+            uint32_t size;
+            if (!read_varuint32(bin, error, size))
+                return false;
+            if (!check_remaining(bin, error, uint64_t(size) * o.type->fixed_size))
+                return false;
+            writer.StartArray();
+            if (!size) {
+                pc = o.target;
+            } else {
+                if (stack.size() >= max_stack_size)
+                    return set_error(state, "recursion limit reached");
+                stack.push_back(size);
+            }
+            break;
+        }
+        case op::next_item:
+            if (--stack.back())
+                pc = o.target;
+            else
+                stack.pop_back();
+            break;
+        case op::end_array: writer.EndArray(); break;
+        case op::variant: {
+            uint32_t index;
+            if (!read_varuint32(bin, error, index))
+                return false;
+            if (index >= o.type->fields.size())
+                return set_error(state, "invalid variant type index");
+            writer.StartArray();
+            auto& f = o.type->fields[index];
+            writer.String(f.name.data(), f.name.length());
+            pc = program->targets[o.target + index];
+            break;
+        }
+        case op::leaf:
+            if (!o.type->ser->bin_to_json(state, false, o.type, true))
+                return false;
+            break;
+        case op::bool_:
+            if (!bin_to_json((bool*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::int8:
+            if (!bin_to_json((int8_t*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::uint8:
+            if (!bin_to_json((uint8_t*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::int16:
+            if (!bin_to_json((int16_t*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::uint16:
+            if (!bin_to_json((uint16_t*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::int32:
+            if (!bin_to_json((int32_t*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::uint32:
+            if (!bin_to_json((uint32_t*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::int64:
+            if (!bin_to_json((int64_t*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::uint64:
+            if (!bin_to_json((uint64_t*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::float32:
+            if (!bin_to_json((float*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::float64:
+            if (!bin_to_json((double*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::varuint32:
+            if (!bin_to_json((::abisnax::varuint32*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::name:
+            if (!bin_to_json((::abisnax::name*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        case op::string:
+            if (!bin_to_json((std::string*)nullptr, state, false, o.type, true))
+                return false;
+            break;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// validate
+///////////////////////////////////////////////////////////////////////////////
+
+// validate_bin checks a value the way bin_to_json would, without producing json. Fixed-size values are skipped with a
+// single bounds check; so are strings and bytes. Other variable-size leaves are decoded and discarded.
+
+// Decode and discard a leaf using its serializer
+ABISNAX_NODISCARD inline bool validate_leaf(input_buffer& bin, std::string& error, const abi_type* type) {
+    json_output_stream stream{nullptr, 0};
+    rapidjson::Writer<json_output_stream> writer{stream};
+    bin_to_json_state state{bin, error, writer};
+    return type->ser->bin_to_json(state, false, type, true);
+}
+
+// depth counts the stack entries bin_to_json would hold. Values of fixed-size types aren't walked, so they don't count
+// toward the recursion limit.
+ABISNAX_NODISCARD inline bool validate_bin(input_buffer& bin, std::string& error, const abi_type* type,
+                                          bool allow_extensions, size_t depth) {
+    if (type->fixed_size) {
+        if (!check_remaining(bin, error, type->fixed_size))
+            return false;
+        bin.pos += type->fixed_size;
+        return true;
+    }
+    auto* ser = type->ser;
+    if (!ser)
+        return false;
+    if (ser == &abi_serializer_for<pseudo_extension>)
+        return validate_bin(bin, error, type->extension_of, allow_extensions, depth);
+    if (ser == &abi_serializer_for<pseudo_optional>) {
+        bool present;
+        if (!read_raw(bin, error, present))
+            return false;
+        return !present || validate_bin(bin, error, type->optional_of, allow_extensions, depth);
+    }
+    if (ser == &abi_serializer_for<pseudo_array>) {
+        uint32_t size;
+        if (!read_varuint32(bin, error, size))
+            return false;
+        if (!size)
+            return true;
+        if (depth >= max_stack_size)
+            return set_error(error, "recursion limit reached");
+        if (auto item_size = type->array_of->fixed_size) {
+            if (!check_remaining(bin, error, uint64_t(size) * item_size))
+                return false;
+            bin.pos += uint64_t(size) * item_size;
+            return true;
+        }
+        for (uint32_t i = 0; i < size; ++i)
+            if (!validate_bin(bin, error, type->array_of, false, depth + 1))
+                return false;
+        return true;
+    }
+    if (ser == &abi_serializer_for<pseudo_object>) {
+        if (depth >= max_stack_size)
+            return set_error(error, "recursion limit reached");
+        for (auto& field : type->fields) {
+            if (bin.pos == bin.end && field.type->extension_of && allow_extensions)
+                continue;
+            if (!validate_bin(bin, error, field.type, allow_extensions && &field == &type->fields.back(), depth + 1))
+                return false;
+        }
+        return true;
+    }
+    if (ser == &abi_serializer_for<pseudo_variant>) {
+        if (depth >= max_stack_size)
+            return set_error(error, "recursion limit reached");
+        uint32_t index;
+        if (!read_varuint32(bin, error, index))
+            return false;
+        if (index >= type->fields.size())
+            return set_error(error, "invalid variant type index");
+        return validate_bin(bin, error, type->fields[index].type, allow_extensions, depth + 1);
+    }
+    if (ser == &abi_serializer_for<std::string> || ser == &abi_serializer_for<bytes>) {
+        uint32_t size;
+        if (!read_varuint32(bin, error, size))
+            return false;
+        if (size > bin.end - bin.pos)
+            return set_error(error, ser == &abi_serializer_for<bytes> ? "invalid bytes size" : "invalid string size");
+        bin.pos += size;
+        return true;
+    }
+    if (ser == &abi_serializer_for<varuint32>) {
+        uint32_t v;
+        return read_varuint32(bin, error, v);
+    }
+    return validate_leaf(bin, error, type);
+}
+
+// Check that bin starts with a well-formed value of type and advance past it. Data after the value isn't an error.
+ABISNAX_NODISCARD inline bool validate_bin(input_buffer& bin, std::string& error, const abi_type* type) {
+    return validate_bin(bin, error, type, true, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// projection
+///////////////////////////////////////////////////////////////////////////////
+
+// A projection selects parts of a value by path, e.g. "actions[].account". Paths are field names separated by ".", each
+// optionally followed by "[]" to select within every item of an array; a path may start with "[]" if the type itself
+// is an array. Optionals and binary extensions are transparent. bin_to_json with a projection writes only the selected
+// parts, keeping their structure, and skips the rest of the data the way validate_bin does.
+
+enum class projection_kind : uint8_t {
+    whole,    // convert the whole value
+    object,   // convert the selected fields
+    array,    // project each item
+    optional, // project the value if present
+};
+
+struct projection_node {
+    projection_kind kind = projection_kind::whole;
+    const abi_type* type = nullptr; // never an extension
+    uint32_t child = 0;             // array and optional
+    std::vector<uint32_t> fields{}; // object: the node for each field, or 0 if the field is skipped
+};
+
+struct projection {
+    std::vector<projection_node> nodes{}; // nodes[0] is the root
+};
+
+// Paths merged by segment. A path which ends at a segment selects it whole, along with anything below it.
+struct projection_path_tree {
+    bool whole = false;
+    std::map<std::string_view, projection_path_tree> children{};
+};
+
+struct projection_compiler {
+    projection& p;
+    std::string& error;
+
+    ABISNAX_NODISCARD bool node(uint32_t& result, const projection_path_tree& tree, const abi_type* type) {
+        if (type->extension_of)
+            type = type->extension_of;
+        result = p.nodes.size();
+        p.nodes.push_back({projection_kind::whole, type});
+        if (tree.whole)
+            return true;
+        uint32_t child;
+        if (type->optional_of) {
+            if (!node(child, tree, type->optional_of))
+                return false;
+            p.nodes[result].kind = projection_kind::optional;
+            p.nodes[result].child = child;
+            return true;
+        }
+        if (type->array_of) {
+            auto it = tree.children.find("[]");
+            if (it == tree.children.end())
+                return set_error(error, "can't select \"" + std::string{tree.children.begin()->first} +
+                                            "\" in type \"" + std::string{type->name} + "\"");
+            if (tree.children.size() > 1)
+                return set_error(error, "can't select \"" + std::string{std::next(it)->first} +
+                                            "\" in type \"" + std::string{type->name} + "\"");
+            if (!node(child, it->second, type->array_of))
+                return false;
+            p.nodes[result].kind = projection_kind::array;
+            p.nodes[result].child = child;
+            return true;
+        }
+        std::vector<uint32_t> fields(type->fields.size());
+        for (auto& [name, subtree] : tree.children) {
+            if (!type->filled_struct || name == "[]")
+                return set_error(error, "can't select \"" + std::string{name} + "\" in type \"" +
+                                            std::string{type->name} + "\"");
+            auto it = std::find_if(type->fields.begin(), type->fields.end(),
+                                   [&](auto& field) { return field.name == name; });
+            if (it == type->fields.end())
+                return set_error(error, "type \"" + std::string{type->name} + "\" has no field \"" +
+                                            std::string{name} + "\"");
+            if (!node(fields[it - type->fields.begin()], subtree, it->type))
+                return false;
+        }
+        p.nodes[result].kind = projection_kind::object;
+        p.nodes[result].fields = std::move(fields);
+        return true;
+    }
+
+    ABISNAX_NODISCARD bool compile(const abi_type* type, const std::vector<std::string_view>& paths) {
+        if (paths.empty())
+            return set_error(error, "projection has no paths");
+        projection_path_tree root;
+        for (auto path : paths) {
+            auto* tree = &root;
+            auto add = [&](std::string_view segment) { tree = &tree->children[segment]; };
+            for (size_t pos = 0;;) {
+                auto end = std::min(path.find('.', pos), path.size());
+                auto segment = path.substr(pos, end - pos);
+                bool items = ends_with(segment, "[]");
+                if (items)
+                    segment.remove_suffix(2);
+                if (segment.empty() && (pos || !items))
+                    return set_error(error, "invalid projection path \"" + std::string{path} + "\"");
+                if (!segment.empty())
+                    add(segment);
+                if (items)
+                    add("[]");
+                if (end == path.size())
+                    break;
+                pos = end + 1;
+            }
+            tree->whole = true;
+        }
+        p.nodes.clear();
+        uint32_t result;
+        return node(result, root, type);
+    }
+};
+
+ABISNAX_NODISCARD inline bool compile_projection(projection& p, std::string& error, const abi_type* type,
+                                                const std::vector<std::string_view>& paths) {
+    return projection_compiler{p, error}.compile(type, paths);
+}
+
+// depth counts the stack entries bin_to_json would hold
+ABISNAX_NODISCARD inline bool bin_to_json(bin_to_json_state& state, const projection& p, uint32_t index,
+                                         bool allow_extensions, size_t depth) {
+    auto& node = p.nodes[index];
+    switch (node.kind) {
+    case projection_kind::whole: return bin_to_json(state, node.type, allow_extensions, depth);
+    case projection_kind::optional: {
+        bool present;
+        if (!read_raw(state.bin, state.error, present))
+            return false;
+        if (!present)
+            return state.writer.Null();
+        return bin_to_json(state, p, node.child, allow_extensions, depth);
+    }
+    case projection_kind::array: {
+        uint32_t size;
+        if (!read_varuint32(state.bin, state.error, size))
+            return false;
+        if (size && depth >= max_stack_size)
+            return set_error(state, "recursion limit reached");
+        if (!check_remaining(state.bin, state.error, uint64_t(size) * node.type->array_of->fixed_size))
+            return false;
+        state.writer.StartArray();
+        for (uint32_t i = 0; i < size; ++i)
+            if (!bin_to_json(state, p, node.child, false, depth + 1))
+                return false;
+        return state.writer.EndArray();
+    }
+    case projection_kind::object: {
+        if (depth >= max_stack_size)
+            return set_error(state, "recursion limit reached");
+        if (!check_remaining(state.bin, state.error, node.type->fixed_size))
+            return false;
+        state.writer.StartObject();
+        auto& fields = node.type->fields;
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (state.bin.pos == state.bin.end && fields[i].type->extension_of && allow_extensions)
+                continue;
+            bool last = allow_extensions && i + 1 == fields.size();
+            if (!node.fields[i]) {
+                if (!validate_bin(state.bin, state.error, fields[i].type, last, depth + 1))
+                    return false;
+                continue;
+            }
+            state.writer.Key(fields[i].name.data(), fields[i].name.length());
+            if (!bin_to_json(state, p, node.fields[i], last, depth + 1))
+                return false;
+        }
+        return state.writer.EndObject();
+    }
+    }
+    return false;
+}
+
+ABISNAX_NODISCARD inline bool bin_to_json(input_buffer& bin, std::string& error, const projection* p,
+                                         json_output_stream& stream) {
+    rapidjson::Writer<json_output_stream> writer{stream};
+    bin_to_json_state state{bin, error, writer};
+    return bin_to_json(state, *p, 0, true, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// predicate
+///////////////////////////////////////////////////////////////////////////////
+
+// A predicate is a condition checked directly on a value's binary form, e.g.
+//
+//    to == "useraaaaaaab" && quantity.symbol == "4,SNAX"
+//
+// A comparison takes a field path (names separated by ".") on the left and a json literal on the right; && and ||
+// combine comparisons, and parentheses group them. Integer fields and asset.amount support ==, !=, <, <=, > and >=;
+// bool, name, symbol, symbol_code, asset and asset.symbol fields support == and !=. Comparisons on a field which is
+// absent, because it's in an optional or a binary extension, are false. Matching only reads the fields up to the last
+// one a predicate uses, skipping the others the way validate_bin does, and never allocates.
+
+enum class predicate_op : uint8_t { eq, ne, lt, le, gt, ge };
+
+enum class predicate_compare : uint8_t {
+    bytes,        // == and != only
+    boolean,      // == and != only
+    signed_int,   //
+    unsigned_int, //
+};
+
+struct predicate_comparison {
+    uint32_t slot = 0;
+    uint8_t offset = 0; // within the slot
+    uint8_t size = 0;
+    predicate_compare compare = predicate_compare::bytes;
+    predicate_op op = predicate_op::eq;
+    std::array<char, 16> value{}; // the literal's binary form
+};
+
+struct predicate_expr {
+    enum kind_type : uint8_t { comparison, and_, or_ } kind = comparison;
+    uint32_t left = 0; // comparison: index of the comparison
+    uint32_t right = 0;
+};
+
+// Walks a value to the fields a predicate uses
+struct predicate_node {
+    enum kind_type : uint8_t { object, optional, slot } kind = object;
+    const abi_type* type = nullptr; // never an extension
+    uint32_t child = 0;             // optional: node, or 0 until a path uses it; slot: index of the slot
+    std::vector<uint32_t> fields{}; // object: the node for each field, or 0 if the field is skipped
+    uint32_t num_fields = 0;        // object: fields before the end of the last used field
+};
+
+inline constexpr size_t max_predicate_slots = 32;
+
+// A field value read by a predicate
+struct predicate_slot {
+    bool present = false;
+    std::array<char, 16> value{};
+};
+
+struct predicate {
+    std::vector<predicate_node> nodes{}; // nodes[0] is the root
+    std::vector<predicate_comparison> comparisons{};
+    std::vector<predicate_expr> exprs{}; // exprs.back() is the root
+    uint32_t num_slots = 0;
+};
+
+struct predicate_compiler {
+    predicate& p;
+    std::string& error;
+    std::string_view text;
+    size_t pos = 0;
+
+    ABISNAX_NODISCARD bool fail(const std::string& what) {
+        return set_error(error, "invalid predicate \"" + std::string{text} + "\": " + what);
+    }
+
+    void skip_space() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r'))
+            ++pos;
+    }
+
+    bool consume(std::string_view token) {
+        skip_space();
+        if (text.substr(pos, token.size()) != token)
+            return false;
+        pos += token.size();
+        return true;
+    }
+
+    static bool is_path_char(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.';
+    }
+
+    ABISNAX_NODISCARD bool add_node(uint32_t& result, const abi_type* type, std::string_view path) {
+        if (type->extension_of)
+            type = type->extension_of;
+        predicate_node node{predicate_node::object, type};
+        if (type->optional_of) {
+            node.kind = predicate_node::optional;
+        } else if (type->filled_struct) {
+            node.fields.resize(type->fields.size());
+        } else if (type->fixed_size && type->fixed_size <= sizeof(predicate_slot::value)) {
+            if (p.num_slots >= max_predicate_slots)
+                return fail("too many fields");
+            node.kind = predicate_node::slot;
+            node.child = p.num_slots++;
+        } else {
+            return fail("can't compare \"" + std::string{path} + "\" of type \"" + std::string{type->name} + "\"");
+        }
+        result = p.nodes.size();
+        p.nodes.push_back(std::move(node));
+        return true;
+    }
+
+    // Move from an optional's node to the node of its value
+    ABISNAX_NODISCARD bool unwrap_optional(uint32_t& node, std::string_view field) {
+        if (!p.nodes[node].child) {
+            uint32_t child;
+            if (!add_node(child, p.nodes[node].type->optional_of, field))
+                return false;
+            p.nodes[node].child = child;
+        }
+        node = p.nodes[node].child;
+        return true;
+    }
+
+    // Find or add the slot which holds field's value, and how to compare it
+    ABISNAX_NODISCARD bool path(predicate_comparison& comparison, const abi_type*& type, std::string_view field) {
+        uint32_t node = 0;
+        std::string_view asset_field;
+        for (size_t begin = 0;;) {
+            auto end = std::min(field.find('.', begin), field.size());
+            auto name = field.substr(begin, end - begin);
+            if (name.empty())
+                return fail("invalid path \"" + std::string{field} + "\"");
+            if (p.nodes[node].kind == predicate_node::optional && !unwrap_optional(node, field))
+                return false;
+            auto* t = p.nodes[node].type;
+            if (p.nodes[node].kind == predicate_node::slot && t->ser == &abi_serializer_for<asset> &&
+                asset_field.empty() && end == field.size() && (name == "amount" || name == "symbol")) {
+                asset_field = name;
+                break;
+            }
+            if (p.nodes[node].kind != predicate_node::object)
+                return fail("can't select \"" + std::string{name} + "\" in type \"" + std::string{t->name} + "\"");
+            auto it = std::find_if(t->fields.begin(), t->fields.end(), [&](auto& field) { return field.name == name; });
+            if (it == t->fields.end())
+                return fail("type \"" + std::string{t->name} + "\" has no field \"" + std::string{name} + "\"");
+            auto index = it - t->fields.begin();
+            if (!p.nodes[node].fields[index]) {
+                uint32_t child;
+                if (!add_node(child, it->type, field.substr(0, end)))
+                    return false;
+                p.nodes[node].fields[index] = child;
+                p.nodes[node].num_fields = std::max<uint32_t>(p.nodes[node].num_fields, index + 1);
+            }
+            node = p.nodes[node].fields[index];
+            if (end == field.size())
+                break;
+            begin = end + 1;
+        }
+        if (p.nodes[node].kind == predicate_node::optional && !unwrap_optional(node, field))
+            return false;
+        if (p.nodes[node].kind != predicate_node::slot)
+            return fail("can't compare \"" + std::string{field} + "\" of type \"" +
+                        std::string{p.nodes[node].type->name} + "\"");
+        type = p.nodes[node].type;
+        comparison.slot = p.nodes[node].child;
+        if (!asset_field.empty()) {
+            type = &builtin_abi_types().at(asset_field == "amount" ? "int64" : "symbol");
+            comparison.offset = asset_field == "amount" ? 0 : 8;
+        }
+        comparison.size = type->fixed_size;
+        auto* ser = type->ser;
+        if (ser == &abi_serializer_for<bool>)
+            comparison.compare = predicate_compare::boolean;
+        else if (ser == &abi_serializer_for<int8_t> || ser == &abi_serializer_for<int16_t> ||
+                 ser == &abi_serializer_for<int32_t> || ser == &abi_serializer_for<int64_t>)
+            comparison.compare = predicate_compare::signed_int;
+        else if (ser == &abi_serializer_for<uint8_t> || ser == &abi_serializer_for<uint16_t> ||
+                 ser == &abi_serializer_for<uint32_t> || ser == &abi_serializer_for<uint64_t>)
+            comparison.compare = predicate_compare::unsigned_int;
+        else if (ser == &abi_serializer_for<name> || ser == &abi_serializer_for<symbol> ||
+                 ser == &abi_serializer_for<symbol_code> || ser == &abi_serializer_for<asset>)
+            comparison.compare = predicate_compare::bytes;
+        else
+            return fail("can't compare \"" + std::string{field} + "\" of type \"" + std::string{type->name} + "\"");
+        return true;
+    }
+
+    ABISNAX_NODISCARD bool comparison(uint32_t& result) {
+        skip_space();
+        auto begin = pos;
+        while (pos < text.size() && is_path_char(text[pos]))
+            ++pos;
+        if (pos == begin)
+            return fail("expected field at offset " + std::to_string(begin));
+        auto field = text.substr(begin, pos - begin);
+
+        predicate_comparison c;
+        if (consume("=="))
+            c.op = predicate_op::eq;
+        else if (consume("!="))
+            c.op = predicate_op::ne;
+        else if (consume("<="))
+            c.op = predicate_op::le;
+        else if (consume(">="))
+            c.op = predicate_op::ge;
+        else if (consume("<"))
+            c.op = predicate_op::lt;
+        else if (consume(">"))
+            c.op = predicate_op::gt;
+        else
+            return fail("expected comparison at offset " + std::to_string(pos));
+
+        skip_space();
+        begin = pos;
+        if (pos < text.size() && text[pos] == '"') {
+            for (++pos; pos < text.size() && text[pos] != '"'; ++pos)
+                if (text[pos] == '\\')
+                    ++pos;
+            if (pos >= text.size())
+                return fail("unterminated string at offset " + std::to_string(begin));
+            ++pos;
+        } else {
+            while (pos < text.size() && (is_path_char(text[pos]) || text[pos] == '-' || text[pos] == '+'))
+                ++pos;
+        }
+        if (pos == begin)
+            return fail("expected value at offset " + std::to_string(begin));
+        auto literal = text.substr(begin, pos - begin);
+
+        const abi_type* type;
+        if (!path(c, type, field))
+            return false;
+        if (c.op != predicate_op::eq && c.op != predicate_op::ne &&
+            (c.compare == predicate_compare::bytes || c.compare == predicate_compare::boolean))
+            return fail("\"" + std::string{field} + "\" only supports == and !=");
+        std::vector<char> bin;
+        std::string literal_error;
+        if (!json_to_bin(bin, literal_error, type, literal) || bin.size() != c.size)
+            return fail("invalid value " + std::string{literal} + " for \"" + std::string{field} + "\"" +
+                        (literal_error.empty() ? "" : ": " + literal_error));
+        std::copy(bin.begin(), bin.end(), c.value.begin());
+        p.comparisons.push_back(c);
+        result = p.exprs.size();
+        p.exprs.push_back({predicate_expr::comparison, uint32_t(p.comparisons.size() - 1)});
+        return true;
+    }
+
+    ABISNAX_NODISCARD bool primary(uint32_t& result) {
+        if (!consume("("))
+            return comparison(result);
+        if (!or_expr(result))
+            return false;
+        if (!consume(")"))
+            return fail("expected ) at offset " + std::to_string(pos));
+        return true;
+    }
+
+    ABISNAX_NODISCARD bool and_expr(uint32_t& result) {
+        if (!primary(result))
+            return false;
+        while (consume("&&")) {
+            uint32_t right;
+            if (!primary(right))
+                return false;
+            p.exprs.push_back({predicate_expr::and_, result, right});
+            result = p.exprs.size() - 1;
+        }
+        return true;
+    }
+
+    ABISNAX_NODISCARD bool or_expr(uint32_t& result) {
+        if (!and_expr(result))
+            return false;
+        while (consume("||")) {
+            uint32_t right;
+            if (!and_expr(right))
+                return false;
+            p.exprs.push_back({predicate_expr::or_, result, right});
+            result = p.exprs.size() - 1;
+        }
+        return true;
+    }
+
+    ABISNAX_NODISCARD bool compile(const abi_type* type) {
+        p = {};
+        if (type->extension_of)
+            type = type->extension_of;
+        if (!type->filled_struct && !(type->optional_of && type->optional_of->filled_struct))
+            return set_error(error, "predicates need a struct type, not \"" + std::string{type->name} + "\"");
+        uint32_t root;
+        if (!add_node(root, type, {}) || !or_expr(root))
+            return false;
+        skip_space();
+        if (pos != text.size())
+            return fail("unexpected text at offset " + std::to_string(pos));
+        return true;
+    }
+};
+
+ABISNAX_NODISCARD inline bool compile_predicate(predicate& p, std::string& error, const abi_type* type,
+                                               std::string_view text) {
+    return predicate_compiler{p, error, text}.compile(type);
+}
+
+// whole is set if anything after the value is used, so the value must be skipped entirely
+ABISNAX_NODISCARD inline bool read_predicate_slots(input_buffer& bin, std::string& error, const predicate& p,
+                                                  uint32_t index, bool allow_extensions, bool whole, size_t depth,
+                                                  predicate_slot* slots) {
+    auto& node = p.nodes[index];
+    switch (node.kind) {
+    case predicate_node::slot: {
+        auto size = node.type->fixed_size;
+        if (!check_remaining(bin, error, size))
+            return false;
+        slots[node.child].present = true;
+        memcpy(slots[node.child].value.data(), bin.pos, size);
+        bin.pos += size;
+        return true;
+    }
+    case predicate_node::optional: {
+        bool present;
+        if (!read_raw(bin, error, present))
+            return false;
+        return !present || read_predicate_slots(bin, error, p, node.child, allow_extensions, whole, depth, slots);
+    }
+    case predicate_node::object: {
+        if (depth >= max_stack_size)
+            return set_error(error, "recursion limit reached");
+        auto& fields = node.type->fields;
+        auto num_fields = whole ? fields.size() : node.num_fields;
+        for (size_t i = 0; i < num_fields; ++i) {
+            if (bin.pos == bin.end && fields[i].type->extension_of && allow_extensions)
+                continue;
+            bool last = allow_extensions && i + 1 == fields.size();
+            if (node.fields[i] ? !read_predicate_slots(bin, error, p, node.fields[i], last,
+                                                       whole || i + 1 < node.num_fields, depth + 1, slots)
+                               : !validate_bin(bin, error, fields[i].type, last, depth + 1))
+                return false;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+template <typename T>
+bool compare_values(predicate_op op, T a, T b) {
+    switch (op) {
+    case predicate_op::eq: return a == b;
+    case predicate_op::ne: return a != b;
+    case predicate_op::lt: return a < b;
+    case predicate_op::le: return a <= b;
+    case predicate_op::gt: return a > b;
+    case predicate_op::ge: return a >= b;
+    }
+    return false;
+}
+
+inline bool eval_predicate(const predicate& p, uint32_t index, const predicate_slot* slots) {
+    auto& expr = p.exprs[index];
+    switch (expr.kind) {
+    case predicate_expr::and_:
+        return eval_predicate(p, expr.left, slots) && eval_predicate(p, expr.right, slots);
+    case predicate_expr::or_:
+        return eval_predicate(p, expr.left, slots) || eval_predicate(p, expr.right, slots);
+    case predicate_expr::comparison: break;
+    }
+    auto& c = p.comparisons[expr.left];
+    auto& slot = slots[c.slot];
+    if (!slot.present)
+        return false;
+    auto* value = slot.value.data() + c.offset;
+    switch (c.compare) {
+    case predicate_compare::bytes: return (memcmp(value, c.value.data(), c.size) == 0) == (c.op == predicate_op::eq);
+    case predicate_compare::boolean: return compare_values<bool>(c.op, *value, c.value[0]);
+    case predicate_compare::signed_int:
+    case predicate_compare::unsigned_int: {
+        uint64_t a = 0, b = 0;
+        memcpy(&a, value, c.size);
+        memcpy(&b, c.value.data(), c.size);
+        if (c.compare == predicate_compare::unsigned_int)
+            return compare_values(c.op, a, b);
+        auto shift = 64 - 8 * c.size;
+        return compare_values(c.op, int64_t(a << shift) >> shift, int64_t(b << shift) >> shift);
+    }
+    }
+    return false;
+}
+
+// Check whether bin's value matches the predicate. bin's position afterward is unspecified.
+ABISNAX_NODISCARD inline bool match_predicate(bool& result, input_buffer& bin, std::string& error, const predicate& p) {
+    std::array<predicate_slot, max_predicate_slots> slots;
+    if (!read_predicate_slots(bin, error, p, 0, true, false, 0, slots.data()))
+        return false;
+    result = eval_predicate(p, p.exprs.size() - 1, slots.data());
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// bin_index
+///////////////////////////////////////////////////////////////////////////////
+
+// A bin_index records where the parts of a value begin, so they can be read without decoding the rest of it. Indexing
+// walks the value once, the way validate_bin does. Parts are reached by child number: a struct's field, an array's
+// item, an optional's value (0) or a variant's alternative (0). Parts of fixed-size values, including the items of
+// arrays of them, get no entries; their offsets are computed from fixed_size instead. Neither do the items of arrays of
+// empty structs, which take no bytes.
+
+// An indexed value. Its children's entries are consecutive, starting at first_child.
+struct bin_index_entry {
+    uint32_t offset = 0; // from the start of the data
+    uint32_t size = 0;
+    uint32_t first_child = 0;
+    uint32_t num_children = 0; // fields present, array items, 0 or 1 for optionals, 1 for variants
+    uint32_t variant_index = 0;
+};
+
+struct bin_index {
+    const abi_type* type = nullptr;
+    std::vector<char> data;
+    std::vector<bin_index_entry> entries; // entries[0] is the value itself
+};
+
+// A part of an indexed value. entry is null for parts of fixed-size values and for empty items.
+struct bin_index_value {
+    const abi_type* type = nullptr;
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    const bin_index_entry* entry = nullptr;
+};
+
+inline const abi_type* remove_extension(const abi_type* type) {
+    while (type->extension_of)
+        type = type->extension_of;
+    return type;
+}
+
+// Whether values of type always take no bytes, which only empty structs (or structs of them) do
+inline bool may_be_empty(const abi_type* type, size_t depth = 0) {
+    if (type->ser != &abi_serializer_for<pseudo_object> || type->fixed_size || depth >= max_stack_size)
+        return false;
+    for (auto& field : type->fields)
+        if (!may_be_empty(field.type, depth + 1))
+            return false;
+    return true;
+}
+
+// Fill index.entries[entry] with the value at bin. depth counts the stack entries bin_to_json would hold.
+ABISNAX_NODISCARD inline bool index_bin(bin_index& index, input_buffer& bin, std::string& error, const abi_type* type,
+                                       bool allow_extensions, size_t depth, uint32_t entry) {
+    type = remove_extension(type);
+    auto* begin = bin.pos;
+    index.entries[entry].offset = begin - index.data.data();
+    auto finish = [&] {
+        index.entries[entry].size = bin.pos - begin;
+        return true;
+    };
+    auto add_child = [&] {
+        index.entries[entry].first_child = index.entries.size();
+        index.entries[entry].num_children = 1;
+        index.entries.emplace_back();
+        return index.entries[entry].first_child;
+    };
+    if (type->fixed_size || !type->ser)
+        return validate_bin(bin, error, type, allow_extensions, depth) && finish();
+    auto* ser = type->ser;
+    if (ser == &abi_serializer_for<pseudo_optional>) {
+        bool present;
+        if (!read_raw(bin, error, present))
+            return false;
+        return (!present || index_bin(index, bin, error, type->optional_of, allow_extensions, depth, add_child())) &&
+               finish();
+    }
+    if (ser == &abi_serializer_for<pseudo_array>) {
+        uint32_t size;
+        if (!read_varuint32(bin, error, size))
+            return false;
+        if (!size)
+            return finish();
+        if (depth >= max_stack_size)
+            return set_error(error, "recursion limit reached");
+        index.entries[entry].num_children = size;
+        if (auto item_size = type->array_of->fixed_size) {
+            if (!check_remaining(bin, error, uint64_t(size) * item_size))
+                return false;
+            bin.pos += uint64_t(size) * item_size;
+            return finish();
+        }
+        if (may_be_empty(type->array_of))
+            return finish();
+        if (size > bin.end - bin.pos)
+            return set_error(error, "read past end");
+        uint32_t first = index.entries.size();
+        index.entries[entry].first_child = first;
+        index.entries.resize(first + uint64_t(size));
+        for (uint32_t i = 0; i < size; ++i)
+            if (!index_bin(index, bin, error, type->array_of, false, depth + 1, first + i))
+                return false;
+        return finish();
+    }
+    if (ser == &abi_serializer_for<pseudo_object>) {
+        if (depth >= max_stack_size)
+            return set_error(error, "recursion limit reached");
+        uint32_t first = index.entries.size();
+        index.entries[entry].first_child = first;
+        index.entries.resize(first + type->fields.size());
+        uint32_t i = 0;
+        for (auto& field : type->fields) {
+            if (bin.pos == bin.end && field.type->extension_of && allow_extensions)
+                break;
+            if (!index_bin(index, bin, error, field.type, allow_extensions && &field == &type->fields.back(),
+                           depth + 1, first + i))
+                return false;
+            index.entries[entry].num_children = ++i;
+        }
+        return finish();
+    }
+    if (ser == &abi_serializer_for<pseudo_variant>) {
+        if (depth >= max_stack_size)
+            return set_error(error, "recursion limit reached");
+        uint32_t variant_index;
+        if (!read_varuint32(bin, error, variant_index))
+            return false;
+        if (variant_index >= type->fields.size())
+            return set_error(error, "invalid variant type index");
+        index.entries[entry].variant_index = variant_index;
+        return index_bin(index, bin, error, type->fields[variant_index].type, allow_extensions, depth + 1,
+                         add_child()) &&
+               finish();
+    }
+    return validate_bin(bin, error, type, allow_extensions, depth) && finish();
+}
+
+// Index the value at the start of [data, data + size); entries[0].size is its size. Data after the value isn't an
+// error here; abisnax_index_bin, which requires the value to fill the data, checks entries[0].size. The index holds a
+// copy of the data.
+ABISNAX_NODISCARD inline bool index_bin(bin_index& index, std::string& error, const abi_type* type, const char* data,
+                                       size_t size) {
+    index.type = nullptr;
+    index.data.clear();
+    index.entries.clear();
+    if (size != uint32_t(size))
+        return set_error(error, "binary is too large to index");
+    index.data.assign(data, data + size);
+    index.entries.emplace_back();
+    input_buffer bin{index.data.data(), index.data.data() + index.data.size()};
+    if (!index_bin(index, bin, error, type, true, 0, 0)) {
+        index.entries.clear();
+        return false;
+    }
+    index.type = remove_extension(type);
+    return true;
+}
+
+inline bin_index_value get_root(const bin_index& index) {
+    auto& entry = index.entries[0];
+    return {index.type, entry.offset, entry.size, &entry};
+}
+
+inline uint32_t num_children(const bin_index_value& value) {
+    if (value.type->fixed_size || !value.entry)
+        return value.type->ser == &abi_serializer_for<pseudo_object> ? value.type->fields.size() : 0;
+    return value.entry->num_children;
+}
+
+// Replace value with its child-th child. Takes constant time, except within fixed-size structs, where it adds up the
+// sizes of the fields before the child.
+ABISNAX_NODISCARD inline bool get_child(bin_index_value& value, std::string& error, const bin_index& index,
+                                       uint32_t child) {
+    auto* type = value.type;
+    if (child >= num_children(value)) {
+        if (type->ser == &abi_serializer_for<pseudo_object> && child < type->fields.size())
+            return set_error(error, "field \"" + std::string{type->fields[child].name} + "\" is absent");
+        if (type->ser == &abi_serializer_for<pseudo_optional> && !child)
+            return set_error(error, "optional is empty");
+        return set_error(error, std::string{type->name} + " has no child " + std::to_string(child));
+    }
+    if (type->fixed_size || !value.entry) {
+        uint32_t offset = value.offset;
+        for (uint32_t i = 0; i < child; ++i)
+            offset += type->fields[i].type->fixed_size;
+        auto* t = type->fields[child].type;
+        value = {t, offset, t->fixed_size, nullptr};
+        return true;
+    }
+    auto& entry = *value.entry;
+    if (type->ser == &abi_serializer_for<pseudo_array> &&
+        (type->array_of->fixed_size || may_be_empty(type->array_of))) {
+        auto* t = type->array_of;
+        value = {t, entry.offset + entry.size - (entry.num_children - child) * t->fixed_size, t->fixed_size, nullptr};
+        return true;
+    }
+    auto& child_entry = index.entries[entry.first_child + child];
+    const abi_type* t;
+    if (type->ser == &abi_serializer_for<pseudo_object>)
+        t = type->fields[child].type;
+    else if (type->ser == &abi_serializer_for<pseudo_array>)
+        t = type->array_of;
+    else if (type->ser == &abi_serializer_for<pseudo_optional>)
+        t = type->optional_of;
+    else
+        t = type->fields[entry.variant_index].type;
+    value = {remove_extension(t), child_entry.offset, child_entry.size, &child_entry};
+    return true;
+}
+
+// Find the part of the value at path, a list of child numbers, e.g. {17, 3} for field 3 of item 17
+ABISNAX_NODISCARD inline bool get_child(bin_index_value& value, std::string& error, const bin_index& index,
+                                       const uint32_t* path, size_t depth) {
+    if (index.entries.empty())
+        return set_error(error, "index is empty");
+    value = get_root(index);
+    for (size_t i = 0; i < depth; ++i)
+        if (!get_child(value, error, index, path[i]))
+            return false;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// abi_view
+///////////////////////////////////////////////////////////////////////////////
+
+// abi_view reads the parts of a value straight from its binary, without json or copies; views point into the binary,
+// which must outlive them. The value is checked once, when the root view is made; lookups skip the data before the
+// part they find the way validate_bin does and cache nothing, so a bin_index suits visiting many parts of a large value
+// better. A failed lookup returns an invalid view
+// holding the error, and lookups on an invalid view pass the error on, so a chain such as
+//    view["actions"][0]["authorization"][0]["actor"].as<name>()
+// only needs checking at the end.
+struct abi_view_iterator;
+
+struct abi_view {
+    const abi_type* type = nullptr; // null if the view is invalid
+    input_buffer bin{};             // starts at the value and ends with the root's value
+    bool allow_extensions = true;
+    std::string error{};
+
+    abi_view() = default;
+
+    // View the value at the start of bin. The whole value is checked. Data after it isn't an error.
+    abi_view(const abi_type* type, input_buffer bin) { *this = make(type, bin, true); }
+
+    explicit operator bool() const { return type; }
+
+    // Field of a struct
+    abi_view operator[](std::string_view field_name) const {
+        if (!type)
+            return *this;
+        if (type->ser != &abi_serializer_for<pseudo_object>)
+            return failed("can't select \"" + std::string{field_name} + "\" in type \"" + std::string{type->name} +
+                          "\"");
+        auto b = bin;
+        for (auto& field : type->fields) {
+            bool field_allow_extensions = allow_extensions && &field == &type->fields.back();
+            if (b.pos == b.end && field.type->extension_of && allow_extensions) {
+                if (field.name == field_name)
+                    return failed("field \"" + std::string{field_name} + "\" is absent");
+                continue;
+            }
+            if (field.name == field_name)
+                return part(field.type, b, field_allow_extensions);
+            std::string e;
+            if (!validate_bin(b, e, field.type, field_allow_extensions, 0))
+                return failed(std::move(e));
+        }
+        return failed("type \"" + std::string{type->name} + "\" has no field \"" + std::string{field_name} + "\"");
+    }
+
+    // Item of an array. Takes constant time if the items have a fixed size.
+    abi_view operator[](uint32_t i) const {
+        if (!type)
+            return *this;
+        if (type->ser != &abi_serializer_for<pseudo_array>)
+            return failed("type \"" + std::string{type->name} + "\" isn't an array");
+        auto b = bin;
+        std::string e;
+        uint32_t n;
+        if (!read_varuint32(b, e, n))
+            return failed(std::move(e));
+        if (i >= n)
+            return failed("type \"" + std::string{type->name} + "\" has no item " + std::to_string(i));
+        if (auto item_size = type->array_of->fixed_size)
+            b.pos += uint64_t(i) * item_size;
+        else
+            for (uint32_t j = 0; j < i; ++j)
+                if (!validate_bin(b, e, type->array_of, false, 0))
+                    return failed(std::move(e));
+        return part(type->array_of, b, false);
+    }
+
+    // Number of items in an array; 0 for other types
+    uint32_t size() const {
+        uint32_t n = 0;
+        auto b = bin;
+        std::string e;
+        if (!type || type->ser != &abi_serializer_for<pseudo_array> || !read_varuint32(b, e, n))
+            return 0;
+        return n;
+    }
+
+    // Whether an optional holds a value
+    bool has_value() const { return type && type->ser == &abi_serializer_for<pseudo_optional> && *bin.pos; }
+
+    // Index of a variant's alternative
+    uint32_t variant_index() const {
+        uint32_t index = 0;
+        auto b = bin;
+        std::string e;
+        if (type && type->ser == &abi_serializer_for<pseudo_variant>)
+            (void)read_varuint32(b, e, index);
+        return index;
+    }
+
+    // Value of an optional, or a variant's alternative
+    abi_view value() const {
+        if (!type)
+            return *this;
+        auto b = bin;
+        if (type->ser == &abi_serializer_for<pseudo_optional>) {
+            if (!*b.pos++)
+                return failed("optional is empty");
+            return part(type->optional_of, b, allow_extensions);
+        }
+        if (type->ser == &abi_serializer_for<pseudo_variant>) {
+            uint32_t index;
+            std::string e;
+            if (!read_varuint32(b, e, index))
+                return failed(std::move(e));
+            return part(type->fields[index].type, b, allow_extensions);
+        }
+        return failed("type \"" + std::string{type->name} + "\" has no value");
+    }
+
+    // Read a built-in fixed-size type, e.g. name, asset or uint64. T must match the view's type.
+    template <typename T>
+    ABISNAX_NODISCARD bool as(T& result, std::string& error) const {
+        static_assert(builtin_fixed_size<T>(), "T must be a built-in fixed-size type");
+        if (!type)
+            return set_error(error, this->error);
+        if (type->ser != &abi_serializer_for<T>)
+            return set_error(error, "type \"" + std::string{type->name} + "\" doesn't match");
+        auto b = bin;
+        return read_raw(b, error, result);
+    }
+
+    // Like as(result, error), but empty on error
+    template <typename T>
+    std::optional<T> as() const {
+        T result;
+        std::string e;
+        if (!as(result, e))
+            return {};
+        return result;
+    }
+
+    // Content of a string or bytes. Empty on error.
+    std::optional<std::string_view> as_string_view() const {
+        if (!type || (type->ser != &abi_serializer_for<std::string> && type->ser != &abi_serializer_for<bytes>))
+            return {};
+        auto b = bin;
+        uint32_t n;
+        std::string e;
+        if (!read_varuint32(b, e, n))
+            return {};
+        return std::string_view{b.pos, n};
+    }
+
+    // Iterate over the items of an array; empty for other types
+    abi_view_iterator begin() const;
+    abi_view_iterator end() const;
+
+  private:
+    friend abi_view_iterator;
+
+    // View the value of type at the start of b
+    static abi_view make(const abi_type* type, input_buffer b, bool allow_extensions) {
+        abi_view result;
+        type = remove_extension(type);
+        auto* begin = b.pos;
+        if (!validate_bin(b, result.error, type, allow_extensions, 0)) {
+            if (result.error.empty())
+                result.error = "binary decode error";
+            return result;
+        }
+        result.type = type;
+        result.bin = {begin, b.pos};
+        result.allow_extensions = allow_extensions;
+        return result;
+    }
+
+    // View a part of this value starting at b. The root view already checked it.
+    abi_view part(const abi_type* type, input_buffer b, bool allow_extensions) const {
+        abi_view result;
+        result.type = remove_extension(type);
+        result.bin = {b.pos, bin.end};
+        result.allow_extensions = allow_extensions;
+        return result;
+    }
+
+    abi_view failed(std::string e) const {
+        abi_view result;
+        result.error = std::move(e);
+        return result;
+    }
+};
+
+struct abi_view_iterator {
+    const abi_type* item_type = nullptr;
+    input_buffer bin{}; // the remaining items
+    uint32_t remaining = 0;
+    abi_view item{};
+
+    abi_view& operator*() { return item; }
+    abi_view* operator->() { return &item; }
+    bool operator==(const abi_view_iterator& rhs) const { return remaining == rhs.remaining; }
+    bool operator!=(const abi_view_iterator& rhs) const { return remaining != rhs.remaining; }
+
+    abi_view_iterator& operator++() {
+        std::string e;
+        (void)validate_bin(bin, e, item_type, false, 0);
+        if (--remaining)
+            item = item.part(item_type, bin, false);
+        return *this;
+    }
+};
+
+inline abi_view_iterator abi_view::begin() const {
+    uint32_t n = size();
+    if (!n)
+        return {};
+    auto b = bin;
+    std::string e;
+    (void)read_varuint32(b, e, n);
+    return {type->array_of, b, n, part(type->array_of, b, false)};
+}
+
+inline abi_view_iterator abi_view::end() const { return {}; }
+
+///////////////////////////////////////////////////////////////////////////////
+// json_to_bin (compiled)
+///////////////////////////////////////////////////////////////////////////////
+
+// json_to_bin_program holds a node per type, which json_to_bin dispatches on with a switch instead of the virtual
+// serializers. Common primitives call their json_to_bin overloads directly, and variant alternatives are found with a
+// collision-free hash table built when the program is compiled. Stack entries and errors match the serializers above.
+
+enum class json_to_bin_kind : uint8_t {
+    fail, // type has no serializer
+    object,
+    array,
+    optional,
+    variant,
+    leaf, // type->ser->json_to_bin
+    bool_,
+    int8,
+    uint8,
+    int16,
+    uint16,
+    int32,
+    uint32,
+    int64,
+    uint64,
+    float32,
+    float64,
+    varuint32,
+    name,
+    string,
+};
+
+struct json_to_bin_node {
+    json_to_bin_kind kind = json_to_bin_kind::fail;
+    const abi_type* type = nullptr;
+    uint32_t child = 0;       // array and optional
+    uint32_t first_field = 0; // object and variant
+    uint32_t num_fields = 0;  // object and variant
+    uint32_t table = 0;       // variant: index into variant_tables
+};
+
+struct json_to_bin_field {
+    std::string_view name = {};
+    uint32_t node = 0;
+    bool extension = false;
+};
+
+// Maps a variant's alternative names to their indexes without collisions: hash_name(name, seed) & mask selects the only
+// slot name can be in
+struct json_to_bin_variant_table {
+    uint32_t seed = 0;
+    uint32_t mask = 0;
+    std::vector<uint32_t> slots{}; // alternative index + 1, or 0 if empty
+};
+
+struct json_to_bin_program {
+    std::vector<json_to_bin_node> nodes{}; // nodes[0] is the root
+    std::vector<json_to_bin_field> fields{};
+    std::vector<json_to_bin_variant_table> variant_tables{};
+
+    // Generated handlers for the nodes (see generated_codec), used instead of interpreting them when set
+    bool (*generated)(json_to_bin_state& state, uint32_t node, bool allow_extensions, event_type event,
+                      bool start) = nullptr;
+};
+
+// FNV-1a, with seed mixed into the offset basis
+inline uint32_t hash_name(std::string_view name, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (auto c : name)
+        hash = (hash ^ uint8_t(c)) * 16777619u;
+    return hash;
+}
+
+inline json_to_bin_kind get_json_to_bin_kind(const abi_type* type) {
+    using kind = json_to_bin_kind;
+    auto* ser = type->ser;
+    if (!ser)
+        return kind::fail;
+    if (ser == &abi_serializer_for<pseudo_object>)
+        return kind::object;
+    if (ser == &abi_serializer_for<pseudo_array>)
+        return kind::array;
+    if (ser == &abi_serializer_for<pseudo_optional>)
+        return kind::optional;
+    if (ser == &abi_serializer_for<pseudo_variant>)
+        return kind::variant;
+    switch (get_leaf_opcode(ser)) {
+    case bin_to_json_opcode::bool_: return kind::bool_;
+    case bin_to_json_opcode::int8: return kind::int8;
+    case bin_to_json_opcode::uint8: return kind::uint8;
+    case bin_to_json_opcode::int16: return kind::int16;
+    case bin_to_json_opcode::uint16: return kind::uint16;
+    case bin_to_json_opcode::int32: return kind::int32;
+    case bin_to_json_opcode::uint32: return kind::uint32;
+    case bin_to_json_opcode::int64: return kind::int64;
+    case bin_to_json_opcode::uint64: return kind::uint64;
+    case bin_to_json_opcode::float32: return kind::float32;
+    case bin_to_json_opcode::float64: return kind::float64;
+    case bin_to_json_opcode::varuint32: return kind::varuint32;
+    case bin_to_json_opcode::name: return kind::name;
+    case bin_to_json_opcode::string: return kind::string;
+    default: return kind::leaf;
+    }
+}
+
+struct json_to_bin_compiler {
+    json_to_bin_program& program;
+    std::map<const abi_type*, uint32_t> nodes{};
+    std::vector<uint32_t> pending{};
+
+    uint32_t node(const abi_type* type) {
+        // T$ converts the same way as T; objects check field.extension instead
+        if (type->extension_of)
+            return node(type->extension_of);
+        auto [it, inserted] = nodes.try_emplace(type, program.nodes.size());
+        if (inserted) {
+            program.nodes.push_back({get_json_to_bin_kind(type), type});
+            pending.push_back(it->second);
+        }
+        return it->second;
+    }
+
+    void fields(uint32_t index) {
+        auto* type = program.nodes[index].type;
+        uint32_t first = program.fields.size();
+        for (auto& field : type->fields)
+            program.fields.push_back({field.name, 0, field.type->extension_of != nullptr});
+        for (size_t i = 0; i < type->fields.size(); ++i)
+            program.fields[first + i].node = node(type->fields[i].type);
+        program.nodes[index].first_field = first;
+        program.nodes[index].num_fields = type->fields.size();
+    }
+
+    // Find a seed and a power-of-two table size, up to 4 times the smallest that fits, which give every alternative
+    // its own slot. A repeated name keeps its first index, like the serializers' search.
+    void variant_table(uint32_t index) {
+        auto& node = program.nodes[index];
+        auto* fields = program.fields.data() + node.first_field;
+        json_to_bin_variant_table table;
+        auto fill = [&](uint32_t size, uint32_t seed) {
+            table.seed = seed;
+            table.mask = size - 1;
+            table.slots.assign(size, 0);
+            for (uint32_t i = 0; i < node.num_fields; ++i) {
+                auto& slot = table.slots[hash_name(fields[i].name, seed) & table.mask];
+                if (slot && fields[slot - 1].name != fields[i].name)
+                    return false;
+                if (!slot)
+                    slot = i + 1;
+            }
+            return true;
+        };
+        uint32_t size = 1;
+        while (size < node.num_fields)
+            size *= 2;
+        bool found = false;
+        for (uint32_t s = size; !found && s <= size * 4; s *= 2)
+            for (uint32_t seed = 0; !found && seed < 1024; ++seed)
+                found = fill(s, seed);
+        // Distinct names which share every hash tried are practically impossible; search them, like the serializers
+        if (!found)
+            table.slots.clear();
+        node.table = program.variant_tables.size();
+        program.variant_tables.push_back(std::move(table));
+    }
+
+    void compile(const abi_type* type) {
+        program.nodes.clear();
+        program.fields.clear();
+        program.variant_tables.clear();
+        node(type);
+        for (size_t i = 0; i < pending.size(); ++i) {
+            auto index = pending[i];
+            auto* t = program.nodes[index].type;
+            switch (program.nodes[index].kind) {
+            case json_to_bin_kind::object: fields(index); break;
+            case json_to_bin_kind::variant:
+                fields(index);
+                variant_table(index);
+                break;
+            case json_to_bin_kind::array: {
+                auto child = node(t->array_of);
+                program.nodes[index].child = child;
+                break;
+            }
+            case json_to_bin_kind::optional: {
+                auto child = node(t->optional_of);
+                program.nodes[index].child = child;
+                break;
+            }
+            default: break;
+            }
+        }
+    }
+};
+
+inline void compile_json_to_bin(json_to_bin_program& program, const abi_type* type) {
+    json_to_bin_compiler{program}.compile(type);
+}
+
+ABISNAX_NODISCARD inline bool json_to_bin(json_to_bin_state& state, const json_to_bin_program* program,
+                                         std::string_view json) {
+    state.program = program;
+    return json_to_bin(state, program->nodes[0].type, json);
+}
+
+ABISNAX_NODISCARD inline bool json_to_bin_insitu(json_to_bin_state& state, const json_to_bin_program* program,
+                                                char* json, size_t size) {
+    state.program = program;
+    return json_to_bin_insitu(state, program->nodes[0].type, json, size);
+}
+
+inline json_to_bin_chunked::json_to_bin_chunked(const json_to_bin_program* program)
+    : json_to_bin_chunked(program->nodes[0].type) {
+    state.program = program;
+}
+
+ABISNAX_NODISCARD inline bool json_to_bin(const json_to_bin_program& program, json_to_bin_state& state, uint32_t index,
+                                         bool allow_extensions, event_type event, bool start) {
+    using kind = json_to_bin_kind;
+    auto& node = program.nodes[index];
+    auto* type = node.type;
+    switch (node.kind) {
+    case kind::fail: return false;
+    case kind::object: {
+        if (start) {
+            if (event != event_type::received_start_object)
+                return set_error(state, "expected object");
+            state.stack.push_back({type, allow_extensions});
+            state.stack.back().node = index;
+            return true;
+        }
+        auto& stack_entry = state.stack.back();
+        auto* fields = program.fields.data() + node.first_field;
+        if (event == event_type::received_end_object) {
+            if (stack_entry.position + 1 != (ptrdiff_t)node.num_fields) {
+                auto& field = fields[stack_entry.position + 1];
+                if (!field.extension || !allow_extensions) {
+                    stack_entry.position = -1;
+                    return set_error(state, "expected field \"" + std::string{field.name} + "\"");
+                }
+                ++stack_entry.position;
+                state.skipped_extension = true;
+                return true;
+            }
+            state.stack.pop_back();
+            return true;
+        }
+        if (event == event_type::received_key) {
+            if (++stack_entry.position >= (ptrdiff_t)node.num_fields || state.skipped_extension)
+                return set_error(state, "unexpected field \"" + state.received_data.key + "\"");
+            auto& field = fields[stack_entry.position];
+            if (state.received_data.key != field.name) {
+                stack_entry.position = -1;
+                return set_error(state, "expected field \"" + std::string{field.name} + "\"");
+            }
+            return true;
+        }
+        auto& field = fields[stack_entry.position];
+        return json_to_bin(program, state, field.node,
+                           allow_extensions && stack_entry.position + 1 == (ptrdiff_t)node.num_fields, event, true);
+    }
+    case kind::array: {
+        if (start) {
+            if (event != event_type::received_start_array)
+                return set_error(state, "expected array");
+            state.stack.push_back({type, false});
+            state.stack.back().node = index;
+            reserve_array_size(state, state.stack.back());
+            return true;
+        }
+        auto& stack_entry = state.stack.back();
+        if (event == event_type::received_end_array) {
+            write_array_size(state, stack_entry);
+            state.stack.pop_back();
+            return true;
+        }
+        ++stack_entry.position;
+        return json_to_bin(program, state, node.child, false, event, true);
+    }
+    case kind::optional:
+        if (event == event_type::received_null) {
+            state.bin.push_back(0);
+            return true;
+        }
+        state.bin.push_back(1);
+        return json_to_bin(program, state, node.child, allow_extensions, event, true);
+    case kind::variant: {
+        if (start) {
+            if (event != event_type::received_start_array)
+                return set_error(state, R"(expected variant: ["type", value])");
+            state.stack.push_back({type, allow_extensions});
+            state.stack.back().node = index;
+            return true;
+        }
+        auto& stack_entry = state.stack.back();
+        auto* fields = program.fields.data() + node.first_field;
+        ++stack_entry.position;
+        if (event == event_type::received_end_array) {
+            if (stack_entry.position != 2)
+                return set_error(state, R"(expected variant: ["type", value])");
+            state.stack.pop_back();
+            return true;
+        }
+        if (stack_entry.position == 0) {
+            if (event != event_type::received_string)
+                return set_error(state, R"(expected variant: ["type", value])");
+            auto& type_name = state.get_string();
+            auto& table = program.variant_tables[node.table];
+            uint32_t i;
+            if (!table.slots.empty()) {
+                i = table.slots[hash_name(type_name, table.seed) & table.mask] - 1;
+            } else {
+                i = std::find_if(fields, fields + node.num_fields,
+                                 [&](auto& field) { return field.name == type_name; }) -
+                    fields;
+            }
+            if (i >= node.num_fields || fields[i].name != type_name)
+                return set_error(state, "type is not valid for this variant");
+            stack_entry.variant_type_index = i;
+            push_varuint32(state.bin, stack_entry.variant_type_index);
+            return true;
+        } else if (stack_entry.position == 1) {
+            auto& field = fields[stack_entry.variant_type_index];
+            return json_to_bin(program, state, field.node, allow_extensions, event, true);
+        } else {
+            return set_error(state, R"(expected variant: ["type", value])");
+        }
+    }
+    case kind::leaf: return type->ser->json_to_bin(state, allow_extensions, type, event, start);
+    case kind::bool_: return json_to_bin((bool*)nullptr, state, allow_extensions, type, event, start);
+    case kind::int8: return json_to_bin((int8_t*)nullptr, state, allow_extensions, type, event, start);
+    case kind::uint8: return json_to_bin((uint8_t*)nullptr, state, allow_extensions, type, event, start);
+    case kind::int16: return json_to_bin((int16_t*)nullptr, state, allow_extensions, type, event, start);
+    case kind::uint16: return json_to_bin((uint16_t*)nullptr, state, allow_extensions, type, event, start);
+    case kind::int32: return json_to_bin((int32_t*)nullptr, state, allow_extensions, type, event, start);
+    case kind::uint32: return json_to_bin((uint32_t*)nullptr, state, allow_extensions, type, event, start);
+    case kind::int64: return json_to_bin((int64_t*)nullptr, state, allow_extensions, type, event, start);
+    case kind::uint64: return json_to_bin((uint64_t*)nullptr, state, allow_extensions, type, event, start);
+    case kind::float32: return json_to_bin((float*)nullptr, state, allow_extensions, type, event, start);
+    case kind::float64: return json_to_bin((double*)nullptr, state, allow_extensions, type, event, start);
+    case kind::varuint32:
+        return json_to_bin((::abisnax::varuint32*)nullptr, state, allow_extensions, type, event, start);
+    case kind::name: return json_to_bin((::abisnax::name*)nullptr, state, allow_extensions, type, event, start);
+    case kind::string: return json_to_bin((std::string*)nullptr, state, allow_extensions, type, event, start);
+    }
+    return false;
+}
+
+// Feed an event to node of state.program, through its generated handlers if it has them
+ABISNAX_NODISCARD inline bool run_json_to_bin_program(json_to_bin_state& state, uint32_t node, bool allow_extensions,
+                                                     event_type event, bool start) {
+    auto& program = *state.program;
+    if (program.generated)
+        return program.generated(state, node, allow_extensions, event, start);
+    return json_to_bin(program, state, node, allow_extensions, event, start);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// generated codecs
+///////////////////////////////////////////////////////////////////////////////
+
+// abisnax-gen emits straight-line C++ converters for chosen types. A codec only applies to a type whose shape hash
+// matches the one it was generated from. Its json_to_bin handles one node of the type's json_to_bin_program, so it
+// plugs into the streaming json_to_bin with the same behavior and errors; its bin_to_json matches bin_to_json.
+
+struct generated_codec {
+    const char* type;
+    uint64_t shape_hash;
+    bool (*bin_to_json)(bin_to_json_state& state);
+    bool (*json_to_bin)(json_to_bin_state& state, uint32_t node, bool allow_extensions, event_type event, bool start);
+    uint32_t json_to_bin_nodes; // size of the json_to_bin_program it was generated from
+};
+
+inline void append_shape(std::string& shape, std::map<const abi_type*, size_t>& ids,
+                         std::vector<const abi_type*>& pending, const abi_type* type) {
+    if (type->extension_of) {
+        append_shape(shape, ids, pending, type->extension_of);
+        shape += "$";
+    } else if (type->optional_of) {
+        append_shape(shape, ids, pending, type->optional_of);
+        shape += "?";
+    } else if (type->array_of) {
+        append_shape(shape, ids, pending, type->array_of);
+        shape += "[]";
+    } else if (type->filled_struct || type->filled_variant) {
+        auto [it, inserted] = ids.try_emplace(type, ids.size());
+        if (inserted)
+            pending.push_back(type);
+        shape += "#" + std::to_string(it->second);
+    } else if (type->ser) {
+        shape += type->name;
+    } else {
+        shape += "!";
+    }
+}
+
+// Hash of the names, fields and layout of type and every type it refers to
+inline uint64_t get_shape_hash(const abi_type* type) {
+    std::string shape;
+    std::map<const abi_type*, size_t> ids;
+    std::vector<const abi_type*> pending;
+    append_shape(shape, ids, pending, type);
+    for (size_t i = 0; i < pending.size(); ++i) {
+        auto* t = pending[i];
+        shape += " " + std::to_string(t->name.size()) + ":" + std::string{t->name} + (t->filled_struct ? "{" : "<");
+        for (auto& field : t->fields) {
+            shape += std::to_string(field.name.size()) + ":" + std::string{field.name} + "=";
+            append_shape(shape, ids, pending, field.type);
+            shape += ",";
+        }
+        shape += t->filled_struct ? "}" : ">";
+    }
+
+    // FNV-1a
+    uint64_t hash = 14695981039346656037u;
+    for (auto c : shape)
+        hash = (hash ^ uint8_t(c)) * 1099511628211u;
+    return hash;
+}
+
+ABISNAX_NODISCARD inline bool bin_to_json(input_buffer& bin, std::string& error, const generated_codec* codec,
+                                         json_output_stream& stream) {
+    rapidjson::Writer<json_output_stream> writer{stream};
+    bin_to_json_state state{bin, error, writer};
+    return codec->bin_to_json(state);
+}
+
+inline namespace literals {
+inline constexpr name operator""_n(const char* s, size_t) { return name{s}; }
+} // namespace literals
+
+} // namespace abisnax
+
+// Defined here rather than in abisnax.h since codecs use the conversion state above
+struct abisnax_codec_s : abisnax::generated_codec {};
@@ -0,0 +1,461 @@
+// copyright defined in abisnax/LICENSE.txt
+
+// abisnax-gen: generate codecs for types in an abi. See abisnax_add_codecs.
+//
+//    abisnax-gen abi.json name output.cpp type...
+//
+// output.cpp defines:
+//
+//    extern const abisnax_codec name_codecs[];
+//    extern const size_t name_num_codecs;
+
+#include "abisnax.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace abisnax;
+
+// C++ spelling of the built-in leaf types
+std::string cpp_type(std::string_view name) {
+    if (name == "bool")
+        return "bool";
+    if (name == "float32")
+        return "float";
+    if (name == "float64")
+        return "double";
+    if (name == "string")
+        return "std::string";
+    if (name == "block_timestamp_type")
+        return "::abisnax::block_timestamp";
+    for (auto* s : {"int8", "uint8", "int16", "uint16", "int32", "uint32", "int64", "uint64"})
+        if (name == s)
+            return std::string{name} + "_t";
+    return "::abisnax::" + std::string{name};
+}
+
+std::string quote(std::string_view s) {
+    std::string result = "\"";
+    for (auto c : s) {
+        if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\' && c != '?') {
+            result += c;
+        } else {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\%03o", uint8_t(c));
+            result += buf;
+        }
+    }
+    return result + "\"";
+}
+
+struct generator {
+    std::string declarations{};
+    std::string definitions{};
+    std::map<std::pair<const abi_type*, bool>, size_t> bin_to_json_functions{};
+    std::vector<std::pair<const abi_type*, bool>> pending_bin_to_json{};
+    size_t next_var = 0;
+
+    std::string var(const char* prefix) { return prefix + std::to_string(next_var++); }
+
+    static bool is_function(const abi_type* type) { return type->filled_struct || type->filled_variant; }
+
+    size_t function(std::map<std::pair<const abi_type*, bool>, size_t>& functions,
+                    std::vector<std::pair<const abi_type*, bool>>& pending, const abi_type* type,
+                    bool allow_extensions) {
+        auto [it, inserted] = functions.try_emplace({type, allow_extensions}, functions.size());
+        if (inserted)
+            pending.push_back(it->first);
+        return it->second;
+    }
+
+    // Emit code which converts one value; depth is the number of stack entries the interpreter would hold
+    void bin_to_json_value(std::string& out, const std::string& indent, const abi_type* type, bool allow_extensions,
+                           const std::string& depth) {
+        if (type->extension_of) {
+            bin_to_json_value(out, indent, type->extension_of, allow_extensions, depth);
+        } else if (type->optional_of) {
+            auto present = var("present");
+            out += indent + "bool " + present + ";\n";
+            out += indent + "if (!read_raw(state.bin, state.error, " + present + "))\n";
+            out += indent + "    return false;\n";
+            out += indent + "if (" + present + ") {\n";
+            bin_to_json_value(out, indent + "    ", type->optional_of, allow_extensions, depth);
+            out += indent + "} else {\n";
+            out += indent + "    state.writer.Null();\n";
+            out += indent + "}\n";
+        } else if (type->array_of) {
+            auto size = var("size");
+            auto i = var("i");
+            out += indent + "uint32_t " + size + ";\n";
+            out += indent + "if (!read_varuint32(state.bin, state.error, " + size + "))\n";
+            out += indent + "    return false;\n";
+            if (type->array_of->fixed_size) {
+                out += indent + "if (!check_remaining(state.bin, state.error, uint64_t(" + size + ") * " +
+                       std::to_string(type->array_of->fixed_size) + "))\n";
+                out += indent + "    return false;\n";
+            }
+            out += indent + "if (" + depth + " + 1 > max_stack_size)\n";
+            out += indent + "    return set_error(state, \"recursion limit reached\");\n";
+            out += indent + "state.writer.StartArray();\n";
+            out += indent + "for (uint32_t " + i + " = 0; " + i + " < " + size + "; ++" + i + ") {\n";
+            bin_to_json_value(out, indent + "    ", type->array_of, false, depth + " + 1");
+            out += indent + "}\n";
+            out += indent + "state.writer.EndArray();\n";
+        } else if (is_function(type)) {
+            auto f = function(bin_to_json_functions, pending_bin_to_json, type, allow_extensions);
+            out += indent + "if (!bin_to_json_" + std::to_string(f) + "(state, " + depth + "))\n";
+            out += indent + "    return false;\n";
+        } else {
+            out += indent + "if (!bin_to_json((" + cpp_type(type->name) + "*)nullptr, state, false, nullptr, true))\n";
+            out += indent + "    return false;\n";
+        }
+    }
+
+    // Emit code which converts a fixed-size struct after the whole of it has been bounds checked
+    void fixed_object(std::string& out, const abi_type* type) {
+        out += "    state.writer.StartObject();\n";
+        for (auto& field : type->fields) {
+            out += "    state.writer.Key(" + quote(field.name) + ", " + std::to_string(field.name.size()) + ");\n";
+            if (field.type->filled_struct) {
+                fixed_object(out, field.type);
+            } else {
+                out += "    if (!unchecked_bin_to_json((" + cpp_type(field.type->name) + "*)nullptr, state))\n";
+                out += "        return false;\n";
+            }
+        }
+        out += "    state.writer.EndObject();\n";
+    }
+
+    void bin_to_json_function(size_t index, const abi_type* type, bool allow_extensions) {
+        auto name = "bin_to_json_" + std::to_string(index);
+        declarations += "bool " + name + "(bin_to_json_state& state, size_t depth); // " + std::string{type->name} +
+                        (allow_extensions ? "" : ", no extensions") + "\n";
+        auto& out = definitions;
+        out += "\nbool " + name + "(bin_to_json_state& state, size_t depth) {\n";
+        out += "    if (depth + 1 > max_stack_size)\n";
+        out += "        return set_error(state, \"recursion limit reached\");\n";
+        if (type->fixed_size) {
+            out += "    if (!check_remaining(state.bin, state.error, " + std::to_string(type->fixed_size) + "))\n";
+            out += "        return false;\n";
+            fixed_object(out, type);
+        } else if (type->filled_struct) {
+            out += "    state.writer.StartObject();\n";
+            for (auto& field : type->fields) {
+                bool last = &field == &type->fields.back();
+                std::string indent = "    ";
+                bool extension = field.type->extension_of && allow_extensions;
+                if (extension) {
+                    out += "    if (state.bin.pos == state.bin.end) {\n";
+                    out += "        state.skipped_extension = true;\n";
+                    out += "    } else {\n";
+                    indent += "    ";
+                }
+                out += indent + "state.writer.Key(" + quote(field.name) + ", " + std::to_string(field.name.size()) +
+                       ");\n";
+                bin_to_json_value(out, indent, field.type, allow_extensions && last, "depth + 1");
+                if (extension)
+                    out += "    }\n";
+            }
+            out += "    state.writer.EndObject();\n";
+        } else {
+            out += "    state.writer.StartArray();\n";
+            out += "    uint32_t index;\n";
+            out += "    if (!read_varuint32(state.bin, state.error, index))\n";
+            out += "        return false;\n";
+            out += "    switch (index) {\n";
+            for (size_t i = 0; i < type->fields.size(); ++i) {
+                auto& field = type->fields[i];
+                out += "    case " + std::to_string(i) + ": {\n";
+                out += "        state.writer.String(" + quote(field.name) + ", " + std::to_string(field.name.size()) +
+                       ");\n";
+                bin_to_json_value(out, "        ", field.type, allow_extensions, "depth + 1");
+                out += "        break;\n";
+                out += "    }\n";
+            }
+            out += "    default: return set_error(state, \"invalid variant type index\");\n";
+            out += "    }\n";
+            out += "    state.writer.EndArray();\n";
+        }
+        out += "    return true;\n";
+        out += "}\n";
+    }
+
+    // C++ type whose json_to_bin overload handles a built-in kind
+    static const char* kind_cpp_type(json_to_bin_kind kind) {
+        using kind_type = json_to_bin_kind;
+        switch (kind) {
+        case kind_type::bool_: return "bool";
+        case kind_type::int8: return "int8_t";
+        case kind_type::uint8: return "uint8_t";
+        case kind_type::int16: return "int16_t";
+        case kind_type::uint16: return "uint16_t";
+        case kind_type::int32: return "int32_t";
+        case kind_type::uint32: return "uint32_t";
+        case kind_type::int64: return "int64_t";
+        case kind_type::uint64: return "uint64_t";
+        case kind_type::float32: return "float";
+        case kind_type::float64: return "double";
+        case kind_type::varuint32: return "::abisnax::varuint32";
+        case kind_type::name: return "::abisnax::name";
+        case kind_type::string: return "std::string";
+        default: return nullptr;
+        }
+    }
+
+    // Emit a handler for each node of type's json_to_bin_program. Each one does what the interpreter in
+    // json_to_bin(const json_to_bin_program&, ...) does for its node, with the node's fields and children built in.
+    // Nodes are numbered as compile_json_to_bin numbers them, so they match the program compiled at runtime for a type
+    // of the same shape. Returns the number of nodes.
+    size_t json_to_bin_handlers(size_t codec, const abi_type* type) {
+        json_to_bin_program program;
+        compile_json_to_bin(program, type);
+        auto prefix = "json_to_bin_" + std::to_string(codec) + "_";
+        auto handler = [&](uint32_t node) { return prefix + std::to_string(node); };
+        auto& out = definitions;
+        for (uint32_t index = 0; index < program.nodes.size(); ++index) {
+            auto& node = program.nodes[index];
+            auto n = std::to_string(index);
+            auto* fields = program.fields.data() + node.first_field;
+            auto num_fields = std::to_string(node.num_fields);
+            declarations += "bool " + handler(index) +
+                            "(json_to_bin_state& state, bool allow_extensions, event_type event, bool start); // " +
+                            std::string{node.type->name} + "\n";
+            out += "\nbool " + handler(index) +
+                   "(json_to_bin_state& state, bool allow_extensions, event_type event, bool start) {\n";
+            switch (node.kind) {
+            case json_to_bin_kind::fail: out += "    return false;\n"; break;
+            case json_to_bin_kind::object: {
+                out += "    if (start) {\n";
+                out += "        if (event != event_type::received_start_object)\n";
+                out += "            return set_error(state, \"expected object\");\n";
+                out += "        state.stack.push_back({state.program->nodes[" + n + "].type, allow_extensions});\n";
+                out += "        state.stack.back().node = " + n + ";\n";
+                out += "        return true;\n";
+                out += "    }\n";
+                out += "    auto& stack_entry = state.stack.back();\n";
+                out += "    if (event == event_type::received_end_object) {\n";
+                out += "        switch (stack_entry.position + 1) {\n";
+                for (uint32_t i = 0; i < node.num_fields; ++i) {
+                    out += "        case " + std::to_string(i) + ":\n";
+                    if (fields[i].extension) {
+                        out += "            if (allow_extensions) {\n";
+                        out += "                ++stack_entry.position;\n";
+                        out += "                state.skipped_extension = true;\n";
+                        out += "                return true;\n";
+                        out += "            }\n";
+                    }
+                    out += "            stack_entry.position = -1;\n";
+                    out += "            return set_error(state, " +
+                           quote("expected field \"" + std::string{fields[i].name} + "\"") + ");\n";
+                }
+                out += "        }\n";
+                out += "        state.stack.pop_back();\n";
+                out += "        return true;\n";
+                out += "    }\n";
+                out += "    if (event == event_type::received_key) {\n";
+                out += "        if (++stack_entry.position >= " + num_fields + " || state.skipped_extension)\n";
+                out += "            return set_error(state, \"unexpected field \\\"\" + state.received_data.key + "
+                       "\"\\\"\");\n";
+                out += "        switch (stack_entry.position) {\n";
+                for (uint32_t i = 0; i < node.num_fields; ++i) {
+                    auto& name = fields[i].name;
+                    out += "        case " + std::to_string(i) + ":\n";
+                    out += "            if (state.received_data.key == std::string_view{" + quote(name) + ", " +
+                           std::to_string(name.size()) + "})\n";
+                    out += "                return true;\n";
+                    out += "            stack_entry.position = -1;\n";
+                    out += "            return set_error(state, " +
+                           quote("expected field \"" + std::string{name} + "\"") + ");\n";
+                }
+                out += "        }\n";
+                out += "        return false;\n";
+                out += "    }\n";
+                out += "    switch (stack_entry.position) {\n";
+                for (uint32_t i = 0; i < node.num_fields; ++i) {
+                    bool last = i + 1 == node.num_fields;
+                    out += "    case " + std::to_string(i) + ": return " + handler(fields[i].node) + "(state, " +
+                           (last ? "allow_extensions" : "false") + ", event, true);\n";
+                }
+                out += "    }\n";
+                out += "    return false;\n";
+                break;
+            }
+            case json_to_bin_kind::array:
+                out += "    if (start) {\n";
+                out += "        if (event != event_type::received_start_array)\n";
+                out += "            return set_error(state, \"expected array\");\n";
+                out += "        state.stack.push_back({state.program->nodes[" + n + "].type, false});\n";
+                out += "        state.stack.back().node = " + n + ";\n";
+                out += "        reserve_array_size(state, state.stack.back());\n";
+                out += "        return true;\n";
+                out += "    }\n";
+                out += "    auto& stack_entry = state.stack.back();\n";
+                out += "    if (event == event_type::received_end_array) {\n";
+                out += "        write_array_size(state, stack_entry);\n";
+                out += "        state.stack.pop_back();\n";
+                out += "        return true;\n";
+                out += "    }\n";
+                out += "    ++stack_entry.position;\n";
+                out += "    return " + handler(node.child) + "(state, false, event, true);\n";
+                break;
+            case json_to_bin_kind::optional:
+                out += "    if (event == event_type::received_null) {\n";
+                out += "        state.bin.push_back(0);\n";
+                out += "        return true;\n";
+                out += "    }\n";
+                out += "    state.bin.push_back(1);\n";
+                out += "    return " + handler(node.child) + "(state, allow_extensions, event, true);\n";
+                break;
+            case json_to_bin_kind::variant: {
+                auto expected = quote(R"(expected variant: ["type", value])");
+                out += "    if (start) {\n";
+                out += "        if (event != event_type::received_start_array)\n";
+                out += "            return set_error(state, " + expected + ");\n";
+                out += "        state.stack.push_back({state.program->nodes[" + n + "].type, allow_extensions});\n";
+                out += "        state.stack.back().node = " + n + ";\n";
+                out += "        return true;\n";
+                out += "    }\n";
+                out += "    auto& stack_entry = state.stack.back();\n";
+                out += "    ++stack_entry.position;\n";
+                out += "    if (event == event_type::received_end_array) {\n";
+                out += "        if (stack_entry.position != 2)\n";
+                out += "            return set_error(state, " + expected + ");\n";
+                out += "        state.stack.pop_back();\n";
+                out += "        return true;\n";
+                out += "    }\n";
+                out += "    if (stack_entry.position == 0) {\n";
+                out += "        if (event != event_type::received_string)\n";
+                out += "            return set_error(state, " + expected + ");\n";
+                out += "        auto& type_name = state.get_string();\n";
+                for (uint32_t i = 0; i < node.num_fields; ++i) {
+                    auto& name = fields[i].name;
+                    out += std::string{i ? "        else if" : "        if"} + " (type_name == std::string_view{" +
+                           quote(name) + ", " + std::to_string(name.size()) + "})\n";
+                    out += "            stack_entry.variant_type_index = " + std::to_string(i) + ";\n";
+                }
+                out += std::string{node.num_fields ? "        else\n    " : ""} +
+                       "        return set_error(state, \"type is not valid for this variant\");\n";
+                if (node.num_fields) {
+                    out += "        push_varuint32(state.bin, stack_entry.variant_type_index);\n";
+                    out += "        return true;\n";
+                }
+                out += "    }\n";
+                out += "    if (stack_entry.position == 1) {\n";
+                out += "        switch (stack_entry.variant_type_index) {\n";
+                for (uint32_t i = 0; i < node.num_fields; ++i)
+                    out += "        case " + std::to_string(i) + ": return " + handler(fields[i].node) +
+                           "(state, allow_extensions, event, true);\n";
+                out += "        }\n";
+                out += "        return false;\n";
+                out += "    }\n";
+                out += "    return set_error(state, " + expected + ");\n";
+                break;
+            }
+            case json_to_bin_kind::leaf:
+                out += "    auto* type = state.program->nodes[" + n + "].type;\n";
+                out += "    return type->ser->json_to_bin(state, allow_extensions, type, event, start);\n";
+                break;
+            default:
+                out += "    return json_to_bin((" + std::string{kind_cpp_type(node.kind)} +
+                       "*)nullptr, state, allow_extensions, state.program->nodes[" + n + "].type, event, start);\n";
+                break;
+            }
+            out += "}\n";
+        }
+
+        out += "\nbool codec_json_to_bin_" + std::to_string(codec) +
+               "(json_to_bin_state& state, uint32_t node, bool allow_extensions, event_type event, bool start) {\n";
+        out += "    switch (node) {\n";
+        for (uint32_t index = 0; index < program.nodes.size(); ++index)
+            out += "    case " + std::to_string(index) + ": return " + handler(index) +
+                   "(state, allow_extensions, event, start);\n";
+        out += "    }\n";
+        out += "    return false;\n";
+        out += "}\n";
+        return program.nodes.size();
+    }
+
+    // Emit the codec's entry points and everything they use. Returns the number of json_to_bin nodes.
+    size_t codec(size_t index, const abi_type* type) {
+        auto suffix = std::to_string(index);
+        auto& out = definitions;
+        out += "\nbool codec_bin_to_json_" + suffix + "(bin_to_json_state& state) {\n";
+        out += "    size_t depth = 0;\n";
+        bin_to_json_value(out, "    ", type, true, "depth");
+        out += "    return true;\n";
+        out += "}\n";
+        while (!pending_bin_to_json.empty()) {
+            auto [t, allow_extensions] = pending_bin_to_json.back();
+            pending_bin_to_json.pop_back();
+            bin_to_json_function(bin_to_json_functions.at({t, allow_extensions}), t, allow_extensions);
+        }
+        return json_to_bin_handlers(index, type);
+    }
+};
+
+ABISNAX_NODISCARD bool generate(std::string& result, std::string& error, const std::string& abi,
+                               const std::string& name, const std::vector<std::string>& types) {
+    abi_def def{};
+    if (!json_to_native(def, error, abi))
+        return false;
+    if (!check_abi_version(def.version, error))
+        return false;
+    contract c;
+    if (!fill_contract(c, error, def))
+        return false;
+
+    generator gen;
+    std::map<std::string, abi_type> scratch;
+    std::string codecs;
+    for (size_t i = 0; i < types.size(); ++i) {
+        const abi_type* type;
+        if (!get_type(type, error, c.abi_types, scratch, types[i], 0))
+            return false;
+        auto nodes = gen.codec(i, type);
+        char hash[32];
+        snprintf(hash, sizeof(hash), "0x%016llx", (unsigned long long)get_shape_hash(type));
+        codecs += "    {{" + quote(types[i]) + ", " + hash + "ull, codec_bin_to_json_" + std::to_string(i) +
+                  ", codec_json_to_bin_" + std::to_string(i) + ", " + std::to_string(nodes) + "}},\n";
+    }
+
+    result = "// Generated by abisnax-gen. Do not edit.\n\n";
+    result += "#include \"abisnax.h\"\n";
+    result += "#include \"abisnax.hpp\"\n\n";
+    result += "namespace {\n\n";
+    result += "using namespace abisnax;\n\n";
+    result += gen.declarations;
+    result += gen.definitions;
+    result += "\n} // namespace\n\n";
+    result += "extern const abisnax_codec " + name + "_codecs[] = {\n" + codecs + "};\n";
+    result += "extern const size_t " + name + "_num_codecs = " + std::to_string(types.size()) + ";\n";
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        std::cerr << "usage: abisnax-gen abi.json name output.cpp type...\n";
+        return 1;
+    }
+    std::ifstream in(argv[1]);
+    if (!in) {
+        std::cerr << "abisnax-gen: can't read " << argv[1] << "\n";
+        return 1;
+    }
+    std::stringstream abi;
+    abi << in.rdbuf();
+
+    std::string result;
+    std::string error;
+    if (!generate(result, error, abi.str(), argv[2], {argv + 4, argv + argc})) {
+        std::cerr << "abisnax-gen: " << argv[1] << ": " << (error.empty() ? "abi parse error" : error) << "\n";
+        return 1;
+    }
+    std::ofstream out(argv[3]);
+    out << result;
+    if (!out) {
+        std::cerr << "abisnax-gen: can't write " << argv[3] << "\n";
+        return 1;
+    }
+    return 0;
+}
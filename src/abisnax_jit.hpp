@@ -0,0 +1,356 @@
+// copyright defined in abisnax/LICENSE.txt
+
+#pragma once
+
+#include "abisnax.hpp"
+
+#include <cstring>
+#include <exception>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define ABISNAX_JIT 1
+#else
+#define ABISNAX_JIT 0
+#endif
+
+namespace abisnax {
+
+///////////////////////////////////////////////////////////////////////////////
+// bin_to_json (native)
+///////////////////////////////////////////////////////////////////////////////
+
+// jit_bin_to_json translates a bin_to_json_program into x86-64 code. Each op becomes a direct call to a helper below;
+// jumps, subroutine calls and the loops over array items become native branches, so there's no dispatch loop left.
+// The helpers behave exactly like the cases of the interpreter over the same program. The generated code has no unwind
+// info, so no exception may leave a helper: guard reports it as an error and bin_to_json rethrows it once the code has
+// returned.
+
+inline constexpr bool jit_supported = ABISNAX_JIT;
+
+struct bin_to_json_jit_state {
+    bin_to_json_state& state;
+    std::vector<uint32_t> items{}; // remaining items of the arrays being converted
+    size_t calls = 0;
+    std::exception_ptr exception{};
+};
+
+// Executable memory holding one compiled program
+struct bin_to_json_jit_code {
+    void* code = nullptr;
+    size_t size = 0;
+
+    bin_to_json_jit_code() = default;
+    bin_to_json_jit_code(const bin_to_json_jit_code&) = delete;
+    bin_to_json_jit_code& operator=(const bin_to_json_jit_code&) = delete;
+
+    ~bin_to_json_jit_code() {
+#if ABISNAX_JIT
+        if (code)
+            munmap(code, size);
+#endif
+    }
+};
+
+namespace jit {
+
+using state = bin_to_json_jit_state;
+using op = bin_to_json_op;
+
+inline bool enter(state* s, const op*) {
+    if (s->calls + s->items.size() >= max_stack_size)
+        return set_error(s->state, "recursion limit reached");
+    ++s->calls;
+    return true;
+}
+
+inline bool leave(state* s, const op*) noexcept {
+    --s->calls;
+    return true;
+}
+
+inline bool start_object(state* s, const op*) {
+    s->state.writer.StartObject();
+    return true;
+}
+
+inline bool fixed_object(state* s, const op* o) {
+    return check_remaining(s->state.bin, s->state.error, o->type->fixed_size) &&
+           fixed_object_to_json(s->state, o->type);
+}
+
+inline bool end_object(state* s, const op*) {
+    s->state.writer.EndObject();
+    return true;
+}
+
+inline bool key(state* s, const op* o) {
+    s->state.writer.Key(o->key.data(), o->key.length());
+    return true;
+}
+
+// true to skip the extension
+inline bool skip_extension(state* s, const op*) noexcept { return s->state.bin.pos == s->state.bin.end; }
+
+// 0 on error, 1 if present, 2 if absent
+inline uint32_t optional(state* s, const op*) {
+    bool present;
+    if (!read_raw(s->state.bin, s->state.error, present))
+        return 0;
+    if (present)
+        return 1;
+    s->state.writer.Null();
+    return 2;
+}
+
+// 0 on error, 1 if there are items, 2 if empty
+inline uint32_t start_array(state* s, const op* o) {
+    uint32_t size;
+    if (!read_varuint32(s->state.bin, s->state.error, size))
+        return 0;
+    if (!check_remaining(s->state.bin, s->state.error, uint64_t(size) * o->type->fixed_size))
+        return 0;
+    s->state.writer.StartArray();
+    if (!size)
+        return 2;
+    if (s->calls + s->items.size() >= max_stack_size)
+        return set_error(s->state, "recursion limit reached");
+    s->items.push_back(size);
+    return 1;
+}
+
+// true if there are more items
+inline bool next_item(state* s, const op*) noexcept {
+    if (--s->items.back())
+        return true;
+    s->items.pop_back();
+    return false;
+}
+
+inline bool end_array(state* s, const op*) {
+    s->state.writer.EndArray();
+    return true;
+}
+
+// 0 on error, otherwise 1 + the alternative's index
+inline uint32_t variant(state* s, const op* o) {
+    uint32_t index;
+    if (!read_varuint32(s->state.bin, s->state.error, index))
+        return 0;
+    if (index >= o->type->fields.size())
+        return set_error(s->state, "invalid variant type index");
+    s->state.writer.StartArray();
+    auto& f = o->type->fields[index];
+    s->state.writer.String(f.name.data(), f.name.length());
+    return index + 1;
+}
+
+inline bool leaf(state* s, const op* o) { return o->type->ser->bin_to_json(s->state, false, o->type, true); }
+
+template <typename T>
+bool typed_leaf(state* s, const op* o) {
+    return bin_to_json((T*)nullptr, s->state, false, o->type, true);
+}
+
+// Call a helper which may throw. An exception becomes an error return (false or 0).
+template <auto helper>
+auto guard(state* s, const op* o) noexcept -> decltype(helper(s, o)) {
+    try {
+        return helper(s, o);
+    } catch (...) {
+        s->exception = std::current_exception();
+        return {};
+    }
+}
+
+// x86-64 code for a program. Helpers take (rdi = state, rsi = op); rbx holds state throughout.
+struct assembler {
+    std::vector<uint8_t> code{};
+    std::vector<uint32_t> op_offsets{};
+    std::vector<std::pair<uint32_t, uint32_t>> fixups{}; // rel32 position, target op
+    std::vector<uint32_t> fail_fixups{};                 // rel32 position
+
+    void bytes(std::initializer_list<uint8_t> b) { code.insert(code.end(), b); }
+
+    void imm32(uint32_t v) {
+        for (int i = 0; i < 4; ++i)
+            code.push_back(v >> (i * 8));
+    }
+
+    void imm64(uint64_t v) {
+        for (int i = 0; i < 8; ++i)
+            code.push_back(v >> (i * 8));
+    }
+
+    void call_helper(const void* helper, const op* o) {
+        bytes({0x48, 0x89, 0xdf}); // mov rdi, rbx
+        bytes({0x48, 0xbe});       // mov rsi, o
+        imm64((uint64_t)o);
+        bytes({0x48, 0xb8}); // mov rax, helper
+        imm64((uint64_t)helper);
+        bytes({0xff, 0xd0}); // call rax
+    }
+
+    void helper_or_fail(const void* helper, const op* o) {
+        call_helper(helper, o);
+        bytes({0x84, 0xc0}); // test al, al
+        jump_to_fail({0x0f, 0x84}); // jz
+    }
+
+    void jump_to_fail(std::initializer_list<uint8_t> opcode) {
+        bytes(opcode);
+        fail_fixups.push_back(code.size());
+        imm32(0);
+    }
+
+    void jump_to(std::initializer_list<uint8_t> opcode, uint32_t target) {
+        bytes(opcode);
+        fixups.push_back({code.size(), target});
+        imm32(0);
+    }
+
+    void compile(const bin_to_json_program& program) {
+        using opcode = bin_to_json_opcode;
+        bytes({0x55});                   // push rbp
+        bytes({0x48, 0x89, 0xe5});       // mov rbp, rsp
+        bytes({0x53});                   // push rbx
+        bytes({0x48, 0x83, 0xec, 0x08}); // sub rsp, 8
+        bytes({0x48, 0x89, 0xfb});       // mov rbx, rdi
+
+        // Subroutines start right after a ret; keep their stack aligned like the top level's
+        auto& ops = program.ops;
+        std::vector<bool> subroutine(ops.size());
+        for (auto& o : ops)
+            if (o.code == opcode::call)
+                subroutine[o.target] = true;
+
+        for (size_t pc = 0; pc < ops.size(); ++pc) {
+            auto& o = ops[pc];
+            op_offsets.push_back(code.size());
+            if (subroutine[pc])
+                bytes({0x48, 0x83, 0xec, 0x08}); // sub rsp, 8
+            switch (o.code) {
+            case opcode::done:
+                bytes({0xb8});
+                imm32(1);                        // mov eax, 1
+                bytes({0x48, 0x8d, 0x65, 0xf8}); // lea rsp, [rbp - 8]
+                bytes({0x5b, 0x5d, 0xc3});       // pop rbx; pop rbp; ret
+                break;
+            case opcode::call:
+                helper_or_fail((const void*)&guard<enter>, &o);
+                jump_to({0xe8}, o.target); // call
+                call_helper((const void*)&leave, &o);
+                break;
+            case opcode::ret:
+                bytes({0x48, 0x83, 0xc4, 0x08}); // add rsp, 8
+                bytes({0xc3});                   // ret
+                break;
+            case opcode::jump: jump_to({0xe9}, o.target); break;
+            case opcode::fail: jump_to_fail({0xe9}); break;
+            case opcode::start_object: helper_or_fail((const void*)&guard<start_object>, &o); break;
+            case opcode::fixed_object: helper_or_fail((const void*)&guard<fixed_object>, &o); break;
+            case opcode::end_object: helper_or_fail((const void*)&guard<end_object>, &o); break;
+            case opcode::key: helper_or_fail((const void*)&guard<key>, &o); break;
+            case opcode::skip_extension:
+                call_helper((const void*)&skip_extension, &o);
+                bytes({0x84, 0xc0});             // test al, al
+                jump_to({0x0f, 0x85}, o.target); // jnz
+                break;
+            case opcode::optional:
+            case opcode::start_array:
+                call_helper(o.code == opcode::optional ? (const void*)&guard<optional>
+                                                       : (const void*)&guard<start_array>,
+                            &o);
+                bytes({0x83, 0xf8, 0x01});          // cmp eax, 1
+                jump_to_fail({0x0f, 0x82});         // jb
+                jump_to({0x0f, 0x87}, o.target);    // ja
+                break;
+            case opcode::next_item:
+                call_helper((const void*)&next_item, &o);
+                bytes({0x84, 0xc0});             // test al, al
+                jump_to({0x0f, 0x85}, o.target); // jnz
+                break;
+            case opcode::end_array: helper_or_fail((const void*)&guard<end_array>, &o); break;
+            case opcode::variant:
+                call_helper((const void*)&guard<variant>, &o);
+                bytes({0x85, 0xc0});                // test eax, eax
+                jump_to_fail({0x0f, 0x84});         // jz
+                for (size_t i = 0; i < o.type->fields.size(); ++i) {
+                    bytes({0x3d});
+                    imm32(i + 1);                                           // cmp eax, i + 1
+                    jump_to({0x0f, 0x84}, program.targets[o.target + i]); // je
+                }
+                break;
+            case opcode::leaf: helper_or_fail((const void*)&guard<leaf>, &o); break;
+            case opcode::bool_: helper_or_fail((const void*)&guard<typed_leaf<bool>>, &o); break;
+            case opcode::int8: helper_or_fail((const void*)&guard<typed_leaf<int8_t>>, &o); break;
+            case opcode::uint8: helper_or_fail((const void*)&guard<typed_leaf<uint8_t>>, &o); break;
+            case opcode::int16: helper_or_fail((const void*)&guard<typed_leaf<int16_t>>, &o); break;
+            case opcode::uint16: helper_or_fail((const void*)&guard<typed_leaf<uint16_t>>, &o); break;
+            case opcode::int32: helper_or_fail((const void*)&guard<typed_leaf<int32_t>>, &o); break;
+            case opcode::uint32: helper_or_fail((const void*)&guard<typed_leaf<uint32_t>>, &o); break;
+            case opcode::int64: helper_or_fail((const void*)&guard<typed_leaf<int64_t>>, &o); break;
+            case opcode::uint64: helper_or_fail((const void*)&guard<typed_leaf<uint64_t>>, &o); break;
+            case opcode::float32: helper_or_fail((const void*)&guard<typed_leaf<float>>, &o); break;
+            case opcode::float64: helper_or_fail((const void*)&guard<typed_leaf<double>>, &o); break;
+            case opcode::varuint32: helper_or_fail((const void*)&guard<typed_leaf<::abisnax::varuint32>>, &o); break;
+            case opcode::name: helper_or_fail((const void*)&guard<typed_leaf<::abisnax::name>>, &o); break;
+            case opcode::string: helper_or_fail((const void*)&guard<typed_leaf<std::string>>, &o); break;
+            }
+        }
+
+        uint32_t fail = code.size();
+        bytes({0x31, 0xc0});             // xor eax, eax
+        bytes({0x48, 0x8d, 0x65, 0xf8}); // lea rsp, [rbp - 8]
+        bytes({0x5b, 0x5d, 0xc3});       // pop rbx; pop rbp; ret
+
+        auto patch = [&](uint32_t pos, uint32_t target) {
+            uint32_t rel = target - (pos + 4);
+            for (int i = 0; i < 4; ++i)
+                code[pos + i] = rel >> (i * 8);
+        };
+        for (auto [pos, target] : fixups)
+            patch(pos, op_offsets[target]);
+        for (auto pos : fail_fixups)
+            patch(pos, fail);
+    }
+};
+
+} // namespace jit
+
+ABISNAX_NODISCARD inline bool jit_bin_to_json(bin_to_json_jit_code& result, std::string& error,
+                                             const bin_to_json_program& program) {
+#if ABISNAX_JIT
+    jit::assembler a;
+    a.compile(program);
+    size_t size = (a.code.size() + 4095) & ~size_t(4095);
+    void* code = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+        return set_error(error, "jit: mmap failed");
+    memcpy(code, a.code.data(), a.code.size());
+    if (mprotect(code, size, PROT_READ | PROT_EXEC)) {
+        munmap(code, size);
+        return set_error(error, "jit: mprotect failed");
+    }
+    if (result.code)
+        munmap(result.code, result.size);
+    result.code = code;
+    result.size = size;
+    return true;
+#else
+    return set_error(error, "jit is not supported on this platform");
+#endif
+}
+
+ABISNAX_NODISCARD inline bool bin_to_json(input_buffer& bin, std::string& error, const bin_to_json_jit_code* code,
+                                         json_output_stream& stream) {
+    rapidjson::Writer<json_output_stream> writer{stream};
+    bin_to_json_state state{bin, error, writer};
+    bin_to_json_jit_state jit_state{state};
+    bool ok = ((bool (*)(bin_to_json_jit_state*))code->code)(&jit_state);
+    if (jit_state.exception)
+        std::rethrow_exception(jit_state.exception);
+    return ok;
+}
+
+} // namespace abisnax
@@ -254,9 +254,9 @@ ABISNAX_NODISCARD bool key_to_string(std::string& dest, std::string& error, cons
 }
 
 ABISNAX_NODISCARD inline bool string_to_public_key(public_key& dest, std::string& error, std::string_view s) {
-    if (s.size() >= 3 && s.substr(0, 3) == "SNAX") {
+    if (s.size() >= 4 && s.substr(0, 4) == "SNAX") {
         std::array<uint8_t, 37> whole;
-        if (!base58_to_binary(whole, error, s.substr(3)))
+        if (!base58_to_binary(whole, error, s.substr(4)))
             return false;
         public_key key{key_type::k1};
         static_assert(whole.size() == key.data.size() + 4);
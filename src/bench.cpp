@@ -0,0 +1,92 @@
+// copyright defined in abisnax/LICENSE.txt
+
+// Compare bin_to_json through the compiled program interpreter with the jit, on types from the test abi:
+//
+//    bench [iterations]
+
+#include "abisnax.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+std::string repeat(const std::string& item, int count) {
+    std::string result = "[";
+    for (int i = 0; i < count; ++i)
+        result += (i ? "," : "") + item;
+    return result + "]";
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    std::ifstream in(BENCH_ABI);
+    std::stringstream abi;
+    abi << in.rdbuf();
+
+    auto interpreted = abisnax_create();
+    auto jit = abisnax_create();
+    if (!abisnax_set_jit_threshold(jit, 1)) {
+        printf("%s\n", abisnax_get_error(jit));
+        return 0;
+    }
+    for (auto* context : {interpreted, jit}) {
+        if (!abisnax_set_abi(context, 0, abi.str().c_str())) {
+            printf("%s\n", abisnax_get_error(context));
+            return 1;
+        }
+    }
+
+    std::string leaves = R"({"b":true,"u8":1,"i16":-2,"u32":3,"i64":"-4","u64":"5","vu":6,"f64":1.5,"n":"alice",)"
+                         R"("s":"hi","data":"0A0B","hash":")" +
+                         std::string(64, 'A') +
+                         R"(","sym":"4,SYS","qty":"1.0000 SYS","ext":{"quantity":"1.0000 SYS","contract":"bob"},)"
+                         R"("when":"2020-01-01T00:00:00.000","at":"2020-01-01T00:00:00.000","maybe":"x",)"
+                         R"("names":["a","b"],"more":[["int8",1],["s1",{"x1":2}]]})";
+    std::string fixed = R"({"b":true,"i16":-2,"u64":"5","f32":0.5,"n":"alice","sym":"4,SYS",)"
+                        R"("ext":{"quantity":"1.0000 SYS","contract":"bob"}})";
+    std::string s5 = R"({"x1":1,"x2":2,"x3":{"c1":3,"c2":[{"x1":4,"x2":5,"x3":{"c1":6,"c2":[],"c3":7}}],"c3":8}})";
+    struct {
+        const char* type;
+        std::string json;
+    } cases[] = {
+        {"leaves", leaves},          {"leaves[]", repeat(leaves, 100)}, {"fixed[]", repeat(fixed, 100)},
+        {"s5[]", repeat(s5, 100)},   {"int8[]", repeat("1", 1000)},
+    };
+
+    printf("%-10s %14s %14s %8s\n", "type", "interpreted ns", "jit ns", "speedup");
+    for (auto& c : cases) {
+        if (!abisnax_json_to_bin(interpreted, 0, c.type, c.json.c_str())) {
+            printf("%s: %s\n", c.type, abisnax_get_error(interpreted));
+            return 1;
+        }
+        std::string bin{abisnax_get_bin_data(interpreted), size_t(abisnax_get_bin_size(interpreted))};
+        auto time = [&](abisnax_context* context) {
+            auto handle = abisnax_get_type_handle(context, 0, c.type);
+            auto json = abisnax_bin_to_json_handle(context, handle, bin.data(), bin.size());
+            if (!json || json != c.json)
+                throw std::runtime_error(std::string{c.type} + ": round trip mismatch");
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i)
+                if (!abisnax_bin_to_json_handle(context, handle, bin.data(), bin.size()))
+                    throw std::runtime_error(abisnax_get_error(context));
+            auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            abisnax_release_type_handle(context, handle);
+            return ns / iterations;
+        };
+        try {
+            auto interpreted_ns = time(interpreted);
+            auto jit_ns = time(jit);
+            printf("%-10s %14.0f %14.0f %7.2fx\n", c.type, interpreted_ns, jit_ns, interpreted_ns / jit_ns);
+        } catch (std::exception& e) {
+            printf("%s\n", e.what());
+            return 1;
+        }
+    }
+    abisnax_destroy(interpreted);
+    abisnax_destroy(jit);
+    return 0;
+}
@@ -2,15 +2,19 @@
 
 #include "abisnax.h"
 #include "abisnax.hpp"
+#include "abisnax_jit.hpp"
 #include "fuzzer.hpp"
+#include <fstream>
+#include <sstream>
 #include <stdexcept>
 #include <stdio.h>
 #include <string>
+#include <thread>
 #include <vector>
 
 inline const bool generate_corpus = false;
 
-const char tokenHexAbi[] = "0e656f73696f3a3a6162692f312e30010c6163636f756e745f6e616d65046e61"
+const char tokenHexAbi[] = "0d736e61783a3a6162692f312e30010c6163636f756e745f6e616d65046e61"
                            "6d6505087472616e7366657200040466726f6d0c6163636f756e745f6e616d65"
                            "02746f0c6163636f756e745f6e616d65087175616e7469747905617373657404"
                            "6d656d6f06737472696e67066372656174650002066973737565720c6163636f"
@@ -25,7 +29,7 @@ const char tokenHexAbi[] = "0e656f73696f3a3a6162692f312e30010c6163636f756e745f6e
                            "6f756e740000000000904dc603693634010863757272656e6379010675696e74"
                            "36340e63757272656e63795f7374617473000000";
 
-const char testHexAbi[] = "0E656F73696F3A3A6162692F312E310004027331000102783104696E74380273"
+const char testHexAbi[] = "0D736E61783A3A6162692F312E310004027331000102783104696E74380273"
                           "32000202793105696E74382402793205696E7438240273330003027A3105696E"
                           "743824027A3203763124027A3303733224027334000202613106696E74383F24"
                           "02623107696E74385B5D240000000000010276310304696E7438027331027332";
@@ -287,6 +291,17 @@ void run_check_type(abisnax_context* context, uint64_t contract, const char* typ
     printf("%s %s %s %s\n", type, data, reorderable_hex.c_str(), result.c_str());
     if (result != expected)
         throw std::runtime_error("mismatch");
+    auto handle = check_context(context, abisnax_get_type_handle(context, contract, type));
+    std::string compiled_result =
+        check_context(context, abisnax_hex_to_json_handle(context, handle, reorderable_hex.c_str()));
+    if (compiled_result != result)
+        throw std::runtime_error("mismatch between compiled and interpreted bin_to_json");
+    if (check_ordered) {
+        check_context(context, abisnax_json_to_bin_handle(context, handle, data));
+        std::string compiled_hex = check_context(context, abisnax_get_bin_hex(context));
+        if (compiled_hex != reorderable_hex)
+            throw std::runtime_error("mismatch between compiled and interpreted json_to_bin");
+    }
 }
 
 template <typename F>
@@ -391,8 +406,11 @@ void check_types() {
 
     check_error(context, "unsupported abi version",
                 [&] { return abisnax_set_abi(context, 8, R"({"version":"snax::abi/9.0"})"); });
-    abisnax_set_abi(context, 8, R"({"version":"snax::abi/1.0"})");
-    abisnax_set_abi(context, 8, R"({"version":"snax::abi/1.1"})");
+    check_error(context, "unsupported abi version",
+                [&] { return abisnax_set_abi(context, 8, R"({"version":"snax::abi/10.0"})"); });
+    check_context(context, abisnax_set_abi(context, 8, R"({"version":"snax::abi/1.0"})"));
+    check_context(context, abisnax_set_abi(context, 8, R"({"version":"snax::abi/1.2"})"));
+    check_context(context, abisnax_set_abi(context, 8, R"({"version":"snax::abi/1.1"})"));
 
     check_type(context, 0, "bool", R"(true)");
     check_type(context, 0, "bool", R"(false)");
@@ -720,6 +738,11 @@ void check_types() {
             context, 0,
             R"({"version":"snax::abi/1.1","types":[{"new_type_name":"a","type":"int8"},{"new_type_name":"a","type":"int8"}]})");
     });
+    check_error(context, "abi redefines type \"name\"", [&] {
+        return abisnax_set_abi( //
+            context, 0,
+            R"({"version":"snax::abi/1.1","structs":[{"name":"name","base":"","fields":[]}]})");
+    });
 
     check_error(context, "expected object", [&] { return abisnax_json_to_bin(context, testAbiName, "s4", "null"); });
     check_error(context, "expected object", [&] { return abisnax_json_to_bin(context, testAbiName, "s4", "[]"); });
@@ -912,9 +935,1493 @@ void check_types() {
     abisnax_destroy(context);
 }
 
+void check_registry() {
+    auto registry = check(abisnax_registry_create());
+    auto context = check(abisnax_create());
+    auto other = check(abisnax_create());
+    auto testAbiName = check_context(context, abisnax_string_to_name(context, "test.abi"));
+    check(abisnax_registry_set_abi(registry, 0, transactionAbi), abisnax_registry_get_error(registry));
+    check(abisnax_registry_set_abi(registry, testAbiName, testAbi), abisnax_registry_get_error(registry));
+    check(!abisnax_registry_set_abi_hex(registry, 8, ""), "registry set_abi_hex");
+    if (abisnax_registry_get_error(registry) != std::string{"no data"})
+        throw std::runtime_error("registry error mismatch");
+
+    check_context(context, abisnax_context_attach_registry(context, registry));
+    check_context(other, abisnax_context_attach_registry(other, registry));
+    abisnax_registry_release(registry);
+    check(!abisnax_registry_set_abi(registry, 8, testAbi), "registry set_abi after publish");
+    if (abisnax_registry_get_error(registry) != std::string{"registry is published"})
+        throw std::runtime_error("registry error mismatch");
+
+    for (auto* ctx : {context, other}) {
+        run_check_type(ctx, 0, "uint8[]", R"([10,9,8])");
+        run_check_type(ctx, 0, "permission_level", R"({"actor":"useraaaaaaaa","permission":"active"})");
+        run_check_type(ctx, testAbiName, "s4", R"({"a1":null,"b1":[5,6,7]})");
+        run_check_type(ctx, testAbiName, "v1?", R"(["s1",{"x1":6}])");
+    }
+    check_error(context, R"(unknown type "s9")", [&] { return abisnax_hex_to_json(context, testAbiName, "s9", ""); });
+    check_error(context, R"(contract "test.hex" is not loaded)", [&] {
+        return abisnax_json_to_bin(context, abisnax_string_to_name(context, "test.hex"), "int8", "1");
+    });
+
+    // Contracts set on the context take precedence over the registry
+    check_context(other, abisnax_set_abi(other, testAbiName,
+                                         R"({"version":"snax::abi/1.1","types":[{"new_type_name":"s1","type":"int8"}]})"));
+    run_check_type(other, testAbiName, "s1", "7");
+    run_check_type(context, testAbiName, "s1", R"({"x1":7})");
+
+    check_context(other, abisnax_context_attach_registry(other, nullptr));
+    check_error(other, R"(contract "" is not loaded)", [&] { return abisnax_json_to_bin(other, 0, "int8", "1"); });
+
+    abisnax_destroy(other);
+    abisnax_destroy(context);
+}
+
+// Contexts on many threads share a published registry. Each thread also replaces one of the registry's contracts on its
+// own context, which must not affect the others, and destroys its context while the others still use the registry.
+void check_registry_threads() {
+    auto registry = check(abisnax_registry_create());
+    std::vector<abisnax_context*> contexts;
+    for (int i = 0; i < 8; ++i)
+        contexts.push_back(check(abisnax_create()));
+    auto testAbiName = check_context(contexts[0], abisnax_string_to_name(contexts[0], "test.abi"));
+    check(abisnax_registry_set_abi(registry, 0, transactionAbi), abisnax_registry_get_error(registry));
+    check(abisnax_registry_set_abi(registry, testAbiName, testAbi), abisnax_registry_get_error(registry));
+    for (auto* context : contexts)
+        check_context(context, abisnax_context_attach_registry(context, registry));
+    abisnax_registry_release(registry);
+
+    const char* trx = R"({"expiration":"2009-02-13T23:31:31.000","ref_block_num":1234,"ref_block_prefix":5678,)"
+                      R"("max_net_usage_words":0,"max_cpu_usage_ms":0,"delay_sec":0,"context_free_actions":[],)"
+                      R"("actions":[{"account":"snax.token","name":"transfer","authorization":[{"actor":)"
+                      R"("useraaaaaaaa","permission":"active"}],"data":"0000000000855C34"}],)"
+                      R"("transaction_extensions":[]})";
+    std::vector<std::string> errors(contexts.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < contexts.size(); ++t) {
+        threads.emplace_back([&, t] {
+            auto context = contexts[t];
+            auto round_trip = [&](uint64_t contract, const char* type, const std::string& json) {
+                check_context(context, abisnax_json_to_bin(context, contract, type, json.c_str()));
+                std::string hex = check_context(context, abisnax_get_bin_hex(context));
+                if (check_context(context, abisnax_hex_to_json(context, contract, type, hex.c_str())) != json)
+                    throw std::runtime_error("threaded round trip: " + json);
+                auto handle = check_context(context, abisnax_get_type_handle(context, contract, type));
+                if (check_context(context, abisnax_hex_to_json_handle(context, handle, hex.c_str())) != json)
+                    throw std::runtime_error("threaded handle round trip: " + json);
+            };
+            try {
+                auto own = R"({"version":"snax::abi/1.1","types":[{"new_type_name":"s1","type":"uint)" +
+                           std::to_string(t % 2 ? 16 : 32) + R"("}]})";
+                check_context(context, abisnax_set_abi(context, testAbiName, own.c_str()));
+                for (int i = 0; i < 200; ++i) {
+                    round_trip(0, "transaction", trx);
+                    round_trip(0, "permission_level[]",
+                               R"([{"actor":"useraaaaaaaa","permission":")" + std::string(1 + i % 12, 'a' + i % 26) +
+                                   R"("}])");
+                    round_trip(testAbiName, "s1", std::to_string(t * 1000 + i));
+                }
+            } catch (std::exception& e) {
+                errors[t] = e.what();
+            }
+            abisnax_destroy(context);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    for (auto& error : errors)
+        if (!error.empty())
+            throw std::runtime_error(error);
+}
+
+void check_type_handles() {
+    auto registry = check(abisnax_registry_create());
+    auto context = check(abisnax_create());
+    auto token = check_context(context, abisnax_string_to_name(context, "snax.token"));
+    check(abisnax_registry_set_abi(registry, 0, transactionAbi), abisnax_registry_get_error(registry));
+    check_context(context, abisnax_set_abi_hex(context, token, tokenHexAbi));
+    check_context(context, abisnax_context_attach_registry(context, registry));
+    abisnax_registry_release(registry);
+
+    auto transfer = check_context(context, abisnax_get_type_handle(context, token, "transfer"));
+    auto permissions = check_context(context, abisnax_get_type_handle(context, 0, "permission_level[]"));
+    check(transfer == abisnax_get_type_handle(context, token, "transfer"), "same handle");
+    check_error(context, R"(unknown type "foo")", [&] { return abisnax_get_type_handle(context, token, "foo"); });
+    check_error(context, "type handle is null", [&] { return abisnax_bin_to_json_handle(context, nullptr, "", 0); });
+
+    auto check_handle = [&](uint64_t contract, const char* type, const abisnax_type_handle* handle, const char* json) {
+        check_context(context, abisnax_json_to_bin(context, contract, type, json));
+        std::string hex = check_context(context, abisnax_get_bin_hex(context));
+        check_context(context, abisnax_json_to_bin_handle(context, handle, json));
+        check(hex == check_context(context, abisnax_get_bin_hex(context)), "json_to_bin_handle");
+        check_context(context, abisnax_json_to_bin_reorderable_handle(context, handle, json));
+        check(hex == check_context(context, abisnax_get_bin_hex(context)), "json_to_bin_reorderable_handle");
+        check(json == std::string{check_context(context, abisnax_hex_to_json_handle(context, handle, hex.c_str()))},
+              "hex_to_json_handle");
+    };
+    check_handle(token, "transfer", transfer,
+                 R"({"from":"useraaaaaaaa","to":"useraaaaaaab","quantity":"0.0001 SNAX","memo":"x"})");
+    check_handle(0, "permission_level[]", permissions, R"([{"actor":"useraaaaaaaa","permission":"active"}])");
+
+    // Handles remain valid after the registry they came from is detached
+    check_context(context, abisnax_context_attach_registry(context, nullptr));
+    check(std::string{"[]"} == check_context(context, abisnax_hex_to_json_handle(context, permissions, "00")),
+          "detached handle");
+
+    abisnax_destroy(context);
+}
+
+void check_abi_versions() {
+    auto context = check(abisnax_create());
+    auto abi = [](const char* type) {
+        return std::string{R"({"version":"snax::abi/1.1","structs":[{"name":"s","base":"","fields":[)"} +
+               R"({"name":"a","type":")" + type + R"("}]}]})";
+    };
+    auto check_s = [&](const char* hex) {
+        check_context(context, abisnax_json_to_bin(context, 0, "s", R"({"a":1})"));
+        check(std::string{hex} == check_context(context, abisnax_get_bin_hex(context)), "abi version");
+    };
+
+    check_context(context, abisnax_set_abi(context, 0, abi("uint8").c_str()));
+    auto handle = check_context(context, abisnax_get_type_handle(context, 0, "s"));
+    check_s("01");
+
+    // A failed replacement keeps the previous abi
+    check_error(context, R"(unknown type "foo")", [&] { return abisnax_set_abi(context, 0, abi("foo").c_str()); });
+    check_s("01");
+
+    check_context(context, abisnax_set_abi(context, 0, abi("uint16").c_str()));
+    check_s("0100");
+    check(handle != check_context(context, abisnax_get_type_handle(context, 0, "s")), "new handle");
+    check(std::string{"{\"a\":1}"} == check_context(context, abisnax_hex_to_json_handle(context, handle, "01")),
+          "replaced handle");
+
+    // Retired handles remain valid until they're released
+    for (int i = 0; i < 20; ++i) {
+        check_context(context, abisnax_set_abi(context, 0, abi(i % 2 ? "uint16" : "uint8").c_str()));
+        check_context(context, abisnax_get_type_handle(context, 0, "s"));
+    }
+    check(std::string{"{\"a\":1}"} == check_context(context, abisnax_hex_to_json_handle(context, handle, "01")),
+          "handle retired long ago");
+    check_context(context, abisnax_release_type_handle(context, handle));
+    check_error(context, "type handle is not held", [&] { return abisnax_release_type_handle(context, handle); });
+    auto current = check_context(context, abisnax_get_type_handle(context, 0, "s"));
+    check_context(context, abisnax_release_type_handle(context, current));
+    check_context(context, abisnax_release_type_handle(context, current));
+    check_error(context, "type handle is not held", [&] { return abisnax_release_type_handle(context, current); });
+    check_context(context, abisnax_set_abi(context, 0, abi("uint16").c_str()));
+
+    check_context(context, abisnax_set_abi_at_block(context, 0, 100, abi("uint32").c_str()));
+    check_s("01000000");
+    check_context(context, abisnax_set_block(context, 99));
+    check_s("0100");
+    check_context(context, abisnax_set_block(context, 100));
+    check_s("01000000");
+
+    check_context(context, abisnax_set_abi_at_block(context, 0, 50, abi("uint8").c_str()));
+    check_context(context, abisnax_set_block(context, 49));
+    check_s("0100");
+    check_context(context, abisnax_set_block(context, 50));
+    check_s("01");
+
+    // set_abi replaces every version
+    check_context(context, abisnax_set_abi(context, 0, abi("uint16").c_str()));
+    check_s("0100");
+    check_context(context, abisnax_set_block(context, 0xffff'ffff));
+    check_s("0100");
+
+    abisnax_destroy(context);
+}
+
+void check_abi_cache() {
+    auto context = check(abisnax_create());
+    auto token = check_context(context, abisnax_string_to_name(context, "snax.token"));
+    auto test = check_context(context, abisnax_string_to_name(context, "test.hex"));
+
+    struct loader_state {
+        uint64_t token = 0;
+        uint64_t test = 0;
+        std::vector<char> abi{};
+        int loads = 0;
+    } state{token, test};
+    auto loader = [](void* user_data, uint64_t contract, const char** data, size_t* size) -> abisnax_bool {
+        auto& state = *static_cast<loader_state*>(user_data);
+        std::string hex;
+        if (contract == state.token)
+            hex = tokenHexAbi;
+        else if (contract == state.test)
+            hex = testHexAbi;
+        else if (contract == 1)
+            hex = string_to_hex("snax::abi/9.0");
+        else
+            return false;
+        std::string error;
+        state.abi.clear();
+        if (!abisnax::unhex(error, hex.begin(), hex.end(), std::back_inserter(state.abi)))
+            return false;
+        state.loads += contract != 1;
+        *data = state.abi.data();
+        *size = state.abi.size();
+        return true;
+    };
+    check_context(context, abisnax_set_abi_loader(context, loader, &state));
+
+    auto check_token = [&] {
+        check_context(context, abisnax_json_to_bin(context, token, "transfer",
+                                                   R"({"from":"a","to":"b","quantity":"0.0001 SNAX","memo":""})"));
+    };
+    auto check_test = [&] { check_context(context, abisnax_json_to_bin(context, test, "s1", R"({"x1":1})")); };
+
+    check_token();
+    check_test();
+    check(state.loads == 2, "loaded once each");
+    check_token();
+    check_test();
+    check(state.loads == 2, "cached");
+    check_error(context, R"(contract "foo" is not loaded)",
+                [&] { return abisnax_json_to_bin(context, abisnax_string_to_name(context, "foo"), "s1", "{}"); });
+    check_error(context, R"(contract "............1": unsupported abi version)",
+                [&] { return abisnax_json_to_bin(context, 1, "s1", "{}"); });
+
+    // Only the most recently used contract fits
+    auto both = abisnax_get_abi_cache_size(context);
+    check_context(context, abisnax_set_abi_cache_limit(context, both - 1));
+    check(abisnax_get_abi_cache_size(context) < both, "evicted");
+    check_test();
+    check(state.loads == 2, "kept most recently used");
+    check_token();
+    check(state.loads == 3, "reloaded");
+    check_test();
+    check(state.loads == 4, "reloaded");
+
+    // Evicting a contract retires its handles; what was made from them keeps working
+    auto handle = check_context(context, abisnax_get_type_handle(context, test, "s1"));
+    const char* path = "x1";
+    auto projection = check_context(context, abisnax_compile_projection(context, handle, &path, 1));
+    for (int i = 0; i < 20; ++i) {
+        check_context(context, abisnax_get_type_handle(context, token, "transfer"));
+        check_context(context, abisnax_get_type_handle(context, test, "s1"));
+    }
+    check(state.loads == 44, "reloaded");
+    check(abisnax_get_type_handle(context, test, "s1") != handle, "evicted handle");
+    check(std::string{R"({"x1":1})"} ==
+              check_context(context, abisnax_bin_to_json_projection(context, projection, "\x01", 1)),
+          "projection of evicted handle");
+
+    check_context(context, abisnax_set_abi_cache_limit(context, 0));
+    check_token();
+    check(state.loads == 45, "reloaded");
+    check(abisnax_get_abi_cache_size(context) == both, "cache size");
+    check_context(context, abisnax_remove_abi(context, token));
+    check(abisnax_get_abi_cache_size(context) < both, "removed");
+    check_context(context, abisnax_set_abi_loader(context, nullptr, nullptr));
+    check_error(context, R"(contract "snax.token" is not loaded)", [&] {
+        return abisnax_json_to_bin(context, token, "transfer", "{}");
+    });
+
+    abisnax_destroy(context);
+}
+
+void check_lazy_abis() {
+    auto eager = check(abisnax_create());
+    auto lazy = check(abisnax_create());
+    check_context(lazy, abisnax_set_lazy_abis(lazy, true));
+    check_context(eager, abisnax_set_abi(eager, 0, transactionAbi));
+    check_context(lazy, abisnax_set_abi(lazy, 0, transactionAbi));
+
+    auto check_same = [&](const char* type, const char* json) {
+        check_context(eager, abisnax_json_to_bin(eager, 0, type, json));
+        std::string hex = check_context(eager, abisnax_get_bin_hex(eager));
+        check_context(lazy, abisnax_json_to_bin(lazy, 0, type, json));
+        check(hex == check_context(lazy, abisnax_get_bin_hex(lazy)), "lazy json_to_bin");
+        check(json == std::string{check_context(lazy, abisnax_hex_to_json(lazy, 0, type, hex.c_str()))},
+              "lazy hex_to_json");
+    };
+    check_same("transaction",
+               R"({"expiration":"2009-02-13T23:31:31.000","ref_block_num":1234,"ref_block_prefix":5678,)"
+               R"("max_net_usage_words":0,"max_cpu_usage_ms":0,"delay_sec":0,"context_free_actions":[],)"
+               R"("actions":[{"account":"snax.token","name":"transfer","authorization":[{"actor":"useraaaaaaaa",)"
+               R"("permission":"active"}],"data":"0000000000855C34"}],"transaction_extensions":[]})");
+    check_same("permission_level[]", R"([{"actor":"useraaaaaaaa","permission":"active"}])");
+
+    // Errors in types are reported when the type is used
+    const char* abi = R"({"version":"snax::abi/1.1","types":[{"new_type_name":"ext","type":"int8$"}],"structs":[)"
+                      R"({"name":"good","base":"","fields":[{"name":"a","type":"int8"}]},)"
+                      R"({"name":"bad","base":"","fields":[{"name":"a","type":"foo"}]},)"
+                      R"({"name":"bad2","base":"","fields":[{"name":"a","type":"ext"}]},)"
+                      R"({"name":"outer","base":"","fields":[{"name":"f","type":"bad"},{"name":"x","type":"int8"}]}]})";
+    check_error(eager, R"(unknown type "foo")", [&] { return abisnax_set_abi(eager, 1, abi); });
+    check_context(lazy, abisnax_set_abi(lazy, 1, abi));
+    check_context(lazy, abisnax_json_to_bin(lazy, 1, "good", R"({"a":1})"));
+    check_error(lazy, R"(unknown type "foo")", [&] { return abisnax_json_to_bin(lazy, 1, "bad", R"({"a":1})"); });
+    check_error(lazy, R"(unknown type "foo")", [&] { return abisnax_json_to_bin(lazy, 1, "bad", R"({"a":1})"); });
+    check_error(lazy, "can't use extensions ($) within typedefs",
+                [&] { return abisnax_json_to_bin(lazy, 1, "bad2", R"({"a":1})"); });
+    for (int i = 0; i < 2; ++i) {
+        check_error(lazy, R"(unknown type "foo")", [&] { return abisnax_hex_to_json(lazy, 1, "outer", "0107"); });
+        check_error(lazy, R"(unknown type "foo")",
+                    [&] { return abisnax_json_to_bin(lazy, 1, "outer", R"({"f":{"a":1},"x":7})"); });
+    }
+
+    abisnax_destroy(eager);
+    abisnax_destroy(lazy);
+}
+
+void check_const_lookup() {
+    abisnax::abi_def def{};
+    abisnax::contract c{};
+    std::string error;
+    check(abisnax::json_to_native(def, error, testAbi), error.c_str());
+    check(abisnax::fill_contract(c, error, def), error.c_str());
+    auto size = c.abi_types.size();
+
+    std::map<std::string, abisnax::abi_type> scratch;
+    const abisnax::abi_type* t;
+    check(abisnax::get_type(t, error, c.abi_types, scratch, "int8$", 0) && scratch.empty(), "abi derived type");
+    check(abisnax::get_type(t, error, c.abi_types, scratch, "s1[]", 0) && scratch.size() == 1, "ad-hoc derived type");
+    check(t->array_of == &c.abi_types.at("s1"), "ad-hoc derived type");
+    check(!abisnax::get_type(t, error, c.abi_types, scratch, "s1[][]", 0), "nested array");
+    check(c.abi_types.size() == size, "lookups don't modify the contract");
+}
+
+void check_fixed_sizes() {
+    const char* abi = R"({"version":"snax::abi/1.1","types":[{"new_type_name":"account","type":"name"}],"structs":[)"
+                      R"({"name":"transfer","base":"","fields":[{"name":"from","type":"account"},)"
+                      R"({"name":"quantity","type":"asset"},{"name":"ext","type":"extended_asset"}]},)"
+                      R"({"name":"signed","base":"transfer","fields":[{"name":"hash","type":"checksum256"}]},)"
+                      R"({"name":"memo","base":"","fields":[{"name":"from","type":"name"},)"
+                      R"({"name":"s","type":"string"}]},)"
+                      R"({"name":"later","base":"","fields":[{"name":"from","type":"name"},)"
+                      R"({"name":"x","type":"int8$"}]},)"
+                      R"({"name":"self","base":"","fields":[{"name":"a","type":"self"}]},)"
+                      R"({"name":"point","base":"","fields":[{"name":"b","type":"bool"},{"name":"i8","type":"int8"},)"
+                      R"({"name":"u16","type":"uint16"},{"name":"i32","type":"int32"},{"name":"u64","type":"uint64"},)"
+                      R"({"name":"f32","type":"float32"},{"name":"f64","type":"float64"},{"name":"n","type":"name"},)"
+                      R"({"name":"t","type":"transfer"}]}]})";
+    auto check_sizes = [&](abisnax::contract& c, bool lazy) {
+        auto size = [&](const std::string& name) {
+            abisnax::abi_type* t;
+            std::string error;
+            check(abisnax::get_type(t, error, c.abi_types, name, 0), error.c_str());
+            if (lazy)
+                check(abisnax::fill_type(c, error, *t), error.c_str());
+            return t->fixed_size;
+        };
+        check(size("signed") == 80, "fixed size with base");
+        check(size("transfer") == 48, "fixed size");
+        check(size("point") == 84, "fixed size of primitives");
+        check(size("memo") == 0, "variable size");
+        check(size("later") == 0, "extensions have variable size");
+        check(size("self") == 0, "recursive struct");
+        check(size("transfer[]") == 0, "arrays have variable size");
+    };
+    abisnax::abi_def def{};
+    std::string error;
+    check(abisnax::json_to_native(def, error, abi), error.c_str());
+    abisnax::contract eager{};
+    check(abisnax::fill_contract(eager, error, def), error.c_str());
+    check_sizes(eager, false);
+    abisnax::contract lazy{};
+    check(abisnax::fill_contract_lazy(lazy, error, std::move(def)), error.c_str());
+    check_sizes(lazy, true);
+
+    // Fixed-size structs and arrays of them are bounds checked as a whole before any output, by the serializers, the
+    // compiled programs and the jit
+    auto context = check(abisnax_create());
+    auto jit = check(abisnax_create());
+    check_context(context, abisnax_set_abi(context, 0, abi));
+    check_context(jit, abisnax_set_abi(jit, 0, abi));
+    bool use_jit = abisnax_set_jit_threshold(jit, 1);
+    std::vector<std::pair<const char*, size_t>> types{{"transfer", 48}, {"signed", 80}, {"point", 84}};
+    for (auto [type, size] : types) {
+        std::string short_hex((size - 1) * 2, '0');
+        auto handle = check_context(context, abisnax_get_type_handle(context, 0, type));
+        check_error(context, "read past end", [&] { return abisnax_hex_to_json(context, 0, type, short_hex.c_str()); });
+        check_error(context, "read past end",
+                    [&] { return abisnax_hex_to_json_handle(context, handle, short_hex.c_str()); });
+        for (int i = 0; use_jit && i < 3; ++i)
+            check_error(jit, "read past end", [&] { return abisnax_hex_to_json(jit, 0, type, short_hex.c_str()); });
+    }
+    check_error(context, "read past end", [&] { return abisnax_hex_to_json(context, 0, "transfer[]", "03"); });
+    auto short_array = "ffff03" + std::string(96, '0');
+    check_error(context, "read past end",
+                [&] { return abisnax_hex_to_json(context, 0, "transfer[]", short_array.c_str()); });
+    check(check_context(context, abisnax_hex_to_json(context, 0, "transfer", std::string(96, '0').c_str())) ==
+              std::string{R"({"from":"","quantity":"0 ","ext":{"quantity":"0 ","contract":""}})"},
+          "fixed-size struct");
+    const char* point = R"({"b":true,"i8":-1,"u16":2,"i32":-3,"u64":"4","f32":1.5,"f64":-2.5,"n":"alice",)"
+                        R"("t":{"from":"bob","quantity":"1.0000 SYS","ext":{"quantity":"2 X","contract":"c"}}})";
+    check_context(context, abisnax_json_to_bin(context, 0, "point", point));
+    std::string hex = check_context(context, abisnax_get_bin_hex(context));
+    check(hex.size() == 168, "fixed-size struct of primitives");
+    check(check_context(context, abisnax_hex_to_json(context, 0, "point", hex.c_str())) == std::string{point},
+          "fixed-size struct of primitives");
+    for (int i = 0; use_jit && i < 3; ++i)
+        check(check_context(jit, abisnax_hex_to_json(jit, 0, "point", hex.c_str())) == std::string{point},
+              "jit fixed-size struct of primitives");
+    abisnax_destroy(jit);
+    abisnax_destroy(context);
+}
+
+void check_compiled_bin_to_json() {
+    auto context = check(abisnax_create());
+    check_context(context, abisnax_set_abi(context, 0, testAbi));
+
+    // Compare errors too; run_check_type already compares successful conversions
+    auto check_same = [&](const char* type, const std::string& hex) {
+        auto handle = check_context(context, abisnax_get_type_handle(context, 0, type));
+        auto interpreted = abisnax_hex_to_json(context, 0, type, hex.c_str());
+        std::string expected = interpreted ? interpreted : abisnax_get_error(context);
+        auto compiled = abisnax_hex_to_json_handle(context, handle, hex.c_str());
+        std::string result = compiled ? compiled : abisnax_get_error(context);
+        if (result != expected)
+            throw std::runtime_error("compiled bin_to_json: " + result + " != " + expected);
+    };
+    check_same("s1", "");
+    check_same("v1", "03");
+    check_same("v1", "0102");
+    check_same("int8[]", "0201");
+    check_same("s3", "01");
+    check_same("s3", "010201");
+    check_same("s4", "0100");
+    check_same("s4", "00");
+    check_same("s4[]", "0100");
+    check_same("s5", "01020300000000");
+    std::string nested;
+    for (int i = 0; i < 50; ++i)
+        nested += "01020301";
+    check_same("s5", nested);
+    check_error(context, "recursion limit reached", [&] {
+        auto handle = abisnax_get_type_handle(context, 0, "s5");
+        return abisnax_hex_to_json_handle(context, handle, nested.c_str());
+    });
+
+    abisnax_destroy(context);
+}
+
+void check_compiled_json_to_bin() {
+    auto context = check(abisnax_create());
+    check_context(context, abisnax_set_abi(context, 0, testAbi));
+
+    auto check_same = [&](const char* type, const char* json) {
+        auto handle = check_context(context, abisnax_get_type_handle(context, 0, type));
+        std::string expected = abisnax_json_to_bin(context, 0, type, json) ? abisnax_get_bin_hex(context)
+                                                                            : abisnax_get_error(context);
+        std::string result = abisnax_json_to_bin_handle(context, handle, json) ? abisnax_get_bin_hex(context)
+                                                                               : abisnax_get_error(context);
+        if (result != expected)
+            throw std::runtime_error("compiled json_to_bin: " + result + " != " + expected);
+    };
+    check_same("s1", "null");
+    check_same("s1", R"({"x2":1})");
+    check_same("s1", R"({"x1":1,"x2":1})");
+    check_same("s2", R"({"y1":1})");
+    check_same("s2", R"({"y2":1})");
+    check_same("s3", R"({"z1":1,"z2":["s2",{}]})");
+    check_same("s3", R"({"z1":1,"z2":["s2",{"y1":2}]})");
+    check_same("s3", R"({"z1":1,"z2":["s9",{}]})");
+    check_same("s3", R"({"z1":1,"z3":{}})");
+    check_same("s4", R"({"a1":null,"b1":[1,"x"]})");
+    check_same("v1", R"(["s1",{"x1":1},2])");
+    check_same("v1", R"([1,{"x1":1}])");
+    check_same("s5", R"({"x1":9,"x2":10,"x3":{"c1":4,"c2":[{"x1":1}]}})");
+    std::string nested = R"({"x1":1,"x2":2,"x3":{"c1":3,"c2":[)";
+    for (int i = 0; i < 50; ++i)
+        nested += R"({"x1":1,"x2":2,"x3":{"c1":3,"c2":[)";
+    check_same("s5", nested.c_str());
+
+    // Variant alternatives are found through a collision-free table; a repeated name keeps its first index
+    std::string abi = R"({"version":"snax::abi/1.1","types":[)";
+    std::string alternatives;
+    for (int i = 0; i < 100; ++i) {
+        abi += std::string{i ? "," : ""} + R"({"new_type_name":"t)" + std::to_string(i) + R"(","type":"uint8"})";
+        alternatives += "\"t" + std::to_string(i) + "\",";
+    }
+    abi += R"(],"variants":[{"name":"many","types":[)" + alternatives + R"("t5"]}]})";
+    check_context(context, abisnax_set_abi(context, 1, abi.c_str()));
+    auto many = check_context(context, abisnax_get_type_handle(context, 1, "many"));
+    for (int i = 0; i < 100; ++i) {
+        auto json = R"(["t)" + std::to_string(i) + R"(",7])";
+        check_context(context, abisnax_json_to_bin_handle(context, many, json.c_str()));
+        char hex[5];
+        snprintf(hex, sizeof(hex), "%02X07", i);
+        check(abisnax_get_bin_hex(context) == std::string{hex}, "variant alternative");
+    }
+    for (auto* json : {R"(["t100",7])", R"(["t",7])", R"(["",7])", R"(["t05",7])"})
+        check_error(context, "<variant>: type is not valid for this variant",
+                    [&] { return abisnax_json_to_bin_handle(context, many, json); });
+
+    abisnax_destroy(context);
+}
+
+void check_jit() {
+    auto context = check(abisnax_create());
+    if (!abisnax_set_jit_threshold(context, 2)) {
+        check(abisnax_get_error(context) == std::string{"jit is not supported on this platform"}, "jit error");
+        abisnax_destroy(context);
+        return;
+    }
+    auto interpreted = check(abisnax_create());
+    auto test = abisnax_string_to_name(context, "test.abi");
+    for (auto* c : {context, interpreted}) {
+        check_context(c, abisnax_set_abi(c, 0, transactionAbi));
+        check_context(c, abisnax_set_abi(c, test, testAbi));
+    }
+
+    // Native code takes over after the second use of a type; compare all three uses, including errors
+    auto check_same = [&](uint64_t contract, const char* type, const std::string& hex) {
+        auto expected = abisnax_hex_to_json(interpreted, contract, type, hex.c_str());
+        std::string expected_result = expected ? expected : abisnax_get_error(interpreted);
+        for (int i = 0; i < 3; ++i) {
+            auto result = abisnax_hex_to_json(context, contract, type, hex.c_str());
+            if ((result ? result : abisnax_get_error(context)) != expected_result)
+                throw std::runtime_error("jit bin_to_json: " + std::string{result ? result : abisnax_get_error(context)} +
+                                         " != " + expected_result);
+        }
+    };
+    auto check_json = [&](uint64_t contract, const char* type, const char* json) {
+        check_context(interpreted, abisnax_json_to_bin(interpreted, contract, type, json));
+        check_same(contract, type, check_context(interpreted, abisnax_get_bin_hex(interpreted)));
+    };
+    check_json(0, "permission_level[]", R"([{"actor":"useraaaaaaaa","permission":"active"}])");
+    check_json(0, "transaction", R"({"expiration":"2009-02-13T23:31:31.000","ref_block_num":1234,)"
+                                 R"("ref_block_prefix":5678,"max_net_usage_words":0,"max_cpu_usage_ms":0,)"
+                                 R"("delay_sec":0,"context_free_actions":[],"actions":[{"account":"snax.token",)"
+                                 R"("name":"transfer","authorization":[{"actor":"useraaaaaaaa","permission":)"
+                                 R"("active"}],"data":"00"}],"transaction_extensions":[]})");
+    check_json(test, "s3", R"({"z1":1,"z2":["s2",{"y1":2,"y2":3}],"z3":{"y1":4}})");
+    check_json(test, "s4", R"({"a1":null,"b1":[5,6,7]})");
+    check_json(test, "s4[]", R"([{"a1":1,"b1":[]},{"a1":null,"b1":[1]}])");
+    check_json(test, "v1[]", R"([["int8",7],["s1",{"x1":6}]])");
+    check_json(test, "s5", R"({"x1":1,"x2":2,"x3":{"c1":3,"c2":[{"x1":4,"x2":5,"x3":{"c1":6,"c2":[],"c3":7}}],)"
+                           R"("c3":8}})");
+    check_same(test, "s1", "");
+    check_same(test, "v1", "03");
+    check_same(test, "v1", "0102");
+    check_same(test, "s3", "010201");
+    check_same(test, "s4", "0100");
+    check_same(test, "s4[]", "0100");
+    std::string nested;
+    for (int i = 0; i < 50; ++i)
+        nested += "01020301";
+    check_same(test, "s5", nested);
+
+    // Exceptions thrown while native code runs reach the caller
+    struct throwing_serializer : abisnax::abi_serializer {
+        bool json_to_bin(abisnax::jvalue_to_bin_state&, bool, const abisnax::abi_type*, abisnax::event_type,
+                         bool) const override {
+            return false;
+        }
+        bool json_to_bin(abisnax::json_to_bin_state&, bool, const abisnax::abi_type*, abisnax::event_type,
+                         bool) const override {
+            return false;
+        }
+        bool bin_to_json(abisnax::bin_to_json_state&, bool, const abisnax::abi_type*, bool) const override {
+            throw std::runtime_error("leaf threw");
+        }
+    } ser;
+    abisnax::abi_type leaf;
+    leaf.name = "leaf";
+    leaf.ser = &ser;
+    abisnax::bin_to_json_program program;
+    abisnax::compile_bin_to_json(program, &leaf);
+    abisnax::bin_to_json_jit_code code;
+    std::string error;
+    check(abisnax::jit_bin_to_json(code, error, program), "jit_bin_to_json");
+    abisnax::input_buffer bin{};
+    std::string json;
+    abisnax::json_output_stream stream{json};
+    try {
+        (void)abisnax::bin_to_json(bin, error, &code, stream);
+        error = "no exception";
+    } catch (std::runtime_error& e) {
+        error = e.what();
+    }
+    check(error == "leaf threw", "jit exception");
+
+    abisnax_destroy(interpreted);
+    abisnax_destroy(context);
+}
+
+// Generated by abisnax-gen from test_codecs_abi.json; see CMakeLists.txt
+extern const abisnax_codec test_codecs[];
+extern const size_t test_num_codecs;
+
+void check_codecs() {
+    std::ifstream in(TEST_CODECS_ABI);
+    std::stringstream abi;
+    abi << in.rdbuf();
+    auto interpreted = check(abisnax_create());
+    auto generated = check(abisnax_create());
+    check_context(interpreted, abisnax_set_abi(interpreted, 0, abi.str().c_str()));
+    check_context(generated, abisnax_set_abi(generated, 0, abi.str().c_str()));
+    check_context(generated, abisnax_add_codecs(generated, test_codecs, test_num_codecs));
+
+    // Both successful conversions and errors must match
+    auto result = [](abisnax_context* context, const char* s) {
+        return std::string{s ? s : abisnax_get_error(context)};
+    };
+    auto check_hex = [&](const char* type, const std::string& hex) {
+        auto expected = result(interpreted, abisnax_hex_to_json(interpreted, 0, type, hex.c_str()));
+        auto actual = result(generated, abisnax_hex_to_json(generated, 0, type, hex.c_str()));
+        if (actual != expected)
+            throw std::runtime_error("codec bin_to_json: " + actual + " != " + expected);
+    };
+    auto check_json = [&](const char* type, const char* json) {
+        auto to_hex = [&](abisnax_context* context, auto convert) {
+            return result(context, convert(context, 0, type, json) ? abisnax_get_bin_hex(context) : nullptr);
+        };
+        auto expected = to_hex(interpreted, abisnax_json_to_bin);
+        auto actual = to_hex(generated, abisnax_json_to_bin);
+        if (actual != expected)
+            throw std::runtime_error("codec json_to_bin: " + actual + " != " + expected);
+        expected = to_hex(interpreted, abisnax_json_to_bin_reorderable);
+        actual = to_hex(generated, abisnax_json_to_bin_reorderable);
+        if (actual != expected)
+            throw std::runtime_error("codec json_to_bin_reorderable: " + actual + " != " + expected);
+        check_hex(type, expected);
+    };
+    check_json("s1", R"({"x1":5})");
+    check_json("s1", "{}");
+    check_json("s1", "null");
+    check_json("s1", R"({"x1":"a"})");
+    check_hex("s1", "");
+    check_json("s2", R"({"y1":1})");
+    check_json("s2", R"({"y2":1})");
+    check_json("s2", "{}");
+    check_hex("s2", "0102");
+    check_json("s3", R"({"z1":1,"z2":["s1",{"x1":2}],"z3":{"y1":1}})");
+    check_json("s3", R"({"z1":1,"z3":{}})");
+    check_json("s3", R"({"z1":1,"z2":["s9",{}]})");
+    check_json("s3", R"({"z3":{"y2":2,"y1":1},"z1":1})");
+    check_hex("s3", "0103");
+    check_hex("s3", "010201");
+    check_json("s4", R"({"a1":null,"b1":[5,6,7]})");
+    check_json("s4", R"({"a1":5,"b1":[1,"x"]})");
+    check_json("s4", R"({"b1":[]})");
+    check_json("s5", R"({"x1":1,"x2":2,"x3":{"c1":3,"c2":[{"x1":4,"x2":5,"x3":{"c1":6,"c2":[],"c3":7}}],"c3":8}})");
+    check_json("s5", R"({"x1":1,"x2":2,"x3":{"c1":3,"c2":[{"x1":4,"x2":5,"x3":{"c1":6,"c2":{}}}]}})");
+    std::string nested;
+    for (int i = 0; i < 50; ++i)
+        nested += "01020301";
+    check_hex("s5", nested);
+    check_json("v1", R"(["s2",{"y1":1}])");
+    check_json("v1", R"(["x",1])");
+    check_json("v1", "[1,2]");
+    check_json("v1", R"(["int8",7,5])");
+    check_hex("v1", "03");
+    check_json("int8[]", "[1,2,3]");
+    check_json("int8[]", "[[]]");
+    check_json("extended_asset", R"({"quantity":"1.0000 SYS","contract":"snax.token"})");
+    check_json("fixed", R"({"b":true,"i16":-2,"u64":"5","f32":0.5,"n":"alice","sym":"4,SYS",)"
+                        R"("ext":{"quantity":"1.0000 SYS","contract":"bob"}})");
+    check_hex("fixed", std::string(2 * 54, '1'));
+    check_hex("fixed", std::string(2 * 55, '1'));
+    std::string leaves = R"({"b":true,"u8":1,"i16":-2,"u32":3,"i64":"-4","u64":"5","vu":6,"f64":1.5,"n":"alice",)"
+                         R"("s":"hi","data":"0A0B","hash":")" +
+                         std::string(64, 'A') +
+                         R"(","sym":"4,SYS","qty":"1.0000 SYS","ext":{"quantity":"1.0000 SYS","contract":"bob"},)"
+                         R"("when":"2020-01-01T00:00:00.000","at":"2020-01-01T00:00:00","maybe":null,)"
+                         R"("names":["a","b"])";
+    check_json("leaves", (leaves + "}").c_str());
+    check_json("leaves", (leaves + R"(,"more":[["s1",{"x1":1}]]})").c_str());
+    check_json("leaves", (leaves + R"(,"more":{}})").c_str());
+
+    // Codecs only apply to types with the same name and shape
+    abisnax::contract c;
+    std::string error;
+    abisnax::abi_def def;
+    check(abisnax::json_to_native(def, error, abi.str()) && abisnax::fill_contract(c, error, def), "fill_contract");
+    abisnax::json_to_bin_program program;
+    abisnax::compile_json_to_bin(program, &c.abi_types.at("s1"));
+    abisnax::generated_codec marker{
+        "s1", abisnax::get_shape_hash(&c.abi_types.at("s1")),
+        [](abisnax::bin_to_json_state& state) { return state.writer.String("codec"); },
+        [](abisnax::json_to_bin_state& state, uint32_t, bool, abisnax::event_type, bool) {
+            return abisnax::set_error(state, "codec");
+        },
+        uint32_t(program.nodes.size())};
+    std::vector<abisnax_codec> codecs(2, abisnax_codec{marker});
+    codecs[1].type = "s2";
+    check_context(interpreted, abisnax_add_codecs(interpreted, codecs.data(), codecs.size()));
+    check(result(interpreted, abisnax_hex_to_json(interpreted, 0, "s1", "")) == R"("codec")", "codec is used");
+    check(!abisnax_json_to_bin(interpreted, 0, "s1", R"({"x1":5})") &&
+              result(interpreted, nullptr) == "codec",
+          "json_to_bin codec is used");
+    check(result(interpreted, abisnax_hex_to_json(interpreted, 0, "s2", "")) == "{}", "codec shape mismatch");
+    check_context(interpreted, abisnax_json_to_bin(interpreted, 0, "s2", R"({"y1":1})"));
+
+    auto handle = check_context(generated, abisnax_get_type_handle(generated, 0, "s1"));
+    check_context(generated, abisnax_add_codecs(generated, codecs.data(), codecs.size()));
+    check(abisnax_get_type_handle(generated, 0, "s1") != handle, "handles are retired");
+    check(result(generated, abisnax_hex_to_json(generated, 0, "s1", "05")) == R"({"x1":5})", "earlier codec is used");
+
+    abisnax_destroy(interpreted);
+    abisnax_destroy(generated);
+}
+
+void check_validate() {
+    auto context = check(abisnax_create());
+    check_context(context, abisnax_set_abi(context, 0, testAbi));
+    check_context(context, abisnax_set_abi(context, 1, transactionAbi));
+
+    // Accept and reject what bin_to_json does, with the same errors
+    auto check_same = [&](uint64_t contract, const char* type, const std::string& hex) {
+        std::vector<char> data;
+        std::string error;
+        check(abisnax::unhex(error, hex.begin(), hex.end(), std::back_inserter(data)), "bad hex");
+        auto json = abisnax_bin_to_json(context, contract, type, data.data(), data.size());
+        std::string expected = json ? "ok" : abisnax_get_error(context);
+        bool extra = expected == "Extra data";
+        if (extra)
+            expected = "ok";
+        size_t consumed = 0;
+        auto ok = abisnax_bin_validate(context, contract, type, data.data(), data.size(), &consumed);
+        std::string result = ok ? "ok" : abisnax_get_error(context);
+        if (result != expected)
+            throw std::runtime_error("validate " + std::string{type} + " " + hex + ": " + result + " != " + expected);
+        check(!ok || (consumed < data.size()) == extra, "validate consumed");
+        auto handle = check_context(context, abisnax_get_type_handle(context, contract, type));
+        check(abisnax_bin_validate_handle(context, handle, data.data(), data.size(), nullptr) == ok,
+              "validate handle");
+    };
+    check_same(0, "s1", "");
+    check_same(0, "s1", "01");
+    check_same(0, "v1", "03");
+    check_same(0, "v1", "0102");
+    check_same(0, "v1", "0001");
+    check_same(0, "int8[]", "0201");
+    check_same(0, "int8[]", "020102");
+    check_same(0, "int8[]", "ffffffff0f01");
+    check_same(0, "s3", "01");
+    check_same(0, "s3", "010201");
+    check_same(0, "s4", "0100");
+    check_same(0, "s4", "00");
+    check_same(0, "s4[]", "0100");
+    check_same(0, "s5", "01020300000000");
+    check_same(0, "s5", "010203010203");
+    std::string nested;
+    for (int i = 0; i < 50; ++i)
+        nested += "01020301";
+    check_same(0, "s5", nested);
+    check_same(1, "string", "0361626364");
+    check_same(1, "string", "0461626364");
+    check_same(1, "bytes", "0461626364");
+    check_same(1, "varuint32", "ffffffffff");
+    check_same(1, "name[]", "020000000000000000");
+    check_same(1, "asset?", "01000000000000000004534e415800000000");
+    check_same(1, "public_key", "00");
+
+    check_context(context, abisnax_json_to_bin(context, 1, "transaction",
+                                               R"({"expiration":"2009-02-13T23:31:31.000","ref_block_num":1234,)"
+                                               R"("ref_block_prefix":5678,"max_net_usage_words":0,)"
+                                               R"("max_cpu_usage_ms":0,"delay_sec":0,"context_free_actions":[],)"
+                                               R"("actions":[{"account":"snax.token","name":"transfer",)"
+                                               R"("authorization":[{"actor":"useraaaaaaaa","permission":"active"}],)"
+                                               R"("data":"0000000000855C34"}],"transaction_extensions":[]})"));
+    std::string hex = check_context(context, abisnax_get_bin_hex(context));
+    for (size_t size = 0; size <= hex.size(); size += 2)
+        check_same(1, "transaction", hex.substr(0, size));
+
+    // Data after the value is left for the caller
+    std::string data = "\x01\x02\x03";
+    size_t consumed = 0;
+    check_context(context, abisnax_bin_validate(context, 0, "s1", data.data(), data.size(), &consumed));
+    check(consumed == 1, "validate consumed");
+
+    abisnax_destroy(context);
+}
+
+void check_projections() {
+    auto context = check(abisnax_create());
+    check_context(context, abisnax_set_abi(context, 0, testAbi));
+    check_context(context, abisnax_set_abi(context, 1, transactionAbi));
+
+    auto check_projection = [&](uint64_t contract, const char* type, std::vector<const char*> paths,
+                                const char* json, const char* expected) {
+        auto handle = check_context(context, abisnax_get_type_handle(context, contract, type));
+        auto projection =
+            check_context(context, abisnax_compile_projection(context, handle, paths.data(), paths.size()));
+        check_context(context, abisnax_json_to_bin(context, contract, type, json));
+        std::string bin{abisnax_get_bin_data(context), size_t(abisnax_get_bin_size(context))};
+        std::string result =
+            check_context(context, abisnax_bin_to_json_projection(context, projection, bin.data(), bin.size()));
+        if (result != expected)
+            throw std::runtime_error("projection: " + result + " != " + expected);
+    };
+    const char* trx = R"({"expiration":"2009-02-13T23:31:31.000","ref_block_num":1234,"ref_block_prefix":5678,)"
+                      R"("max_net_usage_words":0,"max_cpu_usage_ms":0,"delay_sec":0,"context_free_actions":[],)"
+                      R"("actions":[{"account":"snax.token","name":"transfer",)"
+                      R"("authorization":[{"actor":"useraaaaaaaa","permission":"active"}],)"
+                      R"("data":"0000000000855C34"},{"account":"snax","name":"newaccount",)"
+                      R"("authorization":[],"data":""}],"transaction_extensions":[{"type":1,"data":"00"}]})";
+    check_projection(1, "transaction", {"actions[].account", "actions[].name"}, trx,
+                     R"({"actions":[{"account":"snax.token","name":"transfer"},)"
+                     R"({"account":"snax","name":"newaccount"}]})");
+    check_projection(1, "transaction", {"transaction_extensions", "expiration", "actions[].authorization[].actor"},
+                     trx,
+                     R"({"expiration":"2009-02-13T23:31:31.000",)"
+                     R"("actions":[{"authorization":[{"actor":"useraaaaaaaa"}]},{"authorization":[]}],)"
+                     R"("transaction_extensions":[{"type":1,"data":"00"}]})");
+    check_projection(1, "transaction", {"actions", "actions[].name"}, trx,
+                     R"({"actions":[{"account":"snax.token","name":"transfer",)"
+                     R"("authorization":[{"actor":"useraaaaaaaa","permission":"active"}],)"
+                     R"("data":"0000000000855C34"},{"account":"snax","name":"newaccount",)"
+                     R"("authorization":[],"data":""}]})");
+    check_projection(1, "action[]", {"[].data"}, R"([{"account":"a","name":"b","authorization":[],"data":"01"}])",
+                     R"([{"data":"01"}])");
+    check_projection(0, "s5", {"x3.c2[].x3.c3", "x2"}, R"({"x1":1,"x2":2,"x3":{"c1":3,"c2":[{"x1":4,"x2":5,)"
+                                                       R"("x3":{"c1":6,"c2":[],"c3":7}}],"c3":8}})",
+                     R"({"x2":2,"x3":{"c2":[{"x3":{"c3":7}}]}})");
+    check_projection(0, "s4", {"b1"}, R"({})", R"({})");
+    check_projection(0, "s4", {"b1"}, R"({"a1":null,"b1":[1]})", R"({"b1":[1]})");
+    check_projection(0, "s3", {"z3.y2"}, R"({"z1":1,"z2":["s2",{"y1":1,"y2":2}],"z3":{"y1":2,"y2":3}})",
+                     R"({"z3":{"y2":3}})");
+
+    auto handle = check_context(context, abisnax_get_type_handle(context, 1, "transaction"));
+    auto check_compile_error = [&](const char* expected, const char* path) {
+        check_error(context, expected, [&] { return abisnax_compile_projection(context, handle, &path, 1); });
+    };
+    check_compile_error(R"(type "action" has no field "nme")", "actions[].nme");
+    check_compile_error(R"(can't select "foo" in type "time_point_sec")", "expiration.foo");
+    check_compile_error(R"(can't select "[]" in type "transaction")", "[].actions");
+    check_compile_error(R"(can't select "account" in type "action[]")", "actions.account");
+    check_compile_error(R"(invalid projection path "actions..name")", "actions..name");
+    check_compile_error(R"(invalid projection path "")", "");
+    check_error(context, "projection has no paths",
+                [&] { return abisnax_compile_projection(context, handle, nullptr, 0); });
+
+    // Data the projection skips is still checked
+    const char* paths[] = {"expiration"};
+    auto projection = check_context(context, abisnax_compile_projection(context, handle, paths, 1));
+    check_error(context, "read past end",
+                [&] { return abisnax_bin_to_json_projection(context, projection, "\0\0\0\0\0\0", 6); });
+
+    // Destroyed projections leave the context, and the others keep working
+    for (int i = 0; i < 1000; ++i) {
+        auto p = check_context(context, abisnax_compile_projection(context, handle, paths, 1));
+        check_context(context, abisnax_destroy_projection(context, p));
+        check_error(context, "unknown projection", [&] { return abisnax_destroy_projection(context, p); });
+    }
+    check_error(context, "read past end",
+                [&] { return abisnax_bin_to_json_projection(context, projection, "\0\0\0\0\0\0", 6); });
+
+    abisnax_destroy(context);
+}
+
+void check_predicates() {
+    auto context = check(abisnax_create());
+    const char* abi = R"({"version":"snax::abi/1.1","structs":[)"
+                      R"({"name":"transfer","base":"","fields":[{"name":"from","type":"name"},)"
+                      R"({"name":"to","type":"name"},{"name":"quantity","type":"asset"},)"
+                      R"({"name":"memo","type":"string"}]},)"
+                      R"({"name":"notify","base":"","fields":[{"name":"id","type":"uint64"},)"
+                      R"({"name":"n","type":"int8"},{"name":"flag","type":"bool"},{"name":"t","type":"transfer?"},)"
+                      R"({"name":"ext","type":"int32$"}]}]})";
+    check_context(context, abisnax_set_abi(context, 0, abi));
+    auto transfer = check_context(context, abisnax_get_type_handle(context, 0, "transfer"));
+    auto notify = check_context(context, abisnax_get_type_handle(context, 0, "notify"));
+
+    auto check_match = [&](const abisnax_type_handle* type, const char* predicate, const char* json, int expected) {
+        auto p = check_context(context, abisnax_compile_predicate(context, type, predicate));
+        check_context(context, abisnax_json_to_bin_handle(context, type, json));
+        std::string bin{abisnax_get_bin_data(context), size_t(abisnax_get_bin_size(context))};
+        if (abisnax_match_predicate(context, p, bin.data(), bin.size()) != expected)
+            throw std::runtime_error(std::string{"predicate "} + predicate + " on " + json + " != " +
+                                     std::to_string(expected));
+    };
+    const char* trx = R"({"from":"useraaaaaaaa","to":"useraaaaaaab","quantity":"1.0000 SNAX","memo":"hi"})";
+    check_match(transfer, R"(to == "useraaaaaaab" && quantity.symbol == "4,SNAX")", trx, 1);
+    check_match(transfer, R"(to == "useraaaaaaac" && quantity.symbol == "4,SNAX")", trx, 0);
+    check_match(transfer, R"(to == "useraaaaaaab" && quantity.symbol == "4,SYS")", trx, 0);
+    check_match(transfer, R"(from == "useraaaaaaab" || to == "useraaaaaaab")", trx, 1);
+    check_match(transfer, R"(quantity == "1.0000 SNAX" && quantity != "1.0000 SYS")", trx, 1);
+    check_match(transfer, R"(quantity.amount > 5000 && quantity.amount <= 10000)", trx, 1);
+    check_match(transfer, R"((from == "a" || quantity.amount >= 10000) && (to == "b" || quantity.amount < 10001))",
+                trx, 1);
+    check_match(transfer, R"(from == "a" || to == "b" && quantity.amount > 0)", trx, 0);
+
+    const char* n = R"({"id":7,"n":-5,"flag":true,"t":null})";
+    check_match(notify, "id == 7 && n < -1 && n >= -5 && flag == true", n, 1);
+    check_match(notify, "id != 7 || n > 0 || flag == false", n, 0);
+    check_match(notify, R"(t.to == "useraaaaaaab" || t.to != "useraaaaaaab" || ext == 0 || ext != 0)", n, 0);
+    check_match(notify, R"(t.to == "useraaaaaaab" && ext == -1)",
+                R"({"id":7,"n":-5,"flag":true,"t":{"from":"","to":"useraaaaaaab","quantity":"0 ","memo":""},"ext":-1})",
+                1);
+
+    auto check_compile_error = [&](const abisnax_type_handle* type, const std::string& expected,
+                                   const char* predicate) {
+        check_error(context, expected, [&] { return abisnax_compile_predicate(context, type, predicate); });
+    };
+    check_compile_error(transfer, R"(invalid predicate "to < "a"": "to" only supports == and !=)", R"(to < "a")");
+    check_compile_error(transfer, R"(invalid predicate "memo == "x"": can't compare "memo" of type "string")",
+                        R"(memo == "x")");
+    check_compile_error(transfer, R"(invalid predicate "nope == 1": type "transfer" has no field "nope")",
+                        "nope == 1");
+    check_compile_error(transfer, R"(invalid predicate "to.x == 1": can't select "x" in type "name")", "to.x == 1");
+    check_compile_error(notify, R"(invalid predicate "n == "a"": invalid value "a" for "n": invalid number)",
+                        R"(n == "a")");
+    check_compile_error(notify, R"(invalid predicate "id == ": expected value at offset 6)", "id == ");
+    check_compile_error(notify, R"(invalid predicate "(id == 1": expected ) at offset 8)", "(id == 1");
+    check_compile_error(notify, R"(invalid predicate "id == 1 x": unexpected text at offset 8)", "id == 1 x");
+    check_compile_error(notify, R"(invalid predicate "id = 1": expected comparison at offset 3)", "id = 1");
+    check_compile_error(notify, R"(invalid predicate "id..x == 1": invalid path "id..x")", "id..x == 1");
+
+    // Only fields up to the last one used are read
+    auto p = check_context(context, abisnax_compile_predicate(context, transfer, R"(to == "useraaaaaaab")"));
+    check_context(context, abisnax_json_to_bin_handle(context, transfer, trx));
+    std::string bin{abisnax_get_bin_data(context), size_t(abisnax_get_bin_size(context))};
+    check(abisnax_match_predicate(context, p, bin.data(), 16) == 1, "predicate reads past the last field used");
+    check(abisnax_match_predicate(context, p, bin.data(), 15) == -1, "predicate on truncated data");
+    check(abisnax_get_error(context) == std::string{"read past end"}, "predicate error");
+
+    // Destroyed predicates leave the context, and the others keep working
+    for (int i = 0; i < 1000; ++i) {
+        auto q = check_context(context, abisnax_compile_predicate(context, notify, "n == 1"));
+        check_context(context, abisnax_destroy_predicate(context, q));
+        check_error(context, "unknown predicate", [&] { return abisnax_destroy_predicate(context, q); });
+    }
+    check(abisnax_match_predicate(context, p, bin.data(), 16) == 1, "predicate after others are destroyed");
+
+    abisnax_destroy(context);
+}
+
+void check_bin_index() {
+    auto context = check(abisnax_create());
+    check_context(context, abisnax_set_abi(context, 0, transactionAbi));
+    const char* abi = R"({"version":"snax::abi/1.1","structs":[)"
+                      R"({"name":"v","base":"","fields":[{"name":"a","type":"uint16[]"},{"name":"o","type":"string?"},)"
+                      R"({"name":"w","type":"var"},{"name":"e","type":"int32$"}]},)"
+                      R"({"name":"empty","base":"","fields":[]},)"
+                      R"({"name":"empties","base":"","fields":[{"name":"a","type":"empty"},)"
+                      R"({"name":"b","type":"empty"}]}],)"
+                      R"("variants":[{"name":"var","types":["uint8","string"]}]})";
+    check_context(context, abisnax_set_abi(context, 1, abi));
+    auto index = check_context(context, abisnax_create_bin_index(context));
+
+    auto index_json = [&](uint64_t contract, const char* type, const char* json) {
+        auto handle = check_context(context, abisnax_get_type_handle(context, contract, type));
+        check_context(context, abisnax_json_to_bin_handle(context, handle, json));
+        std::string bin{abisnax_get_bin_data(context), size_t(abisnax_get_bin_size(context))};
+        check_context(context, abisnax_index_bin(context, index, handle, bin.data(), bin.size()));
+        return std::make_pair(handle, bin);
+    };
+    auto check_part = [&](std::vector<uint32_t> path, const char* type, int64_t count, const std::string& json) {
+        std::string t = check_context(context, abisnax_bin_index_type(context, index, path.data(), path.size()));
+        auto c = abisnax_bin_index_count(context, index, path.data(), path.size());
+        std::string j = check_context(context, abisnax_bin_index_to_json(context, index, path.data(), path.size()));
+        if (t != type || c != count || j != json)
+            throw std::runtime_error("bin index: " + t + " " + std::to_string(c) + " " + j + " != " + type + " " +
+                                     std::to_string(count) + " " + json);
+    };
+    auto check_part_error = [&](std::vector<uint32_t> path, const std::string& expected) {
+        check_error(context, expected,
+                    [&] { return abisnax_bin_index_to_json(context, index, path.data(), path.size()); });
+    };
+
+    const char* trx = R"({"expiration":"2009-02-13T23:31:31.000","ref_block_num":1234,"ref_block_prefix":5678,)"
+                      R"("max_net_usage_words":0,"max_cpu_usage_ms":0,"delay_sec":0,"context_free_actions":[],)"
+                      R"("actions":[{"account":"snax.token","name":"transfer",)"
+                      R"("authorization":[{"actor":"useraaaaaaaa","permission":"active"}],)"
+                      R"("data":"0000000000855C34"},{"account":"snax","name":"newaccount",)"
+                      R"("authorization":[],"data":""}],"transaction_extensions":[]})";
+    auto indexed = index_json(0, "transaction", trx);
+    auto handle = indexed.first;
+    auto& bin = indexed.second;
+    check_part({}, "transaction", 9, trx);
+    check_part({0}, "time_point_sec", 0, R"("2009-02-13T23:31:31.000")");
+    check_part({6}, "action[]", 0, "[]");
+    check_part({7}, "action[]", 2, R"([{"account":"snax.token","name":"transfer",)"
+                                   R"("authorization":[{"actor":"useraaaaaaaa","permission":"active"}],)"
+                                   R"("data":"0000000000855C34"},{"account":"snax","name":"newaccount",)"
+                                   R"("authorization":[],"data":""}])");
+    check_part({7, 1, 1}, "name", 0, R"("newaccount")");
+    check_part({7, 0, 2, 0}, "permission_level", 2, R"({"actor":"useraaaaaaaa","permission":"active"})");
+    check_part({7, 0, 2, 0, 1}, "name", 0, R"("active")");
+    check_part({7, 0, 3}, "bytes", 0, R"("0000000000855C34")");
+    check_part_error({7, 2}, "action[] has no child 2");
+    check_part_error({0, 0}, "time_point_sec has no child 0");
+
+    std::vector<uint32_t> path{7, 0, 2, 0, 1};
+    const char* data = nullptr;
+    size_t size = 0;
+    check_context(context, abisnax_bin_index_get_bin(context, index, path.data(), path.size(), &data, &size));
+    check_context(context, abisnax_json_to_bin(context, 0, "name", R"("active")"));
+    check(size == 8 && !memcmp(data, abisnax_get_bin_data(context), 8), "bin index get_bin");
+    path = {};
+    check_context(context, abisnax_bin_index_get_bin(context, index, path.data(), path.size(), &data, &size));
+    check(std::string{data, size} == bin, "bin index get_bin of the whole value");
+
+    index_json(1, "v", R"({"a":[1,2,3],"o":null,"w":["string","hi"]})");
+    check_part({}, "v", 3, R"({"a":[1,2,3],"o":null,"w":["string","hi"]})");
+    check_part({0, 2}, "uint16", 0, "3");
+    check_part({1}, "string?", 0, "null");
+    check_part({2}, "var", 1, R"(["string","hi"])");
+    check_part({2, 0}, "string", 0, R"("hi")");
+    check_part_error({1, 0}, "optional is empty");
+    check_part_error({3}, R"(field "e" is absent)");
+    check_part_error({2, 1}, "var has no child 1");
+    index_json(1, "v", R"({"a":[],"o":"x","w":["uint8",7],"e":-1})");
+    check_part({}, "v", 4, R"({"a":[],"o":"x","w":["uint8",7],"e":-1})");
+    check_part({1, 0}, "string", 0, R"("x")");
+    check_part({3}, "int32", 0, "-1");
+
+    // Items which take no bytes get no entries, however many there are
+    index_json(1, "empties[]", R"([{"a":{},"b":{}},{"a":{},"b":{}}])");
+    check_part({}, "empties[]", 2, R"([{"a":{},"b":{}},{"a":{},"b":{}}])");
+    check_part({1}, "empties", 2, R"({"a":{},"b":{}})");
+    check_part({1, 1}, "empty", 0, "{}");
+    auto empties = check_context(context, abisnax_get_type_handle(context, 1, "empty[]"));
+    check_context(context, abisnax_index_bin(context, index, empties, "\xff\xff\xff\xff\x0f", 5));
+    check_part({4000000000}, "empty", 0, "{}");
+    check(abisnax_bin_index_count(context, index, nullptr, 0) == 0xffff'ffff, "empty items");
+
+    // The data is checked as a whole
+    check_error(context, "read past end",
+                [&] { return abisnax_index_bin(context, index, handle, bin.data(), bin.size() - 1); });
+    check_part_error({}, "index is empty");
+    bin.push_back(0);
+    check_error(context, "Extra data",
+                [&] { return abisnax_index_bin(context, index, handle, bin.data(), bin.size()); });
+
+    // Destroyed indexes leave the context, and the others keep working
+    for (int i = 0; i < 1000; ++i) {
+        auto other = check_context(context, abisnax_create_bin_index(context));
+        check_context(context, abisnax_index_bin(context, other, empties, "\x02", 1));
+        check_context(context, abisnax_destroy_bin_index(context, other));
+        check_error(context, "unknown bin index", [&] { return abisnax_destroy_bin_index(context, other); });
+    }
+    check_context(context, abisnax_index_bin(context, index, empties, "\x03", 1));
+    check(abisnax_bin_index_count(context, index, nullptr, 0) == 3, "index after others are destroyed");
+
+    abisnax_destroy(context);
+}
+
+void check_abi_view() {
+    abisnax::abi_def def{};
+    abisnax::contract c{};
+    std::string error;
+    check(abisnax::json_to_native(def, error, transactionAbi), error.c_str());
+    check(abisnax::fill_contract(c, error, def), error.c_str());
+    auto get_type = [&](const char* name) {
+        const abisnax::abi_type* t;
+        std::map<std::string, abisnax::abi_type> scratch;
+        check(abisnax::get_type(t, error, c.abi_types, scratch, name, 0), error.c_str());
+        return t;
+    };
+    auto to_bin = [&](const abisnax::abi_type* type, const char* json) {
+        std::vector<char> bin;
+        check(abisnax::json_to_bin(bin, error, type, json), error.c_str());
+        return bin;
+    };
+
+    const char* trx = R"({"expiration":"2009-02-13T23:31:31.000","ref_block_num":1234,"ref_block_prefix":5678,)"
+                      R"("max_net_usage_words":0,"max_cpu_usage_ms":0,"delay_sec":0,"context_free_actions":[],)"
+                      R"("actions":[{"account":"snax.token","name":"transfer",)"
+                      R"("authorization":[{"actor":"useraaaaaaaa","permission":"active"}],)"
+                      R"("data":"0000000000855C34"},{"account":"snax","name":"newaccount",)"
+                      R"("authorization":[],"data":""}],"transaction_extensions":[]})";
+    auto bin = to_bin(get_type("transaction"), trx);
+    abisnax::abi_view view{get_type("transaction"), {bin.data(), bin.data() + bin.size()}};
+    check(bool(view), view.error.c_str());
+    check(view["ref_block_num"].as<uint16_t>() == 1234, "view uint16");
+    check(view["expiration"].as<abisnax::time_point_sec>()->utc_seconds == 1234567891, "view time_point_sec");
+    check(view["actions"].size() == 2 && view["context_free_actions"].size() == 0, "view array size");
+    check(view["actions"][1]["name"].as<abisnax::name>()->value == abisnax::name{"newaccount"}.value, "view name");
+    check(view["actions"][0]["authorization"][0]["actor"].as<abisnax::name>()->value ==
+              abisnax::name{"useraaaaaaaa"}.value,
+          "view nested name");
+    check(view["actions"][0]["data"].as_string_view() == std::string_view{"\0\0\0\0\0\x85\x5c\x34", 8},
+          "view bytes");
+    check(view["actions"][0]["data"].as_string_view()->data() > bin.data() &&
+              view["actions"][0]["data"].as_string_view()->data() < bin.data() + bin.size(),
+          "view points into the binary");
+    std::vector<std::string> names;
+    for (auto& action : view["actions"])
+        names.push_back(std::string(*action["account"].as<abisnax::name>()));
+    check(names == std::vector<std::string>{"snax.token", "snax"}, "view iteration");
+    for (auto& action : view["context_free_actions"])
+        check(!action, "view iteration over an empty array");
+
+    auto check_view_error = [&](const abisnax::abi_view& v, const std::string& expected) {
+        if (v || v.error != expected)
+            throw std::runtime_error("view error: " + v.error + " != " + expected);
+    };
+    check_view_error(view["nope"], R"(type "transaction" has no field "nope")");
+    check_view_error(view["actions"][2]["name"], R"(type "action[]" has no item 2)");
+    check_view_error(view["actions"]["name"], R"(can't select "name" in type "action[]")");
+    check_view_error(view["expiration"][0], R"(type "time_point_sec" isn't an array)");
+    check(!view["ref_block_num"].as<uint32_t>(), "view type mismatch");
+    uint32_t v32;
+    check(!view["ref_block_num"].as(v32, error) && error == R"(type "uint16" doesn't match)", "view type error");
+    check(!view["ref_block_num"].as_string_view(), "view string of a number");
+    check_view_error(abisnax::abi_view{get_type("transaction"), {bin.data(), bin.data() + bin.size() - 1}},
+                     "read past end");
+
+    const char* abi = R"({"version":"snax::abi/1.1","structs":[)"
+                      R"({"name":"v","base":"","fields":[{"name":"a","type":"uint16[]"},{"name":"o","type":"string?"},)"
+                      R"({"name":"w","type":"var"},{"name":"e","type":"int32$"}]}],)"
+                      R"("variants":[{"name":"var","types":["uint8","string"]}]})";
+    def = {};
+    c = {};
+    check(abisnax::json_to_native(def, error, abi), error.c_str());
+    check(abisnax::fill_contract(c, error, def), error.c_str());
+    bin = to_bin(get_type("v"), R"({"a":[1,2,3],"o":"x","w":["string","hi"]})");
+    view = {get_type("v"), {bin.data(), bin.data() + bin.size()}};
+    check(view["a"][2].as<uint16_t>() == 3, "view item of a fixed-size array");
+    check(view["o"].has_value() && view["o"].value().as_string_view() == "x", "view optional");
+    check(view["w"].variant_index() == 1 && view["w"].value().as_string_view() == "hi", "view variant");
+    check_view_error(view["e"], R"(field "e" is absent)");
+    bin = to_bin(get_type("v"), R"({"a":[],"o":null,"w":["uint8",7],"e":-1})");
+    view = {get_type("v"), {bin.data(), bin.data() + bin.size()}};
+    check(!view["o"].has_value() && view["w"].value().as<uint8_t>() == 7, "view empty optional");
+    check(view["e"].as<int32_t>() == -1, "view extension");
+    check_view_error(view["o"].value(), "optional is empty");
+}
+
+void check_json_sizes() {
+    auto context = check(abisnax_create());
+    auto token = check_context(context, abisnax_string_to_name(context, "snax.token"));
+    check_context(context, abisnax_set_abi_hex(context, token, tokenHexAbi));
+    auto type = check_context(context, abisnax_get_type_handle(context, token, "transfer"));
+    std::string json = R"({"from":"useraaaaaaaa","to":"useraaaaaaab","quantity":"0.0001 SNAX","memo":"a\"bé"})";
+    check_context(context, abisnax_json_to_bin(context, token, "transfer", json.c_str()));
+    std::string expected{abisnax_get_bin_data(context), size_t(abisnax_get_bin_size(context))};
+
+    auto check_bin = [&](const char* name, abisnax_bool ok) {
+        check_context(context, ok);
+        if (std::string{abisnax_get_bin_data(context), size_t(abisnax_get_bin_size(context))} != expected)
+            throw std::runtime_error(std::string{name} + ": wrong binary");
+    };
+    // The json is followed by more data, and isn't null-terminated
+    std::string buf = json + "]]]";
+    check_bin("json_to_bin_n", abisnax_json_to_bin_n(context, token, "transfer", buf.data(), json.size()));
+    check_bin("json_to_bin_reorderable_n",
+              abisnax_json_to_bin_reorderable_n(context, token, "transfer", buf.data(), json.size()));
+    check_bin("json_to_bin_handle_n", abisnax_json_to_bin_handle_n(context, type, buf.data(), json.size()));
+    check_bin("json_to_bin_reorderable_handle_n",
+              abisnax_json_to_bin_reorderable_handle_n(context, type, buf.data(), json.size()));
+    check_bin("json_to_bin_handle_insitu", abisnax_json_to_bin_handle_insitu(context, type, buf.data(), json.size()));
+    check(buf.substr(json.size()) == "]]]", "json_to_bin_handle_insitu writes past the json");
+
+    check_error(context, "transfer.memo: failed to parse",
+                [&] { return abisnax_json_to_bin_handle_n(context, type, json.data(), json.size() - 2); });
+    check(!abisnax_json_to_bin_handle_n(context, type, buf.data(), json.size() + 1), "json_to_bin_handle_n extra data");
+    buf = json;
+    check_error(context, "transfer.memo: failed to parse",
+                [&] { return abisnax_json_to_bin_handle_insitu(context, type, buf.data(), json.size() - 2); });
+    check_error(context, "transfer: failed to parse",
+                [&] { return abisnax_json_to_bin_handle_n(context, type, nullptr, 5); });
+
+    // A 0 within the json doesn't end it
+    std::string nul = json + std::string{"\0", 1} + json + " garbage";
+    check(!abisnax_json_to_bin_n(context, token, "transfer", nul.data(), nul.size()), "json_to_bin_n 0");
+    check(!abisnax_json_to_bin_reorderable_n(context, token, "transfer", nul.data(), nul.size()),
+          "json_to_bin_reorderable_n 0");
+    check(!abisnax_json_to_bin_handle_n(context, type, nul.data(), nul.size()), "json_to_bin_handle_n 0");
+    check(!abisnax_json_to_bin_reorderable_handle_n(context, type, nul.data(), nul.size()),
+          "json_to_bin_reorderable_handle_n 0");
+    buf = nul;
+    check(!abisnax_json_to_bin_handle_insitu(context, type, buf.data(), buf.size()), "json_to_bin_handle_insitu 0");
+    auto stream = check_context(context, abisnax_json_stream_begin_handle(context, type));
+    check(!abisnax_json_stream_feed(context, stream, nul.data(), nul.size()) ||
+              !abisnax_json_stream_end(context, stream),
+          "json stream 0");
+
+    abisnax_destroy(context);
+}
+
+void check_array_sizes() {
+    auto context = check(abisnax_create());
+    const char* abi = R"({"version":"snax::abi/1.1","structs":[)"
+                      R"({"name":"a","base":"","fields":[{"name":"x","type":"uint8[]"},{"name":"y","type":"b[]"},)"
+                      R"({"name":"s","type":"string"}]},)"
+                      R"({"name":"b","base":"","fields":[{"name":"z","type":"uint8[]"},)"
+                      R"({"name":"s","type":"string"}]}]})";
+    check_context(context, abisnax_set_abi(context, 0, abi));
+    auto handle = check_context(context, abisnax_get_type_handle(context, 0, "a"));
+
+    auto items = [](size_t n) {
+        std::string s = "[";
+        for (size_t i = 0; i < n; ++i)
+            s += (i ? "," : "") + std::to_string(i % 256);
+        return s + "]";
+    };
+    // The reorderable json_to_bin knows each array's size up front, so it doesn't need to make room for large ones
+    auto check_sizes = [&](size_t x, size_t y, size_t z) {
+        std::string json = R"({"x":)" + items(x) + R"(,"y":[)";
+        for (size_t i = 0; i < y; ++i)
+            json += std::string{i ? "," : ""} + R"({"z":)" + items(z) + R"(,"s":"b"})";
+        json += R"(],"s":"a"})";
+        check_context(context, abisnax_json_to_bin_reorderable(context, 0, "a", json.c_str()));
+        std::string expected = abisnax_get_bin_hex(context);
+        check_context(context, abisnax_json_to_bin(context, 0, "a", json.c_str()));
+        check(abisnax_get_bin_hex(context) == expected, "json_to_bin array sizes");
+        check_context(context, abisnax_json_to_bin_handle(context, handle, json.c_str()));
+        check(abisnax_get_bin_hex(context) == expected, "compiled json_to_bin array sizes");
+
+        // The *_into variants write straight into the buffer, and still report the size if it's too small
+        std::string bin{abisnax_get_bin_data(context), size_t(abisnax_get_bin_size(context))};
+        std::string buf(bin.size(), 0);
+        check(abisnax_json_to_bin_into(context, 0, "a", json.c_str(), buf.data(), buf.size()) == int64_t(bin.size()) &&
+                  buf == bin,
+              "json_to_bin_into array sizes");
+        buf.assign(bin.size(), 0);
+        check(abisnax_json_to_bin_handle_into(context, handle, json.c_str(), buf.data(), buf.size()) ==
+                      int64_t(bin.size()) &&
+                  buf == bin,
+              "json_to_bin_handle_into array sizes");
+        check(abisnax_json_to_bin_handle_into(context, handle, json.c_str(), buf.data(), buf.size() - 1) ==
+                  int64_t(bin.size()),
+              "json_to_bin_handle_into with a small buffer");
+    };
+    for (size_t x : {0, 1, 127, 128, 16383, 16384})
+        check_sizes(x, 0, 0);
+    check_sizes(3, 130, 200);
+    check_sizes(200, 2, 16384);
+
+    abisnax_destroy(context);
+}
+
+void check_reorderable_dom() {
+    auto context = check(abisnax_create());
+    const char* abi = R"({"version":"snax::abi/1.1","structs":[)"
+                      R"({"name":"a","base":"","fields":[{"name":"x","type":"uint8"},{"name":"y","type":"b[]"},)"
+                      R"({"name":"v","type":"v"},{"name":"e","type":"string$"}]},)"
+                      R"({"name":"b","base":"","fields":[{"name":"x","type":"uint16"},)"
+                      R"({"name":"s","type":"string?"}]}],)"
+                      R"("variants":[{"name":"v","types":["b","bool"]}]})";
+    check_context(context, abisnax_set_abi(context, 0, abi));
+
+    auto to_hex = [&](const char* json) {
+        check_context(context, abisnax_json_to_bin_reorderable(context, 0, "a", json));
+        return std::string{abisnax_get_bin_hex(context)};
+    };
+    auto expected = to_hex(R"({"x":1,"y":[{"x":2,"s":"z"},{"x":3,"s":null}],"v":["bool",true],"e":"q"})");
+    check(to_hex(R"({"e":"q","v":["bool",true],"y":[{"s":"z","x":2},{"x":3,"s":null}],"x":1})") == expected,
+          "reordered fields");
+    check(to_hex(R"({"x":7,"y":[{"x":2,"s":"z"},{"s":null,"x":3}],"q":{"x":[1]},"v":["bool",true],"e":"q","x":1})") ==
+              expected,
+          "duplicate and extra fields");
+    check(to_hex(R"({"x":1,"y":[],"v":["b",{"x":5,"s":null}]})") == "010000050000", "skipped extension");
+
+    // In-order json takes the streaming path; anything it rejects converts through the dom
+    auto handle = check_context(context, abisnax_get_type_handle(context, 0, "a"));
+    for (auto* json : {R"({"x":1,"y":[{"x":2,"s":"z"},{"x":3,"s":null}],"v":["bool",true],"e":"q"})",
+                       R"({"e":"q","v":["bool",true],"y":[{"s":"z","x":2},{"x":3,"s":null}],"x":1})",
+                       R"({"x":1,"y":[{"x":2,"s":"z"},{"x":3,"s":null}],"v":["bool",true],"e":"q","q":[]})"}) {
+        check_context(context, abisnax_json_to_bin_reorderable_handle(context, handle, json));
+        check(abisnax_get_bin_hex(context) == expected, "reorderable handle");
+        check(to_hex(json) == expected, "reorderable");
+    }
+
+    // Keys from earlier documents don't confuse later ones
+    for (int i = 0; i < 5000; ++i)
+        to_hex(("{\"k" + std::to_string(i) + R"(":0,"x":1,"y":[],"v":["bool",false]})").c_str());
+    check(to_hex(R"({"e":"q","v":["bool",true],"y":[{"s":"z","x":2},{"x":3,"s":null}],"x":1})") == expected,
+          "reordered fields after many keys");
+
+    check_error(context, "a.y[1]: expected field \"x\"", [&] {
+        return abisnax_json_to_bin_reorderable(context, 0, "a",
+                                               R"({"x":1,"y":[{"x":2,"s":null},{"s":null}],"v":["bool",true]})");
+    });
+    check_error(context, "a.v<variant>: type is not valid for this variant", [&] {
+        return abisnax_json_to_bin_reorderable(context, 0, "a", R"({"x":1,"y":[],"v":["c",true]})");
+    });
+    check_error(context, "a.y[0].s: expected string", [&] {
+        return abisnax_json_to_bin_reorderable(context, 0, "a", R"({"x":1,"y":[{"s":[],"x":2}],"v":["bool",true]})");
+    });
+
+    abisnax_destroy(context);
+}
+
+void check_into() {
+    auto context = check(abisnax_create());
+    check_context(context, abisnax_set_abi(context, 0, transactionAbi));
+    const char* json = R"({"actor":"useraaaaaaaa","permission":"active"})";
+    auto type = check_context(context, abisnax_get_type_handle(context, 0, "permission_level[]"));
+
+    char bin[64];
+    check(abisnax_json_to_bin_into(context, 0, "permission_level", json, bin, 4) == 16, "json_to_bin_into size");
+    check(abisnax_json_to_bin_into(context, 0, "permission_level", json, bin, sizeof(bin)) == 16, "json_to_bin_into");
+    check_context(context, abisnax_json_to_bin(context, 0, "permission_level", json));
+    check(!memcmp(bin, abisnax_get_bin_data(context), 16), "json_to_bin_into data");
+
+    char out[128];
+    check(abisnax_bin_to_json_into(context, 0, "permission_level", bin, 16, out, 10) == (int64_t)strlen(json),
+          "bin_to_json_into size");
+    check(abisnax_bin_to_json_into(context, 0, "permission_level", bin, 16, out, sizeof(out)) == (int64_t)strlen(json),
+          "bin_to_json_into");
+    check(std::string(out, strlen(json)) == json, "bin_to_json_into data");
+
+    auto size = abisnax_json_to_bin_handle_into(context, type, (std::string{"["} + json + "," + json + "]").c_str(),
+                                                bin, sizeof(bin));
+    check(size == 33, "json_to_bin_handle_into");
+    check(abisnax_bin_to_json_handle_into(context, type, bin, size, out, sizeof(out)) == 2 * (int64_t)strlen(json) + 3,
+          "bin_to_json_handle_into");
+
+    check_error(context, "read past end",
+                [&] { return abisnax_bin_to_json_into(context, 0, "permission_level", bin, 15, out, 0) >= 0; });
+    check_error(context, R"(unknown type "foo")",
+                [&] { return abisnax_json_to_bin_into(context, 0, "foo", json, bin, sizeof(bin)) >= 0; });
+
+    abisnax_destroy(context);
+}
+
+void check_json_stream() {
+    auto context = check(abisnax_create());
+    auto token = check_context(context, abisnax_string_to_name(context, "snax.token"));
+    check_context(context, abisnax_set_abi(context, 0, transactionAbi));
+    check_context(context, abisnax_set_abi_hex(context, token, tokenHexAbi));
+
+    auto result = [&](bool ok) {
+        return ok ? std::string{"ok "} + abisnax_get_bin_hex(context)
+                  : std::string{"error "} + abisnax_get_error(context);
+    };
+    // Converts json split every chunk_size bytes, with the split moved along by offset
+    auto stream = [&](uint64_t contract, const char* type, std::string_view json, size_t chunk_size, size_t offset) {
+        auto* s = check_context(context, abisnax_json_stream_begin(context, contract, type));
+        for (size_t pos = 0, end = std::min(offset, json.size()); pos < json.size();
+             pos = end, end = std::min(end + chunk_size, json.size()))
+            if (!abisnax_json_stream_feed(context, s, json.data() + pos, end - pos))
+                break;
+        return result(abisnax_json_stream_end(context, s));
+    };
+    auto whole = [&](uint64_t contract, const char* type, const std::string& json) {
+        return result(abisnax_json_to_bin(context, contract, type, json.c_str()));
+    };
+    auto check_splits = [&](uint64_t contract, const char* type, const std::string& json) {
+        auto expected = whole(contract, type, json);
+        for (size_t chunk_size : {1, 2, 3, 7})
+            for (size_t offset = 0; offset < chunk_size; ++offset)
+                check(stream(contract, type, json, chunk_size, offset) == expected, ("stream " + json).c_str());
+        for (size_t offset = 0; offset <= json.size(); ++offset)
+            check(stream(contract, type, json, json.size(), offset) == expected, ("stream " + json).c_str());
+        return expected;
+    };
+
+    check(check_splits(token, "transfer",
+                       R"({"from":"useraaaaaaaa","to":"useraaaaaaab","quantity":"0.0001 SNAX",)"
+                       R"("memo":"a\"b\\c\/\né😀 Aé"})")
+                  .substr(0, 3) == "ok ",
+          "stream transfer");
+    check_splits(0, "transaction",
+                 R"( {"expiration":"2009-02-13T23:31:31.000","ref_block_num":1234,"ref_block_prefix":5678,)"
+                 R"("max_net_usage_words":0,"max_cpu_usage_ms":0,"delay_sec":0,"context_free_actions":[],)"
+                 R"("actions":[{"account":"snax.token","name":"transfer","authorization":[{"actor":"useraaaaaaaa",)"
+                 R"("permission":"active"}],)"
+                 R"("data":"608C31C6187315D6708C31C6187315D60100000000000000045359530000000000"}],)"
+                 R"("transaction_extensions":[]} )");
+    check_splits(0, "int16[]", "[1, -2,3e2 , 0, -0.0e+1, 32767,-32768]");
+    check_splits(0, "float64[]", "[1.5, -2.25e-3, 0.0, 1e10]");
+    check_splits(0, "bool[]", "[true,false ,true]");
+    check_splits(0, "string[]", R"(["",  "x\t", "\u0041\u00e9"])");
+    check_splits(0, "permission_level[]",
+                 R"([{"actor":"useraaaaaaaa","permission":"active"},{"actor":"a","permission":""}])");
+
+    for (auto* json : {"", " ", "[", "[1,]", "[1 2]", "[01]", "[1.]", "[-]", "[1e]", "[1-2]", "[tru]", "[nul]",
+                       "[truex]", "[true]x", "[1][2]", R"(["a)", R"(["\x"])", R"(["\u12"])", R"(["\ud800"])",
+                       R"(["\udc00"])", "[\"\x01\"]", "{}", "[300]", "[1}", "{\"a\":1]"})
+        check_splits(0, "uint8[]", json);
+    for (auto* json :
+         {"[\"\xc0\xaf\"]", "[\"\xed\xa0\x80\"]", "[\"\xf4\x90\x80\x80\"]", "[\"\xe2\x82\"]", "[\"\xff\"]"})
+        check(stream(0, "string[]", json, 1, 0) == "error [-1]: failed to parse", "stream invalid utf-8");
+    check_splits(0, "string[]", "[\"\xe2\x82\xac\xf0\x9f\x98\x80\"]");
+    check_splits(token, "transfer", R"({"to":"useraaaaaaab","from":"useraaaaaaaa"})");
+    check_splits(token, "transfer", R"({"from":"useraaaaaaaa","to":"useraaaaaaab","quantity":5})");
+
+    // Streams are independent of each other and of the other functions
+    auto* a = check_context(context, abisnax_json_stream_begin(context, 0, "uint8[]"));
+    auto* b = check_context(context, abisnax_json_stream_begin(context, 0, "string"));
+    check_context(context, abisnax_json_stream_feed(context, a, "[1,", 3));
+    check_context(context, abisnax_json_stream_feed(context, b, "\"ab", 3));
+    check_context(context, abisnax_json_to_bin(context, 0, "uint8", "7"));
+    check_context(context, abisnax_json_stream_feed(context, a, "2]", 2));
+    check_context(context, abisnax_json_stream_end(context, a));
+    check(abisnax_get_bin_hex(context) == std::string{"020102"}, "stream a");
+    check_context(context, abisnax_json_stream_feed(context, b, "c\"", 2));
+    check_context(context, abisnax_json_stream_end(context, b));
+    check(abisnax_get_bin_hex(context) == std::string{"03616263"}, "stream b");
+    check_error(context, "stream is not open", [&] { return abisnax_json_stream_end(context, b); });
+    check_error(context, "stream is not open", [&] { return abisnax_json_stream_feed(context, b, "1", 1); });
+    auto other = check(abisnax_create());
+    check_context(other, abisnax_set_abi(other, 0, transactionAbi));
+    auto* foreign = check_context(other, abisnax_json_stream_begin(other, 0, "uint8"));
+    check_error(context, "stream is not open", [&] { return abisnax_json_stream_feed(context, foreign, "1", 1); });
+    check_error(context, "stream is not open", [&] { return abisnax_json_stream_end(context, foreign); });
+    check_context(other, abisnax_json_stream_feed(other, foreign, "1", 1));
+    check_context(other, abisnax_json_stream_end(other, foreign));
+    abisnax_destroy(other);
+
+    // Abandoned streams can be destroyed early
+    for (int i = 0; i < 1000; ++i) {
+        auto* s = check_context(context, abisnax_json_stream_begin(context, 0, "uint8[]"));
+        check_context(context, abisnax_json_stream_feed(context, s, "[1,", 3));
+        check_context(context, abisnax_json_stream_destroy(context, s));
+        check_error(context, "stream is not open", [&] { return abisnax_json_stream_destroy(context, s); });
+        check_error(context, "stream is not open", [&] { return abisnax_json_stream_end(context, s); });
+    }
+    check_error(context, "type handle is null", [&] { return abisnax_json_stream_begin_handle(context, nullptr); });
+
+    abisnax_destroy(context);
+}
+
+void check_batch() {
+    auto context = check(abisnax_create());
+    auto token = check_context(context, abisnax_string_to_name(context, "snax.token"));
+    check_context(context, abisnax_set_abi(context, 0, transactionAbi));
+    check_context(context, abisnax_set_abi_hex(context, token, tokenHexAbi));
+
+    const char* transfer = R"({"from":"useraaaaaaaa","to":"useraaaaaaab","quantity":"0.0001 SNAX","memo":"x"})";
+    check_context(context, abisnax_json_to_bin(context, token, "transfer", transfer));
+    std::vector<char> transfer_bin(abisnax_get_bin_data(context),
+                                   abisnax_get_bin_data(context) + abisnax_get_bin_size(context));
+
+    uint64_t contracts[] = {token, 0, token, 0, token};
+    const char* types[] = {"transfer", "uint8[]", "transfer", "foo", "transfer"};
+    const char* data[] = {transfer_bin.data(), "\x02\x01\x02", transfer_bin.data(), "", transfer_bin.data()};
+    size_t sizes[] = {transfer_bin.size(), 3, 12, 0, transfer_bin.size()};
+    auto* results = check_context(context, abisnax_bin_to_json_batch(context, 5, contracts, types, data, sizes));
+    auto* arena = abisnax_get_batch_arena(context);
+    auto get = [&](int i) { return std::string{arena + results[i].offset, results[i].size}; };
+
+    check(results[0].ok && get(0) == transfer, "batch 0");
+    check(results[1].ok && get(1) == "[1,2]", "batch 1");
+    check(!results[2].ok && get(2) == "read past end", "batch 2");
+    check(!results[3].ok && get(3) == R"(unknown type "foo")", "batch 3");
+    check(results[4].ok && std::string{arena + results[4].offset} == transfer, "batch 4");
+
+    check_error(context, "batch arrays are null",
+                [&] { return abisnax_bin_to_json_batch(context, 1, nullptr, types, data, sizes); });
+    abisnax_destroy(context);
+}
+
 int main() {
     try {
         check_types();
+        check_registry();
+        check_registry_threads();
+        check_type_handles();
+        check_abi_versions();
+        check_abi_cache();
+        check_lazy_abis();
+        check_const_lookup();
+        check_fixed_sizes();
+        check_compiled_bin_to_json();
+        check_compiled_json_to_bin();
+        check_codecs();
+        check_jit();
+        check_validate();
+        check_projections();
+        check_predicates();
+        check_bin_index();
+        check_abi_view();
+        check_json_sizes();
+        check_array_sizes();
+        check_reorderable_dom();
+        check_into();
+        check_json_stream();
+        check_batch();
         printf("\nok\n\n");
         return 0;
     } catch (std::exception& e) {